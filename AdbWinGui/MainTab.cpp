@@ -119,6 +119,8 @@ void MainTab::OnBtnRefreshClick(UINT uNotifyCode, int nID, CWindow wndCtl)
 void MainTab::OnBtnStopInstallClick(UINT uNotifyCode, int nID, CWindow wndCtl)
 {
 	m_bIsCancelled = TRUE;
+	// wakes the install thread even if it is blocked on adb
+	m_cancelToken.Cancel();
 }
 
 LRESULT MainTab::OnListKeyDown(LPNMHDR pnmh)
@@ -305,6 +307,11 @@ bool MainTab::IsCancelled()
 	return m_bIsCancelled ? true : false;
 }
 
+CancellationToken* MainTab::GetCancellationToken()
+{
+	return &m_cancelToken;
+}
+
 void MainTab::PrepareAdb()
 {
 	GetParent().PostMessage(MSG_MAIN_PREPARE_ADB);
@@ -369,6 +376,7 @@ void MainTab::OnDefaultInstallDialog(LPCTSTR lpszApkPath)
 void MainTab::OnInstallApkDirect(LPCTSTR lpszApkPath, BOOL bNotifyMainFrame)
 {
 	m_bIsCancelled = FALSE;
+	m_cancelToken.Reset();
 	m_strErrMsg.Empty();
 
 	TCHAR* szApkPath = new TCHAR[MAX_PATH];
@@ -408,6 +416,7 @@ void MainTab::OnInstallApkDirect(LPCTSTR lpszApkPath, BOOL bNotifyMainFrame)
 void MainTab::OnCopyAndInstallApk(LPCTSTR lpszApkPath)
 {
 	m_bIsCancelled = FALSE;
+	m_cancelToken.Reset();
 	m_strErrMsg.Empty();
 
 	TCHAR* szSrcPath = new TCHAR[MAX_PATH];
@@ -31,6 +31,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "CDialogColor.h"
 #include "CDialogToolTip.h"
 #include "../DDMLib/DDMLib/IDevice.h"
+#include "../DDMLib/DDMLib/CancellationToken.h"
 
 class MainTab : public CDialogImpl<MainTab>, public CDialogResize<MainTab>,
 				public CDialogColor<MainTab>, public CDialogToolTip<MainTab>,
@@ -69,6 +70,7 @@ public:
 
 	InstallStatus m_emStatus;
 	BOOL m_bIsCancelled;
+	CancellationToken m_cancelToken;
 	CString m_strErrMsg;
 
 public:
@@ -128,6 +130,7 @@ public:
 	virtual void OnRemove() override;
 	virtual void OnErrorMessage(const TString errMsg);
 	virtual bool IsCancelled() override;
+	virtual CancellationToken* GetCancellationToken() override;
 
 private:
 	void PrepareAdb();
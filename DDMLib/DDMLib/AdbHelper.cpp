@@ -18,10 +18,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "AdbHelper.h"
 #include <thread>
+#include "CancellationToken.h"
 #include "DdmPreferences.h"
 #include "../System/SocketCore.h"
 #include "Log.h"
 #include "StringUtils.h"
+#include "TransferScheduler.h"
 
 #define DDMS			_T("ddms")
 #define WAIT_TIME		5 // spin-wait sleep, in ms
@@ -47,17 +49,22 @@ int AdbHelper::ReleaseSocket()
 }
 
 const char* AdbHelper::FormAdbRequest(const char* req)
+{
+	return FormAdbRequest(req, static_cast<int>(strlen(req)));
+}
+
+const char* AdbHelper::FormAdbRequest(const char* req, int length)
 {
 	std::ostringstream ss;
 	ss.fill(_T('0'));
 	ss.width(4);
-	ss << std::hex << strlen(req);
-	ss << req;
+	ss << std::hex << length;
+	ss.write(req, length);
 
 	std::string& resultStr = ss.str();
 	size_t size = resultStr.length() + 1;
 	char* result = new char[size];
-	strcpy(result, resultStr.c_str());
+	memcpy(result, resultStr.c_str(), size);
 
 	return result;
 }
@@ -112,16 +119,75 @@ int AdbHelper::ExecuteRemoteCommand(const SocketAddress& adbSockAddr, const TStr
 }
 
 int AdbHelper::ExecuteRemoteCommand(const SocketAddress& adbSockAddr, AdbService adbService, const TString command,
-	IDevice* device, IShellOutputReceiver* rcvr, long maxTimeToOutputResponse, CharStreamReader* reader)
+	IDevice* device, IShellOutputReceiver* rcvr, long maxTimeToOutputResponse, CharStreamReader* reader,
+	SyncService::ISyncProgressMonitor* monitor)
+{
+	const char* enumValue = s_arrAdbService[static_cast<int>(adbService)];
+	const char* szCommand = NULL;
+#ifdef _UNICODE
+	std::string strCmd;
+	ConvertUtils::WstringToString(command, strCmd);
+	szCommand = strCmd.c_str();
+#else
+	szCommand = command;
+#endif
+	std::ostringstream oss;
+	oss << enumValue << ":" << szCommand;
+	return ExecuteRemoteService(adbSockAddr, oss.str(), command, device, rcvr, maxTimeToOutputResponse,
+		reader, monitor);
+}
+
+int AdbHelper::ExecuteAbbCommand(const SocketAddress& adbSockAddr, const std::vector<std::tstring>& args,
+	IDevice* device, IShellOutputReceiver* rcvr, long maxTimeToOutputResponse)
+{
+	// abb_exec takes the arguments apart, NUL separated, no shell parses them
+	std::string service("abb_exec:");
+	std::tstring command;
+	for (size_t i = 0; i < args.size(); i++)
+	{
+		if (i > 0)
+		{
+			service.push_back('\0');
+			command.push_back(_T(' '));
+		}
+#ifdef _UNICODE
+		std::string strArg;
+		ConvertUtils::WstringToString(args[i].c_str(), strArg);
+		service.append(strArg);
+#else
+		service.append(args[i]);
+#endif
+		command.append(args[i]);
+	}
+	return ExecuteRemoteService(adbSockAddr, service, command.c_str(), device, rcvr, maxTimeToOutputResponse,
+		NULL/* StreamReader */, NULL);
+}
+
+int AdbHelper::ExecuteRemoteService(const SocketAddress& adbSockAddr, const std::string& service,
+	const TString command, IDevice* device, IShellOutputReceiver* rcvr, long maxTimeToOutputResponse,
+	CharStreamReader* reader, SyncService::ISyncProgressMonitor* monitor)
 {
 	LogVEx(DDMS, _T("execute: running %s"), command);
 
+	CancellationToken* token = rcvr != NULL ? rcvr->GetCancellationToken() : NULL;
+	if (token == NULL && monitor != NULL)
+	{
+		token = monitor->GetCancellationToken();
+	}
+	if (token != NULL && token->IsCancelled())
+	{
+		LogV(DDMS, _T("execute: cancelled"));
+		return -1;
+	}
+
 	std::unique_ptr<SocketClient> adbClient(SocketClient::Open(adbSockAddr));
 	if (!adbClient)
 	{
 		return -1;
 	}
 	adbClient->ConfigureBlocking(false);
+	// a cancel closes the connection, which makes adb kill the remote command
+	CancellationToken::Scope cancelScope(token, adbClient.get(), CancellationToken::PHASE_CONNECT);
 
 	// if the device is not -1, then we first tell adb we're looking to
 	// talk
@@ -129,32 +195,35 @@ int AdbHelper::ExecuteRemoteCommand(const SocketAddress& adbSockAddr, AdbService
 	bool bRet = SetDevice(adbClient.get(), device);
 	if (!bRet)
 	{
+		adbClient->Close();
 		return -1;
 	}
 
-	const char* enumValue = s_arrAdbService[static_cast<int>(adbService)];
-	const char* szCommand = NULL;
-#ifdef _UNICODE
-	std::string strCmd;
-	ConvertUtils::WstringToString(command, strCmd);
-	szCommand = strCmd.c_str();
-#else
-	szCommand = command;
-#endif
-	std::ostringstream oss;
-	oss << enumValue << ":" << szCommand;
-	std::string& resultStr = oss.str();
-	std::unique_ptr<const char[]> request(FormAdbRequest(resultStr.c_str()));
-	bRet = Write(adbClient.get(), request.get());
+	const int requestLength = static_cast<int>(service.length());
+	std::unique_ptr<const char[]> request(FormAdbRequest(service.c_str(), requestLength));
+	bRet = Write(adbClient.get(), request.get(), requestLength + 4);
 	if (!bRet)
 	{
+		adbClient->Close();
 		return -1;
 	}
 
 	std::unique_ptr<AdbResponse> resp(ReadAdbResponse(adbClient.get(), false /* readDiagString */));
 	if (!resp || !resp->okay)
 	{
-		LogEEx(DDMS, _T("ADB rejected shell command (%s): %s"), command, resp->message);
+		if (cancelScope.IsCancelled())
+		{
+			LogCancelled(command, token);
+		}
+		else if (resp)
+		{
+			LogEEx(DDMS, _T("ADB rejected shell command (%s): %s"), command, resp->message);
+		}
+		else
+		{
+			LogEEx(DDMS, _T("No response from adb to shell command (%s)"), command);
+		}
+		adbClient->Close();
 		return -1;
 	}
 
@@ -165,19 +234,49 @@ int AdbHelper::ExecuteRemoteCommand(const SocketAddress& adbSockAddr, AdbService
 	if (reader != NULL)
 	{
 		int read;
-		while ((read = reader->ReadData(data, bufferLen)) != -1)
+		cancelScope.Enter(CancellationToken::PHASE_UPLOAD);
+		// streamed input is a bulk transfer, paced like a sync push
+		TransferScheduler::Flow flow(device->GetSerialNumber());
+		// files report the end with an empty read, pipes with an error
+		while ((read = reader->ReadData(data, bufferLen)) > 0)
 		{
-			int written = 0;
-			written += adbClient->Write(data, read);
-			if (written != read)
+			if (monitor != NULL && monitor->IsCanceled())
 			{
-				LogEEx(DDMS, _T("ADB write inconsistency, wrote %d expected %d"), written, read);
+				LogV(DDMS, _T("execute: cancelled"));
+				adbClient->Close();
 				return -1;
 			}
+			if (!flow.Consume(read, monitor != NULL ? monitor : SyncService::GetNullProgressMonitor()))
+			{
+				LogV(DDMS, _T("execute: cancelled"));
+				adbClient->Close();
+				return -1;
+			}
+			bRet = Write(adbClient.get(), data, read, DdmPreferences::GetTimeOut());
+			if (!bRet)
+			{
+				if (cancelScope.IsCancelled())
+				{
+					LogCancelled(command, token);
+				}
+				else
+				{
+					LogE(DDMS, _T("ADB write failed while streaming input"));
+				}
+				adbClient->Close();
+				return -1;
+			}
+			if (monitor != NULL)
+			{
+				monitor->Advance(read);
+			}
 		}
 	}
 
 	ZeroMemory(data, sizeof(char) * bufferLen);
+	cancelScope.Enter(CancellationToken::PHASE_OUTPUT);
+	// a blocking read would otherwise never give up on a silent command
+	adbClient->SetTimeout(static_cast<int>(maxTimeToOutputResponse));
 	long timeToResponseCount = 0;
 	int err = 0;
 	while (true)
@@ -213,7 +312,10 @@ int AdbHelper::ExecuteRemoteCommand(const SocketAddress& adbSockAddr, AdbService
 		{
 			err = 0;
 			// we're at the end, we flush the output
-			rcvr->Flush();
+			if (rcvr != NULL)
+			{
+				rcvr->Flush();
+			}
 			LogVEx(DDMS, _T("execute '%s' on '%s' : EOF hit. Read: %d"),
 				command, device->GetSerialNumber(), count);
 			break;
@@ -222,6 +324,7 @@ int AdbHelper::ExecuteRemoteCommand(const SocketAddress& adbSockAddr, AdbService
 		{
 			// reset timeout
 			timeToResponseCount = 0;
+			TransferScheduler::GetInstance().Charge(device->GetSerialNumber(), count);
 
 			// send data to receiver if present
 			if (rcvr != NULL)
@@ -238,6 +341,10 @@ int AdbHelper::ExecuteRemoteCommand(const SocketAddress& adbSockAddr, AdbService
 	{
 		adbClient->Close();
 	}
+	if (cancelScope.IsCancelled())
+	{
+		LogCancelled(command, token);
+	}
 	LogV(DDMS, _T("execute: returning"));
 	if (err != 0)
 	{
@@ -246,6 +353,12 @@ int AdbHelper::ExecuteRemoteCommand(const SocketAddress& adbSockAddr, AdbService
 	return 0;
 }
 
+void AdbHelper::LogCancelled(const TString command, const CancellationToken* token)
+{
+	LogIEx(DDMS, _T("execute '%s' cancelled during %s"), command,
+		CancellationToken::GetPhaseName(token->GetCancelledPhase()));
+}
+
 bool AdbHelper::Read(SocketClient* client, char* data, int length)
 {
 	return Read(client, data, length, DdmPreferences::GetTimeOut());
@@ -264,7 +377,7 @@ bool AdbHelper::Read(SocketClient* client, char* data, int length, int timeout)
 	{
 		int count;
 
-		count = client->Read(data, length);
+		count = client->Read(data + readCount, length - readCount);
 		if (count < 0)
 		{
 			int err = GetLastError();
@@ -288,14 +401,15 @@ bool AdbHelper::Read(SocketClient* client, char* data, int length, int timeout)
 		}
 		else if (count == 0)
 		{
-			// normal finished
-			break;
+			// channel closed before the whole message arrived
+			LogD(DDMS, _T("read: channel closed"));
+			return false;
 		}
 		else
 		{
 			numWaits = 0;
+			readCount += count;
 		}
-		readCount += count;
 	}
 	return true;
 }
@@ -318,7 +432,7 @@ bool AdbHelper::Write(SocketClient* client, const char* data, int length, int ti
 	{
 		int count;
 
-		count = client->Write(data, length);
+		count = client->Write(data + writeCount, length - writeCount);
 		if (count < 0)
 		{
 			int err = GetLastError();
@@ -348,8 +462,8 @@ bool AdbHelper::Write(SocketClient* client, const char* data, int length, int ti
 		else
 		{
 			numWaits = 0;
+			writeCount += count;
 		}
-		writeCount += count;
 	}
 	return true;
 }
@@ -391,4 +505,40 @@ bool AdbHelper::SetDevice(SocketClient* client, const IDevice* device)
 		}
 	}
 	return false;
-}
\ No newline at end of file
+}
+
+bool AdbHelper::GetFeatures(const SocketAddress& adbSockAddr, const IDevice* device, std::string& features)
+{
+	std::unique_ptr<SocketClient> adbClient(SocketClient::Open(adbSockAddr));
+	if (!adbClient)
+	{
+		return false;
+	}
+	adbClient->ConfigureBlocking(false);
+
+	const char* serialNumber;
+#ifdef _UNICODE
+	std::string strSn;
+	ConvertUtils::WstringToString(device->GetSerialNumber(), strSn);
+	serialNumber = strSn.c_str();
+#else
+	serialNumber = device->GetSerialNumber();
+#endif
+	std::ostringstream oss;
+	oss << "host-serial:" << serialNumber << ":features";
+	std::unique_ptr<const char[]> request(FormAdbRequest(oss.str().c_str()));
+
+	bool bRet = Write(adbClient.get(), request.get());
+	if (bRet)
+	{
+		// the feature list follows the OKAY as a length prefixed string
+		std::unique_ptr<AdbResponse> resp(ReadAdbResponse(adbClient.get(), true /* readDiagString */));
+		bRet = resp && resp->okay;
+		if (bRet)
+		{
+			features = resp->message;
+		}
+	}
+	adbClient->Close();
+	return bRet;
+}
@@ -22,6 +22,7 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "../System/SocketClient.h"
 #include "../System/StreamReader.h"
 #include "IDevice.h"
+#include "SyncService.h"
 
 #define ADB_SERVICE_COUT  2
 
@@ -47,16 +48,27 @@ public:
 	static int GetLastError();
 	static int ReleaseSocket();
 	static const char* FormAdbRequest(const char* req);	// need delete return string
+	static const char* FormAdbRequest(const char* req, int length);	// need delete return string
 	static AdbResponse* ReadAdbResponse(SocketClient* client, bool readDiagString);	// need delete return object
 	static int ExecuteRemoteCommand(const SocketAddress& adbSockAddr,
 		const TString command, IDevice* device, IShellOutputReceiver* rcvr, long maxTimeToOutputResponse);
 	static int ExecuteRemoteCommand(const SocketAddress& adbSockAddr, AdbService adbService,
 		const TString command, IDevice* device, IShellOutputReceiver* rcvr, long maxTimeToOutputResponse,
-		CharStreamReader* reader);
+		CharStreamReader* reader, SyncService::ISyncProgressMonitor* monitor = NULL);
+	// runs a binder command through abb_exec:, args[0] names the service
+	static int ExecuteAbbCommand(const SocketAddress& adbSockAddr, const std::vector<std::tstring>& args,
+		IDevice* device, IShellOutputReceiver* rcvr, long maxTimeToOutputResponse);
 	static bool Read(SocketClient* client, char* data, int length);
 	static bool Read(SocketClient* client, char* data, int length, int timeout);
 	static bool Write(SocketClient* client, const char* data, int length = -1);
 	static bool Write(SocketClient* client, const char* data, int length, int timeout);
 	static bool IsOkay(char* reply);
 	static bool SetDevice(SocketClient* client, const IDevice* device);
+	static bool GetFeatures(const SocketAddress& adbSockAddr, const IDevice* device, std::string& features);
+
+private:
+	static int ExecuteRemoteService(const SocketAddress& adbSockAddr, const std::string& service,
+		const TString command, IDevice* device, IShellOutputReceiver* rcvr, long maxTimeToOutputResponse,
+		CharStreamReader* reader, SyncService::ISyncProgressMonitor* monitor);
+	static void LogCancelled(const TString command, const CancellationToken* token);
 };
\ No newline at end of file
@@ -17,9 +17,10 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "AdbVersion.h"
-#include <regex>
+#include <algorithm>
+#include <climits>
+#include "StringUtils.h"
 
-#define ADB_VERSION_PATTERN	_T("^.*(\\d+)\\.(\\d+)\\.(\\d+).*")
 AdbVersion* const AdbVersion::UNKNOWN = new AdbVersion(-1, -1, -1);
 
 AdbVersion::AdbVersion(int major, int minor, int micro) :
@@ -90,28 +91,47 @@ bool AdbVersion::operator < (const AdbVersion& o)
 	return false;
 }
 
+// gives what matching "^.*(\d+)\.(\d+)\.(\d+).*" did: the greedy prefix leaves the last
+// x.y.z of the line, and its major is only the digit right before the first dot
 AdbVersion* AdbVersion::ParseFrom(const TString input)
 {
-	std::tregex rxAdb(ADB_VERSION_PATTERN);
-	std::tsmatch results;
-	std::tstring parseLine(input);
-	if (std::regex_match(parseLine, results, rxAdb) && results.size() == 4)
+	const TCHAR* end = input + _tcslen(input);
+	if (std::any_of(input, end, StringUtils::IsLineTerminator<TCHAR>))
 	{
-		if (results[0].matched)
+		return UNKNOWN;
+	}
+	for (const TCHAR* dot = end - 1; dot > input; dot--)
+	{
+		if (*dot != _T('.') || !StringUtils::IsDigit(dot[-1]))
+		{
+			continue;
+		}
+		const TCHAR* minorEnd = std::find_if_not(dot + 1, end, StringUtils::IsDigit<TCHAR>);
+		if (minorEnd == dot + 1 || minorEnd == end || *minorEnd != _T('.'))
 		{
-			std::tstringstream tss;
-			int major = 0, minor = 0, micro = 0;
-			tss << results[1].str();
-			tss >> major;
-			tss.clear();
-			tss << results[2].str();
-			tss >> minor;
-			tss.clear();
-			tss << results[3].str();
-			tss >> micro;
-			tss.clear();
-			return new AdbVersion(major, minor, micro);
+			continue;
 		}
+		const TCHAR* microEnd = std::find_if_not(minorEnd + 1, end, StringUtils::IsDigit<TCHAR>);
+		if (microEnd == minorEnd + 1)
+		{
+			continue;
+		}
+		return new AdbVersion(dot[-1] - _T('0'), ParseNumber(dot + 1, minorEnd), ParseNumber(minorEnd + 1, microEnd));
 	}
 	return UNKNOWN;
 }
+
+// saturates like reading the digits with a stream did
+int AdbVersion::ParseNumber(const TCHAR* begin, const TCHAR* end)
+{
+	long long value = 0;
+	for (const TCHAR* p = begin; p != end; p++)
+	{
+		value = value * 10 + (*p - _T('0'));
+		if (value > INT_MAX)
+		{
+			return INT_MAX;
+		}
+	}
+	return static_cast<int>(value);
+}
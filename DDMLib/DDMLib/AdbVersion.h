@@ -39,4 +39,7 @@ public:
 	bool operator < (const AdbVersion&);
 
 	static AdbVersion* ParseFrom(const TString input);
+
+private:
+	static int ParseNumber(const TCHAR* begin, const TCHAR* end);
 };
@@ -20,6 +20,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "StringUtils.h"
 #include "AndroidEnvVar.h"
 #include "DdmPreferences.h"
+#include "SyncSessionManager.h"
+#include "ShellSessionPool.h"
 #include "../System/Process.h"
 #include "../System/StreamReader.h"
 
@@ -218,6 +220,8 @@ void AndroidDebugBridge::DisconnectBridge()
 		delete s_pThis;
 		s_pThis = NULL;
 	}
+	SyncSessionManager::GetInstance().CloseAll();
+	ShellSessionPool::GetInstance().CloseAll();
 }
 
 AndroidDebugBridge& AndroidDebugBridge::GetBridge()
@@ -424,6 +428,9 @@ void AndroidDebugBridge::DeviceConnected(const IDevice* device)
 
 void AndroidDebugBridge::DeviceDisconnected(const IDevice* device)
 {
+	SyncSessionManager::GetInstance().CloseSessions(device->GetSerialNumber());
+	ShellSessionPool::GetInstance().CloseSessions(device->GetSerialNumber());
+
 	s_lockMember.lock();
 	if (s_setDeviceListeners.size() == 0)
 	{
@@ -39,4 +39,12 @@ public:
 
 		return v;
 	}
+
+	static long long Swap64bitFromArray(char* value, int offset)
+	{
+		long long v = static_cast<unsigned int>(Swap32bitFromArray(value, offset));
+		v |= static_cast<long long>(Swap32bitFromArray(value, offset + 4)) << 32;
+
+		return v;
+	}
 };
\ No newline at end of file
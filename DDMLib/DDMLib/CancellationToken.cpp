@@ -0,0 +1,134 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "CancellationToken.h"
+#include "../System/SocketClient.h"
+
+CancellationToken::CancellationToken() : m_nPhase(PHASE_NONE), m_nCancelledPhase(PHASE_NONE)
+{
+	m_hEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+}
+
+CancellationToken::~CancellationToken()
+{
+	if (m_hEvent != NULL)
+	{
+		::CloseHandle(m_hEvent);
+	}
+}
+
+void CancellationToken::Cancel()
+{
+	if (!IsCancelled())
+	{
+		m_nCancelledPhase = m_nPhase.load();
+	}
+	::SetEvent(m_hEvent);
+}
+
+void CancellationToken::Reset()
+{
+	::ResetEvent(m_hEvent);
+	m_nPhase = PHASE_NONE;
+	m_nCancelledPhase = PHASE_NONE;
+}
+
+bool CancellationToken::IsCancelled() const
+{
+	return ::WaitForSingleObject(m_hEvent, 0) == WAIT_OBJECT_0;
+}
+
+HANDLE CancellationToken::GetEvent() const
+{
+	return m_hEvent;
+}
+
+void CancellationToken::SetPhase(Phase phase)
+{
+	m_nPhase = phase;
+}
+
+CancellationToken::Phase CancellationToken::GetPhase() const
+{
+	return static_cast<Phase>(m_nPhase.load());
+}
+
+CancellationToken::Phase CancellationToken::GetCancelledPhase() const
+{
+	return static_cast<Phase>(m_nCancelledPhase.load());
+}
+
+const TString CancellationToken::GetPhaseName(Phase phase)
+{
+	switch (phase)
+	{
+	case PHASE_CONNECT:
+		return _T("connect");
+	case PHASE_UPLOAD:
+		return _T("upload");
+	case PHASE_DOWNLOAD:
+		return _T("download");
+	case PHASE_OUTPUT:
+		return _T("output");
+	default:
+		return _T("none");
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for Scope
+
+CancellationToken::Scope::Scope(CancellationToken* token, SocketClient* client, Phase phase)
+{
+	m_pToken = token;
+	m_pClient = client;
+	m_emPrevious = PHASE_NONE;
+	if (m_pToken != NULL)
+	{
+		m_emPrevious = m_pToken->GetPhase();
+		m_pToken->SetPhase(phase);
+		if (m_pClient != NULL)
+		{
+			m_pClient->SetCancelEvent(m_pToken->GetEvent());
+		}
+	}
+}
+
+CancellationToken::Scope::~Scope()
+{
+	if (m_pToken != NULL)
+	{
+		if (m_pClient != NULL)
+		{
+			m_pClient->SetCancelEvent(NULL);
+		}
+		m_pToken->SetPhase(m_emPrevious);
+	}
+}
+
+void CancellationToken::Scope::Enter(Phase phase)
+{
+	if (m_pToken != NULL)
+	{
+		m_pToken->SetPhase(phase);
+	}
+}
+
+bool CancellationToken::Scope::IsCancelled() const
+{
+	return m_pToken != NULL && m_pToken->IsCancelled();
+}
@@ -0,0 +1,77 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "CommonDefine.h"
+#include <atomic>
+
+class SocketClient;
+
+/**
+ * Cancels an in-flight adb operation from another thread. The token owns a
+ * manual-reset event that bound sockets wait on next to their own, so Cancel()
+ * wakes a blocked read or write at once instead of at the next poll. The phase
+ * the operation was in when it got cancelled is kept for reporting.
+ */
+class CancellationToken
+{
+public:
+	enum Phase
+	{
+		PHASE_NONE,
+		PHASE_CONNECT,		// opening the adb connection and sending the request
+		PHASE_UPLOAD,		// pushing a file or streaming input
+		PHASE_DOWNLOAD,		// pulling a file
+		PHASE_OUTPUT,		// waiting for command output
+	};
+
+	// binds a token to a socket and enters a phase until the scope ends, a NULL token does nothing
+	class Scope
+	{
+	private:
+		CancellationToken* m_pToken;
+		SocketClient* m_pClient;
+		Phase m_emPrevious;
+	public:
+		Scope(CancellationToken* token, SocketClient* client, Phase phase);
+		~Scope();
+		void Enter(Phase phase);
+		bool IsCancelled() const;
+	};
+
+private:
+	HANDLE m_hEvent;
+	std::atomic<int> m_nPhase;
+	std::atomic<int> m_nCancelledPhase;
+
+public:
+	CancellationToken();
+	~CancellationToken();
+
+	void Cancel();
+	// rearms the token for the next operation
+	void Reset();
+	bool IsCancelled() const;
+	HANDLE GetEvent() const;
+
+	void SetPhase(Phase phase);
+	Phase GetPhase() const;
+	Phase GetCancelledPhase() const;
+
+	static const TString GetPhaseName(Phase phase);
+};
\ No newline at end of file
@@ -26,11 +26,35 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define DEFAULT_TIMEOUT			5000 // standard delay, in ms
 #define DEFAULT_USE_ADBHOST		false;
 #define DEFAULT_ADBHOST_VALUE		_T("127.0.0.1");
+#define DEFAULT_USE_PACKAGE_CACHE	false
+#define DEFAULT_PACKAGE_CACHE_SIZE	(512LL * 1024 * 1024) // device side budget, in bytes
+#define DEFAULT_USE_RESUMABLE_TRANSFER	false
+#define DEFAULT_SYNC_SESSION_LIMIT	2 // open sync connections per device
+#define DEFAULT_VERIFY_TRANSFERS	false
+#define DEFAULT_COMPRESSION_LEVEL	6 // deflate level of compressed pulls, 0-9
+#define DEFAULT_PROGRESS_INTERVAL	100 // minimum delay between progress updates, in ms
+#define DEFAULT_PROGRESS_STEP		1 // minimum progress change worth an update, in percent
+#define DEFAULT_USE_SHELL_SESSIONS	false
+#define DEFAULT_SHELL_SESSION_LIMIT	2 // persistent shells per device
+#define DEFAULT_USE_STREAMED_INSTALL	true // only taken when the device has cmd and the package cache is off
+#define DEFAULT_DEVICE_COMMAND_LIMIT	4 // shell, sync and install operations in flight per device
 
 Log::LogLevel DdmPreferences::s_emLogLevel = DEFAULT_LOG_LEVEL;
 int DdmPreferences::s_nTimeOut = DEFAULT_TIMEOUT;
 bool DdmPreferences::s_bUseAdbHost = DEFAULT_USE_ADBHOST;
 std::tstring DdmPreferences::s_strAdbHostValue = DEFAULT_ADBHOST_VALUE;
+bool DdmPreferences::s_bUsePackageCache = DEFAULT_USE_PACKAGE_CACHE;
+long long DdmPreferences::s_llPackageCacheSize = DEFAULT_PACKAGE_CACHE_SIZE;
+bool DdmPreferences::s_bUseResumableTransfer = DEFAULT_USE_RESUMABLE_TRANSFER;
+int DdmPreferences::s_nSyncSessionLimit = DEFAULT_SYNC_SESSION_LIMIT;
+bool DdmPreferences::s_bVerifyTransfers = DEFAULT_VERIFY_TRANSFERS;
+int DdmPreferences::s_nCompressionLevel = DEFAULT_COMPRESSION_LEVEL;
+int DdmPreferences::s_nProgressInterval = DEFAULT_PROGRESS_INTERVAL;
+int DdmPreferences::s_nProgressStep = DEFAULT_PROGRESS_STEP;
+bool DdmPreferences::s_bUseShellSessions = DEFAULT_USE_SHELL_SESSIONS;
+int DdmPreferences::s_nShellSessionLimit = DEFAULT_SHELL_SESSION_LIMIT;
+bool DdmPreferences::s_bUseStreamedInstall = DEFAULT_USE_STREAMED_INSTALL;
+int DdmPreferences::s_nDeviceCommandLimit = DEFAULT_DEVICE_COMMAND_LIMIT;
 
 DdmPreferences::DdmPreferences()
 {
@@ -76,3 +100,122 @@ void DdmPreferences::SetAdbHostValue(const TString adbHostValue) {
 	s_strAdbHostValue = adbHostValue;
 }
 
+bool DdmPreferences::GetUsePackageCache()
+{
+	return s_bUsePackageCache;
+}
+
+void DdmPreferences::SetUsePackageCache(bool usePackageCache)
+{
+	s_bUsePackageCache = usePackageCache;
+}
+
+long long DdmPreferences::GetPackageCacheSize()
+{
+	return s_llPackageCacheSize;
+}
+
+void DdmPreferences::SetPackageCacheSize(long long size)
+{
+	s_llPackageCacheSize = size;
+}
+
+bool DdmPreferences::GetUseResumableTransfer()
+{
+	return s_bUseResumableTransfer;
+}
+
+void DdmPreferences::SetUseResumableTransfer(bool useResumableTransfer)
+{
+	s_bUseResumableTransfer = useResumableTransfer;
+}
+
+int DdmPreferences::GetSyncSessionLimit()
+{
+	return s_nSyncSessionLimit;
+}
+
+void DdmPreferences::SetSyncSessionLimit(int limit)
+{
+	s_nSyncSessionLimit = limit;
+}
+
+bool DdmPreferences::GetVerifyTransfers()
+{
+	return s_bVerifyTransfers;
+}
+
+void DdmPreferences::SetVerifyTransfers(bool verifyTransfers)
+{
+	s_bVerifyTransfers = verifyTransfers;
+}
+
+int DdmPreferences::GetCompressionLevel()
+{
+	return s_nCompressionLevel;
+}
+
+void DdmPreferences::SetCompressionLevel(int level)
+{
+	s_nCompressionLevel = level;
+}
+
+int DdmPreferences::GetProgressInterval()
+{
+	return s_nProgressInterval;
+}
+
+void DdmPreferences::SetProgressInterval(int interval)
+{
+	s_nProgressInterval = interval;
+}
+
+int DdmPreferences::GetProgressStep()
+{
+	return s_nProgressStep;
+}
+
+void DdmPreferences::SetProgressStep(int step)
+{
+	s_nProgressStep = step;
+}
+
+bool DdmPreferences::GetUseShellSessions()
+{
+	return s_bUseShellSessions;
+}
+
+void DdmPreferences::SetUseShellSessions(bool useShellSessions)
+{
+	s_bUseShellSessions = useShellSessions;
+}
+
+int DdmPreferences::GetShellSessionLimit()
+{
+	return s_nShellSessionLimit;
+}
+
+void DdmPreferences::SetShellSessionLimit(int limit)
+{
+	s_nShellSessionLimit = limit;
+}
+
+bool DdmPreferences::GetUseStreamedInstall()
+{
+	return s_bUseStreamedInstall;
+}
+
+void DdmPreferences::SetUseStreamedInstall(bool useStreamedInstall)
+{
+	s_bUseStreamedInstall = useStreamedInstall;
+}
+
+int DdmPreferences::GetDeviceCommandLimit()
+{
+	return s_nDeviceCommandLimit;
+}
+
+void DdmPreferences::SetDeviceCommandLimit(int limit)
+{
+	s_nDeviceCommandLimit = limit;
+}
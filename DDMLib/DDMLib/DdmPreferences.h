@@ -28,6 +28,18 @@ private:
 	static int s_nTimeOut;
 	static bool s_bUseAdbHost;
 	static std::tstring s_strAdbHostValue;
+	static bool s_bUsePackageCache;
+	static long long s_llPackageCacheSize;
+	static bool s_bUseResumableTransfer;
+	static int s_nSyncSessionLimit;
+	static bool s_bVerifyTransfers;
+	static int s_nCompressionLevel;
+	static int s_nProgressInterval;
+	static int s_nProgressStep;
+	static bool s_bUseShellSessions;
+	static int s_nShellSessionLimit;
+	static bool s_bUseStreamedInstall;
+	static int s_nDeviceCommandLimit;
 
 private:
 	DdmPreferences();
@@ -41,4 +53,28 @@ public:
 	static void SetUseAdbHost(bool useAdbHost);
 	static const TString GetAdbHostValue();
 	static void SetAdbHostValue(const TString adbHostValue);
+	static bool GetUsePackageCache();
+	static void SetUsePackageCache(bool usePackageCache);
+	static long long GetPackageCacheSize();
+	static void SetPackageCacheSize(long long size);
+	static bool GetUseResumableTransfer();
+	static void SetUseResumableTransfer(bool useResumableTransfer);
+	static int GetSyncSessionLimit();
+	static void SetSyncSessionLimit(int limit);
+	static bool GetVerifyTransfers();
+	static void SetVerifyTransfers(bool verifyTransfers);
+	static int GetCompressionLevel();
+	static void SetCompressionLevel(int level);
+	static int GetProgressInterval();
+	static void SetProgressInterval(int interval);
+	static int GetProgressStep();
+	static void SetProgressStep(int step);
+	static bool GetUseShellSessions();
+	static void SetUseShellSessions(bool useShellSessions);
+	static int GetShellSessionLimit();
+	static void SetShellSessionLimit(int limit);
+	static bool GetUseStreamedInstall();
+	static void SetUseStreamedInstall(bool useStreamedInstall);
+	static int GetDeviceCommandLimit();
+	static void SetDeviceCommandLimit(int limit);
 };
\ No newline at end of file
@@ -17,7 +17,9 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "Device.h"
-#include <regex>
+#include <algorithm>
+#include <climits>
+#include <mutex>
 #include "AndroidEnvVar.h"
 #include "../System/File.h"
 #include "SyncService.h"
@@ -26,14 +28,67 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "AdbHelper.h"
 #include "NullOutputReceiver.h"
 #include "NotifySyncProgressMonitor.h"
+#include "DdmPreferences.h"
+#include "PackageCache.h"
+#include "ResumableTransfer.h"
+#include "SyncSessionManager.h"
+#include "TarTransfer.h"
+#include "DeviceCopy.h"
+#include "ShellProtocol.h"
+#include "ShellSessionPool.h"
+#include "DeviceScheduler.h"
 
 #define GET_PROP_TIMEOUT_MS				100
 #define INSTALL_TIMEOUT_MINUTES			Device::s_lInstallTimeOut
 
 #define DEVICE								_T("device")
 
+#define FEATURE_ABB_EXEC					"abb_exec"
+#define FEATURE_CMD						"cmd"
+
+#define STREAM_INSTALL_BUFFER_SIZE		64*1024
+
+// guards the lazily loaded features of all devices, a member would make Device non-copyable
+static std::mutex s_lockFeatures;
+
 const long Device::s_lInstallTimeOut = Device::GetInstallTimeOut();
 
+// reports the install step once the last byte of a streamed package is sent,
+// kept out of Device.h which SyncService.h includes
+class StreamInstallMonitor : public NotifySyncProgressMonitor
+{
+private:
+	IDevice::IInstallNotify* m_pNotify;
+	long long m_llTotal;
+	long long m_llStreamed;
+
+public:
+	StreamInstallMonitor(IDevice::IInstallNotify* pNotify) : NotifySyncProgressMonitor(pNotify)
+	{
+		m_pNotify = pNotify;
+		m_llTotal = 0;
+		m_llStreamed = 0;
+	}
+
+	void Advance(int work) override
+	{
+		NotifySyncProgressMonitor::Advance(work);
+		bool bWasStreaming = m_llStreamed < m_llTotal;
+		m_llStreamed += work;
+		if (bWasStreaming && m_llStreamed >= m_llTotal)
+		{
+			m_pNotify->OnInstall();
+		}
+	}
+
+	void Start(int totalWork) override
+	{
+		NotifySyncProgressMonitor::Start(totalWork);
+		m_llTotal = totalWork;
+		m_llStreamed = 0;
+	}
+};
+
 long Device::GetInstallTimeOut()
 {
 	AndroidEnvVar env;
@@ -49,6 +104,7 @@ long Device::GetInstallTimeOut()
 Device::Device() : m_pMonitor(NULL), m_pSocketClient(NULL)
 {
 	m_nApiLevel = 0;
+	m_bFeaturesLoaded = false;
 }
 
 Device::Device(DeviceMonitor* monitor, const TString serialNumber, DeviceState deviceState) :
@@ -58,6 +114,7 @@ Device::Device(DeviceMonitor* monitor, const TString serialNumber, DeviceState d
 	m_pSocketClient(NULL)
 {
 	m_nApiLevel = 0;
+	m_bFeaturesLoaded = false;
 }
 
 Device::Device(const IDevice* pDevice) : m_pMonitor(NULL), m_pSocketClient(NULL)
@@ -65,6 +122,7 @@ Device::Device(const IDevice* pDevice) : m_pMonitor(NULL), m_pSocketClient(NULL)
 	m_strSerialNumber = pDevice->GetSerialNumber();
 	m_stateDev = pDevice->GetState();
 	m_nApiLevel = 0;
+	m_bFeaturesLoaded = false;
 }
 
 Device::~Device()
@@ -99,10 +157,57 @@ const TString Device::GetName() const
 
 int Device::ExecuteShellCommand(const TString command, IShellOutputReceiver* receiver, long timeOut)
 {
+	DeviceScheduler::Ticket ticket(GetSerialNumber(), DeviceScheduler::PRIORITY_NORMAL,
+		receiver != NULL ? receiver->GetCancellationToken() : NULL);
+	if (!ticket)
+	{
+		return -1;
+	}
+
+	if (DdmPreferences::GetUseShellSessions())
+	{
+		return ShellSessionPool::GetInstance().Execute(this, command, receiver, timeOut);
+	}
 	return AdbHelper::ExecuteRemoteCommand(AndroidDebugBridge::GetSocketAddress(), command, this,
 		receiver, timeOut);
 }
 
+int Device::ExecuteShellCommand(const TString command, IShellOutputReceiver* stdoutReceiver,
+	IShellOutputReceiver* stderrReceiver, int* exitCode, long timeOut)
+{
+	DeviceScheduler::Ticket ticket(GetSerialNumber(), DeviceScheduler::PRIORITY_NORMAL,
+		stdoutReceiver != NULL ? stdoutReceiver->GetCancellationToken() : NULL);
+	if (!ticket)
+	{
+		return -1;
+	}
+
+	if (HasFeature(FEATURE_SHELL_V2))
+	{
+		return ShellProtocol::Execute(AndroidDebugBridge::GetSocketAddress(), command, this,
+			stdoutReceiver, stderrReceiver, timeOut, exitCode);
+	}
+	// the legacy service merges stderr into stdout and drops the exit status
+	if (exitCode != NULL)
+	{
+		*exitCode = SHELL_EXIT_UNKNOWN;
+	}
+	return AdbHelper::ExecuteRemoteCommand(AndroidDebugBridge::GetSocketAddress(), command, this,
+		stdoutReceiver, timeOut);
+}
+
+int Device::ExecuteShellCommands(const std::vector<std::tstring>& commands,
+	const std::vector<IShellOutputReceiver*>& receivers, long timeOut, std::vector<int>* exitCodes)
+{
+	DeviceScheduler::Ticket ticket(GetSerialNumber(), DeviceScheduler::PRIORITY_NORMAL, NULL);
+	if (!ticket)
+	{
+		return -1;
+	}
+
+	return ShellSessionPool::GetInstance().ExecuteBatch(this, commands, receivers, timeOut, exitCodes);
+}
+
 std::future<std::tstring> Device::GetSystemProperty(const std::tstring& name) const
 {
 	return std::future<std::tstring>();
@@ -131,40 +236,88 @@ int Device::GetApiLevel()
 
 int Device::PushFile(const TString local, const TString remote)
 {
+	DeviceScheduler::Ticket ticket(GetSerialNumber(), DeviceScheduler::PRIORITY_BULK, NULL);
+	if (!ticket)
+	{
+		return -1;
+	}
+
 	const TString targetFileName = GetFileName(local);
 
 	LogDEx(DEVICE, _T("Uploading %s onto device '%s'"), targetFileName, GetSerialNumber());
 
-	std::unique_ptr<SyncService> sync(GetSyncService());
-	if (sync)
+	if (DdmPreferences::GetUseResumableTransfer())
 	{
-		LogDEx(DEVICE, _T("Uploading file onto device '%s'"), GetSerialNumber());
-		bool bSync = sync->PushFile(local, remote, SyncService::GetNullProgressMonitor());
-		sync->Close();
-		if (!bSync)
-		{
-			return -1;
-		}
+		ResumableTransfer transfer(this);
+		return transfer.PushFile(local, remote, SyncService::GetNullProgressMonitor()) ? 0 : -1;
+	}
+
+	SyncSessionManager::Lease sync = SyncSessionManager::GetInstance().Acquire(this);
+	if (!sync)
+	{
+		return -1;
+	}
+	LogDEx(DEVICE, _T("Uploading file onto device '%s'"), GetSerialNumber());
+	if (!sync->PushFile(local, remote, SyncService::GetNullProgressMonitor()))
+	{
+		sync.SetFailed();
+		return -1;
 	}
 	return 0;
 }
 
 int Device::PullFile(const TString remote, const TString local)
 {
+	DeviceScheduler::Ticket ticket(GetSerialNumber(), DeviceScheduler::PRIORITY_BULK, NULL);
+	if (!ticket)
+	{
+		return -1;
+	}
+
 	const TString targetFileName = GetFileName(remote);
 
 	LogDEx(DEVICE, _T("Downloading %s from device '%s'"), targetFileName, GetSerialNumber());
 
-	std::unique_ptr<SyncService> sync(GetSyncService());
-	if (sync)
+	if (DdmPreferences::GetUseResumableTransfer())
 	{
-		LogDEx(DEVICE, _T("Downloading file from device '%s'"), GetSerialNumber());
-		bool bSync = sync->PushFile(local, remote, SyncService::GetNullProgressMonitor());
-		sync->Close();
-		if (!bSync)
-		{
-			return -1;
-		}
+		ResumableTransfer transfer(this);
+		return transfer.PullFile(remote, local, SyncService::GetNullProgressMonitor()) ? 0 : -1;
+	}
+
+	SyncSessionManager::Lease sync = SyncSessionManager::GetInstance().Acquire(this);
+	if (!sync)
+	{
+		return -1;
+	}
+	LogDEx(DEVICE, _T("Downloading file from device '%s'"), GetSerialNumber());
+	if (!sync->PullFile(remote, local, SyncService::GetNullProgressMonitor()))
+	{
+		sync.SetFailed();
+		return -1;
+	}
+	return 0;
+}
+
+int Device::PullFileCompressed(const TString remote, const TString local)
+{
+	DeviceScheduler::Ticket ticket(GetSerialNumber(), DeviceScheduler::PRIORITY_BULK, NULL);
+	if (!ticket)
+	{
+		return -1;
+	}
+
+	LogDEx(DEVICE, _T("Downloading %s compressed from device '%s'"), GetFileName(remote), GetSerialNumber());
+
+	SyncSessionManager::Lease sync = SyncSessionManager::GetInstance().Acquire(this);
+	if (!sync)
+	{
+		return -1;
+	}
+	if (!sync->PullFileCompressed(remote, local, DdmPreferences::GetCompressionLevel(),
+		SyncService::GetNullProgressMonitor()))
+	{
+		sync.SetFailed();
+		return -1;
 	}
 	return 0;
 }
@@ -172,12 +325,39 @@ int Device::PullFile(const TString remote, const TString local)
 int Device::InstallPackage(const TString packageFilePath, bool reinstall,
 	const TString args[], int argCount, IInstallNotify* pNotify)
 {
+	DeviceScheduler::Ticket ticket(GetSerialNumber(), DeviceScheduler::PRIORITY_BULK,
+		pNotify != NULL ? pNotify->GetCancellationToken() : NULL);
+	if (!ticket)
+	{
+		return -1;
+	}
+
 	int nRetCode = -1;
 	if (pNotify != NULL)
 	{
 		pNotify->OnPush();
 	}
+	// the package cache is opt in and keeps packages on the device, so it goes before the
+	// streamed install, which is on by default but leaves nothing behind to reuse
 	std::tstring remoteFilePath;
+	if (DdmPreferences::GetUsePackageCache())
+	{
+		if (DdmPreferences::GetUseStreamedInstall())
+		{
+			LogDEx(DEVICE, _T("Package cache enabled, not streaming %s"), packageFilePath);
+		}
+		// cached packages are kept on the device for the next install
+		nRetCode = PackageCache::GetInstance().SyncPackage(this, packageFilePath, remoteFilePath, pNotify);
+		if (nRetCode == 0)
+		{
+			nRetCode = InstallRemotePackage(remoteFilePath.c_str(), reinstall, args, argCount, pNotify);
+		}
+		return nRetCode;
+	}
+	if (DdmPreferences::GetUseStreamedInstall() && HasFeature(FEATURE_CMD))
+	{
+		return StreamInstallPackage(packageFilePath, reinstall, args, argCount, pNotify);
+	}
 	nRetCode = SyncPackageToDevice(packageFilePath, remoteFilePath, pNotify);
 	if (nRetCode == 0)
 	{
@@ -260,40 +440,152 @@ int Device::SyncPackageToDevice(const TString localFilePath, std::tstring& remot
 	std::tostringstream oss;
 	oss << _T("/data/local/tmp/") << packageFileName;
 	remotePath = oss.str();
-	const TString remoteFilePath = remotePath.c_str();
 
 	LogDEx(DEVICE, _T("Uploading %s onto device '%s'"), packageFileName, GetSerialNumber());
 
-	std::unique_ptr<SyncService> sync(GetSyncService());
-	if (sync)
+	return SyncFileToDevice(localFilePath, remotePath.c_str(), pNotify);
+}
+
+int Device::SyncFileToDevice(const TString localFilePath, const TString remoteFilePath, ISyncNotify* pNotify)
+{
+	DeviceScheduler::Ticket ticket(GetSerialNumber(), DeviceScheduler::PRIORITY_BULK,
+		pNotify != NULL ? pNotify->GetCancellationToken() : NULL);
+	if (!ticket)
 	{
-		NotifySyncProgressMonitor* pNotifyMonitor = NULL;
-		SyncService::ISyncProgressMonitor* pMonitor = NULL;
-		if (pNotify == NULL)
-		{
-			pMonitor = SyncService::GetNullProgressMonitor();
-		}
-		else
-		{
-			pNotifyMonitor = new NotifySyncProgressMonitor(pNotify);
-			pMonitor = pNotifyMonitor;
-		}
+		return -1;
+	}
 
-		LogDEx(DEVICE, _T("Uploading file onto device '%s'"), GetSerialNumber());
-		bool bSync = sync->PushFile(localFilePath, remoteFilePath, pMonitor);
-		if (pNotifyMonitor != NULL)
-		{
-			delete pNotifyMonitor;
-		}
-		sync->Close();
-		if (!bSync)
-		{
-			return -1;
-		}
+	SyncSessionManager::Lease sync = SyncSessionManager::GetInstance().Acquire(this);
+	if (!sync)
+	{
+		return -1;
+	}
+
+	NotifySyncProgressMonitor* pNotifyMonitor = NULL;
+	SyncService::ISyncProgressMonitor* pMonitor = NULL;
+	if (pNotify == NULL)
+	{
+		pMonitor = SyncService::GetNullProgressMonitor();
+	}
+	else
+	{
+		pNotifyMonitor = new NotifySyncProgressMonitor(pNotify);
+		pMonitor = pNotifyMonitor;
+	}
+
+	LogDEx(DEVICE, _T("Uploading file onto device '%s'"), GetSerialNumber());
+	bool bSync = sync->PushFile(localFilePath, remoteFilePath, pMonitor);
+	if (pNotifyMonitor != NULL)
+	{
+		delete pNotifyMonitor;
+	}
+	if (!bSync)
+	{
+		sync.SetFailed();
+		return -1;
 	}
 	return 0;
 }
 
+int Device::PushDirectory(const TString localDirectory, const TString remoteDirectory, ISyncNotify* pNotify)
+{
+	DeviceScheduler::Ticket ticket(GetSerialNumber(), DeviceScheduler::PRIORITY_BULK,
+		pNotify != NULL ? pNotify->GetCancellationToken() : NULL);
+	if (!ticket)
+	{
+		return -1;
+	}
+
+	LogDEx(DEVICE, _T("Uploading directory %s onto device '%s'"), localDirectory, GetSerialNumber());
+
+	NotifySyncProgressMonitor* pNotifyMonitor = NULL;
+	SyncService::ISyncProgressMonitor* pMonitor = NULL;
+	if (pNotify == NULL)
+	{
+		pMonitor = SyncService::GetNullProgressMonitor();
+	}
+	else
+	{
+		pNotifyMonitor = new NotifySyncProgressMonitor(pNotify);
+		pMonitor = pNotifyMonitor;
+	}
+
+	TarTransfer transfer(this);
+	bool bRet = transfer.PushDirectory(localDirectory, remoteDirectory, pMonitor);
+	if (pNotifyMonitor != NULL)
+	{
+		delete pNotifyMonitor;
+	}
+	return bRet ? 0 : -1;
+}
+
+int Device::PullDirectory(const TString remoteDirectory, const TString localDirectory, ISyncNotify* pNotify)
+{
+	DeviceScheduler::Ticket ticket(GetSerialNumber(), DeviceScheduler::PRIORITY_BULK,
+		pNotify != NULL ? pNotify->GetCancellationToken() : NULL);
+	if (!ticket)
+	{
+		return -1;
+	}
+
+	LogDEx(DEVICE, _T("Downloading directory %s from device '%s'"), remoteDirectory, GetSerialNumber());
+
+	NotifySyncProgressMonitor* pNotifyMonitor = NULL;
+	SyncService::ISyncProgressMonitor* pMonitor = NULL;
+	if (pNotify == NULL)
+	{
+		pMonitor = SyncService::GetNullProgressMonitor();
+	}
+	else
+	{
+		pNotifyMonitor = new NotifySyncProgressMonitor(pNotify);
+		pMonitor = pNotifyMonitor;
+	}
+
+	TarTransfer transfer(this);
+	bool bRet = transfer.PullDirectory(remoteDirectory, localDirectory, pMonitor);
+	if (pNotifyMonitor != NULL)
+	{
+		delete pNotifyMonitor;
+	}
+	return bRet ? 0 : -1;
+}
+
+int Device::CopyFileToDevices(const TString remote, const std::vector<Device*>& targets, const TString targetRemote,
+	ISyncNotify* pNotify)
+{
+	// DeviceCopy takes the scheduler slots of the source and all targets at once
+	LogDEx(DEVICE, _T("Copying %s from device '%s' to %d devices"), remote, GetSerialNumber(),
+		static_cast<int>(targets.size()));
+
+	std::vector<DeviceCopy::Target> vecTargets;
+	for (Device* target : targets)
+	{
+		DeviceCopy::Target entry = { target, targetRemote, false };
+		vecTargets.push_back(entry);
+	}
+
+	NotifySyncProgressMonitor* pNotifyMonitor = NULL;
+	SyncService::ISyncProgressMonitor* pMonitor = NULL;
+	if (pNotify == NULL)
+	{
+		pMonitor = SyncService::GetNullProgressMonitor();
+	}
+	else
+	{
+		pNotifyMonitor = new NotifySyncProgressMonitor(pNotify);
+		pMonitor = pNotifyMonitor;
+	}
+
+	DeviceCopy copy(this);
+	bool bRet = copy.Copy(remote, vecTargets, pMonitor);
+	if (pNotifyMonitor != NULL)
+	{
+		delete pNotifyMonitor;
+	}
+	return bRet ? 0 : -1;
+}
+
 const TString Device::GetFileName(const TString filePath) {
 	return File::GetName(filePath);
 }
@@ -301,28 +593,33 @@ const TString Device::GetFileName(const TString filePath) {
 int Device::InstallRemotePackage(const TString remoteFilePath, bool reinstall,
 	const TString args[], int argCount, IInstallNotify* pNotify)
 {
+	DeviceScheduler::Ticket ticket(GetSerialNumber(), DeviceScheduler::PRIORITY_BULK,
+		pNotify != NULL ? pNotify->GetCancellationToken() : NULL);
+	if (!ticket)
+	{
+		return -1;
+	}
+
 	if (pNotify != NULL)
 	{
 		pNotify->OnInstall();
 	}
 	InstallReceiver receiver(pNotify);
-	std::tostringstream oss;
-	oss << _T("pm install");
+	InstallReceiver errorReceiver(pNotify);
+	std::vector<std::tstring> vecArgs(1, _T("install"));
 	if (reinstall)
 	{
-		oss << _T(" -r");
-	}
-	for (int i = 0; i != argCount; i++)
-	{
-		oss << _T(" ") << args[i];
+		vecArgs.push_back(_T("-r"));
 	}
-	oss << _T(" ") << remoteFilePath;
+	SplitInstallArgs(args, argCount, vecArgs);
+	vecArgs.push_back(remoteFilePath);
 
 	std::chrono::minutes minute(INSTALL_TIMEOUT_MINUTES);
 	long timeout = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(minute).count());
-	std::tstring& cmd = oss.str();
-	int nRet = ExecuteShellCommand(cmd.c_str(), &receiver, timeout);
-	const TString errMsg = receiver.GetErrorMessage();
+	int nRet = RunPackageManager(vecArgs, &receiver, &errorReceiver, timeout);
+	// newer pm versions report the failure on stderr
+	const TString errMsg = _tcslen(errorReceiver.GetErrorMessage()) > 0 ?
+		errorReceiver.GetErrorMessage() : receiver.GetErrorMessage();
 	if (_tcslen(errMsg) > 0 && pNotify != NULL)
 	{
 		pNotify->OnErrorMessage(errMsg);
@@ -342,12 +639,157 @@ int Device::RemoveRemotePackage(const TString remoteFilePath)
 
 int Device::UninstallPackage(const TString packageName)
 {
+	DeviceScheduler::Ticket ticket(GetSerialNumber(), DeviceScheduler::PRIORITY_NORMAL, NULL);
+	if (!ticket)
+	{
+		return -1;
+	}
+
 	InstallReceiver receiver;
+	InstallReceiver errorReceiver;
+	std::vector<std::tstring> vecArgs;
+	vecArgs.push_back(_T("uninstall"));
+	vecArgs.push_back(packageName);
+	std::chrono::minutes minute(INSTALL_TIMEOUT_MINUTES);
+	long timeout = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(minute).count());
+	return RunPackageManager(vecArgs, &receiver, &errorReceiver, timeout);
+}
+
+int Device::StreamInstallPackage(const TString packageFilePath, bool reinstall,
+	const TString args[], int argCount, IInstallNotify* pNotify)
+{
+	File file(packageFilePath);
+	if (!file.IsFile())
+	{
+		return -1;
+	}
+	const long long llSize = file.GetLength64();
+
+	// the package goes from the local file straight into the package manager, nothing is
+	// written to /data/local/tmp and nothing has to be removed afterwards
 	std::tostringstream oss;
-	oss << _T("pm uninstall") << packageName;
+	oss << _T("cmd package install -S ") << llSize;
+	if (reinstall)
+	{
+		oss << _T(" -r");
+	}
+	// quoted the way RunPackageManager does it for the other install paths
+	std::vector<std::tstring> vecArgs;
+	SplitInstallArgs(args, argCount, vecArgs);
+	for (const std::tstring& arg : vecArgs)
+	{
+		std::tstring quoted;
+		StringUtils::QuoteShellArgument(arg.c_str(), quoted);
+		oss << _T(" ") << quoted;
+	}
+	LogDEx(DEVICE, _T("Streaming %s into the package manager of '%s'"), packageFilePath, GetSerialNumber());
+
+	FileReadWrite fRead = file.GetRead();
+	if (!fRead.IsValid())
+	{
+		fRead.Delete();
+		return -1;
+	}
+	CharStreamReader reader(fRead, STREAM_INSTALL_BUFFER_SIZE);
+	InstallReceiver receiver(pNotify);
+	StreamInstallMonitor* pNotifyMonitor = NULL;
+	SyncService::ISyncProgressMonitor* pMonitor = NULL;
+	if (pNotify == NULL)
+	{
+		pMonitor = SyncService::GetNullProgressMonitor();
+	}
+	else
+	{
+		pNotifyMonitor = new StreamInstallMonitor(pNotify);
+		pMonitor = pNotifyMonitor;
+	}
+
 	std::chrono::minutes minute(INSTALL_TIMEOUT_MINUTES);
 	long timeout = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(minute).count());
-	return ExecuteShellCommand(oss.str().c_str(), &receiver, timeout);
+	pMonitor->Start(static_cast<int>((std::min)(llSize, static_cast<long long>(INT_MAX))));
+	int nRet = AdbHelper::ExecuteRemoteCommand(AndroidDebugBridge::GetSocketAddress(), AdbHelper::EXEC,
+		oss.str().c_str(), this, &receiver, timeout, &reader, pMonitor);
+	pMonitor->Stop();
+	fRead.Close();
+	fRead.Delete();
+	if (pNotifyMonitor != NULL)
+	{
+		delete pNotifyMonitor;
+	}
+
+	const TString errMsg = receiver.GetErrorMessage();
+	if (_tcslen(errMsg) > 0 && pNotify != NULL)
+	{
+		pNotify->OnErrorMessage(errMsg);
+	}
+	// exec: has no exit status, only the Success line proves the install
+	if (nRet == 0 && !receiver.IsSuccess())
+	{
+		return -1;
+	}
+	return nRet;
+}
+
+int Device::RunPackageManager(const std::vector<std::tstring>& args, InstallReceiver* receiver,
+	InstallReceiver* errorReceiver, long timeOut)
+{
+	// fastest first: abb_exec talks to the package service over binder from adbd, cmd skips
+	// the app_process start of the pm wrapper, pm works everywhere
+	const TCHAR* szPath;
+	int exitCode = SHELL_EXIT_UNKNOWN;
+	int nRet;
+	const long long llStart = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+	if (HasFeature(FEATURE_ABB_EXEC))
+	{
+		szPath = _T("abb_exec");
+		std::vector<std::tstring> vecAbbArgs(1, _T("package"));
+		vecAbbArgs.insert(vecAbbArgs.end(), args.begin(), args.end());
+		nRet = AdbHelper::ExecuteAbbCommand(AndroidDebugBridge::GetSocketAddress(), vecAbbArgs, this,
+			receiver, timeOut);
+	}
+	else
+	{
+		szPath = HasFeature(FEATURE_CMD) ? _T("cmd package") : _T("pm");
+		std::tstring cmd(szPath);
+		for (const std::tstring& arg : args)
+		{
+			std::tstring quoted;
+			StringUtils::QuoteShellArgument(arg.c_str(), quoted);
+			cmd.append(_T(" ")).append(quoted);
+		}
+		nRet = ExecuteShellCommand(cmd.c_str(), receiver, errorReceiver, &exitCode, timeOut);
+	}
+	const long long llElapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count() - llStart;
+	LogIEx(DEVICE, _T("package %s on '%s' via %s took %lld ms"), args[0].c_str(), GetSerialNumber(), szPath,
+		llElapsed);
+
+	if (nRet != 0)
+	{
+		return nRet;
+	}
+	if (exitCode != SHELL_EXIT_UNKNOWN)
+	{
+		return exitCode == 0 ? 0 : -1;
+	}
+	// without an exit status the printed Success/Failure line decides
+	bool bFailed = _tcslen(receiver->GetErrorMessage()) > 0 || _tcslen(errorReceiver->GetErrorMessage()) > 0;
+	return bFailed ? -1 : 0;
+}
+
+void Device::SplitInstallArgs(const TString args[], int argCount, std::vector<std::tstring>& vecArgs)
+{
+	for (int i = 0; i != argCount; i++)
+	{
+		// callers may pass several options in one string
+		std::tistringstream iss(args[i]);
+		std::tstring arg;
+		while (iss >> arg)
+		{
+			vecArgs.push_back(arg);
+		}
+	}
 }
 
 void Device::SetState(DeviceState state)
@@ -407,12 +849,38 @@ void Device::Update(int changeMask)
 	m_pMonitor->GetServer()->DeviceChanged(this, changeMask);
 }
 
+bool Device::HasFeature(const char* feature)
+{
+	std::string key(",");
+	key.append(feature).append(",");
+	{
+		std::lock_guard<std::mutex> lock(s_lockFeatures);
+		if (m_bFeaturesLoaded)
+		{
+			return m_strFeatures.find(key) != std::string::npos;
+		}
+	}
+
+	// asked outside of the lock, two callers racing here only ask twice
+	std::string features;
+	if (!AdbHelper::GetFeatures(AndroidDebugBridge::GetSocketAddress(), this, features))
+	{
+		// try again next time, the device may still be coming up
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(s_lockFeatures);
+	m_strFeatures = "," + features + ",";
+	m_bFeaturesLoaded = true;
+	return m_strFeatures.find(key) != std::string::npos;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // implements for InstallReceiver
 
 Device::InstallReceiver::InstallReceiver(IInstallNotify* pNotify)
 {
 	m_pNotify = pNotify;
+	m_bSuccess = false;
 }
 
 void Device::InstallReceiver::ProcessNewLines(const std::vector<std::string>& vecArray)
@@ -426,18 +894,18 @@ void Device::InstallReceiver::ProcessNewLines(const std::vector<std::string>& ve
 		if (strncmp(SUCCESS_OUTPUT, line.c_str(), sizeof(SUCCESS_OUTPUT)) == 0)
 		{
 			m_strErrorMessage.clear();
+			m_bSuccess = true;
 			break;
 		}
 		else
 		{
-			std::regex rxAdb(FAILURE_PATTERN, std::regex::icase);
-			std::smatch results;
-			if (std::regex_match(line, results, rxAdb) && results[0].matched)
+			std::string reason;
+			if (MatchFailure(line, reason))
 			{
 #ifdef _UNICODE
-				ConvertUtils::StringToWstring(results[1].str(), m_strErrorMessage);
+				ConvertUtils::StringToWstring(reason, m_strErrorMessage);
 #else
-				m_strErrorMessage = results[1].str();
+				m_strErrorMessage = reason;
 #endif
 				break;
 			}
@@ -454,7 +922,46 @@ bool Device::InstallReceiver::IsCancelled()
 	return m_pNotify == NULL ? false : m_pNotify->IsCancelled();
 }
 
+CancellationToken* Device::InstallReceiver::GetCancellationToken()
+{
+	return m_pNotify == NULL ? NULL : m_pNotify->GetCancellationToken();
+}
+
 const TString Device::InstallReceiver::GetErrorMessage()
 {
 	return m_strErrorMessage.c_str();
+}
+
+bool Device::InstallReceiver::IsSuccess() const
+{
+	return m_bSuccess;
+}
+
+// matches "Failure\s+\[(.*)\]" case insensitively, without building a regex for every line
+bool Device::InstallReceiver::MatchFailure(const std::string& line, std::string& reason)
+{
+	const size_t prefixLength = sizeof(FAILURE_OUTPUT) - 1;
+	const size_t length = line.length();
+	if (length < prefixLength || !StringUtils::EqualsIgnoreCase(line.c_str(), FAILURE_OUTPUT, prefixLength))
+	{
+		return false;
+	}
+	size_t pos = prefixLength;
+	while (pos < length && StringUtils::IsSpace(line[pos]))
+	{
+		pos++;
+	}
+	// at least one space, then the reason in brackets that close the line
+	if (pos == prefixLength || pos + 1 >= length || line[pos] != '[' || line[length - 1] != ']')
+	{
+		return false;
+	}
+	auto first = line.begin() + pos + 1;
+	auto last = line.end() - 1;
+	if (std::any_of(first, last, StringUtils::IsLineTerminator<char>))
+	{
+		return false;
+	}
+	reason.assign(first, last);
+	return true;
 }
\ No newline at end of file
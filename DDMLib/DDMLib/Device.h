@@ -39,15 +39,20 @@ private:
 	{
 	private:
 		#define SUCCESS_OUTPUT  "Success"
-		#define FAILURE_PATTERN "Failure\\s+\\[(.*)\\]"
+		#define FAILURE_OUTPUT  "failure"
 		std::tstring m_strErrorMessage;
 		IInstallNotify* m_pNotify;
+		bool m_bSuccess;
 	public:
 		InstallReceiver(IInstallNotify* pNotify = NULL);
 	public:
 		virtual void ProcessNewLines(const std::vector<std::string>& vecArray) override;
 		virtual bool IsCancelled() override;
+		virtual CancellationToken* GetCancellationToken() override;
 		const TString GetErrorMessage();
+		bool IsSuccess() const;
+	private:
+		static bool MatchFailure(const std::string& line, std::string& reason);
 	};
 
 private:
@@ -56,6 +61,8 @@ private:
 	DeviceState m_stateDev = UNKNOWN;
 	SocketClient* m_pSocketClient;
 	int m_nApiLevel;
+	bool m_bFeaturesLoaded;
+	std::string m_strFeatures;
 	
 public:
 	Device();
@@ -68,6 +75,12 @@ public:
 public:
 	virtual const TString GetName() const override;
 	virtual int ExecuteShellCommand(const TString command, IShellOutputReceiver* receiver, long timeOut) override;
+	// splits stdout from stderr and reports the exit status when the device speaks shell v2
+	int ExecuteShellCommand(const TString command, IShellOutputReceiver* stdoutReceiver,
+		IShellOutputReceiver* stderrReceiver, int* exitCode, long timeOut);
+	// runs the commands back to back on one persistent shell, one receiver per command
+	int ExecuteShellCommands(const std::vector<std::tstring>& commands,
+		const std::vector<IShellOutputReceiver*>& receivers, long timeOut, std::vector<int>* exitCodes = NULL);
 	virtual std::future<std::tstring> GetSystemProperty(const std::tstring& name) const override;
 
 	virtual const TString GetSerialNumber() const override;
@@ -81,11 +94,17 @@ public:
 	SyncService* GetSyncService();
 	virtual int PushFile(const TString local, const TString remote) override;
 	virtual int PullFile(const TString remote, const TString local) override;
+	int PullFileCompressed(const TString remote, const TString local);
 	virtual int InstallPackage(const TString packageFilePath, bool reinstall,
 		const TString args[] = NULL, int argCount = 0, IInstallNotify* pNotify = NULL) override;
 	virtual int InstallPackages(const TString apkFilePaths[], int apkCount, int timeOutInMs, bool reinstall,
 		const TString args[] = NULL, int argCount = 0, IInstallNotify* pNotify = NULL) override;
 	virtual int SyncPackageToDevice(const TString localFilePath, std::tstring& remotePath, ISyncNotify* pNotify = NULL) override;
+	int SyncFileToDevice(const TString localFilePath, const TString remoteFilePath, ISyncNotify* pNotify = NULL);
+	int PushDirectory(const TString localDirectory, const TString remoteDirectory, ISyncNotify* pNotify = NULL);
+	int PullDirectory(const TString remoteDirectory, const TString localDirectory, ISyncNotify* pNotify = NULL);
+	int CopyFileToDevices(const TString remote, const std::vector<Device*>& targets, const TString targetRemote,
+		ISyncNotify* pNotify = NULL);
 	virtual int InstallRemotePackage(const TString remoteFilePath, bool reinstall,
 		const TString args[] = NULL, int argCount = 0, IInstallNotify* pNotify = NULL) override;
 	virtual int RemoveRemotePackage(const TString remoteFilePath) override;
@@ -94,8 +113,14 @@ public:
 	void SetClientMonitoringSocket(SocketClient* socketClient);
 	SocketClient* GetClientMonitoringSocket();
 	void Update(int changeMask);
+	bool HasFeature(const char* feature);
 
 private:
 	int GetApiLevel();
+	int StreamInstallPackage(const TString packageFilePath, bool reinstall,
+		const TString args[], int argCount, IInstallNotify* pNotify);
+	int RunPackageManager(const std::vector<std::tstring>& args, InstallReceiver* receiver,
+		InstallReceiver* errorReceiver, long timeOut);
+	static void SplitInstallArgs(const TString args[], int argCount, std::vector<std::tstring>& vecArgs);
 	static const TString GetFileName(const TString filePath);
 };
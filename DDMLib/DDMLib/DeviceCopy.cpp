@@ -0,0 +1,284 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "DeviceCopy.h"
+#include <algorithm>
+#include <climits>
+#include <set>
+#include <thread>
+#include "Device.h"
+#include "DeviceScheduler.h"
+#include "Log.h"
+#include "SyncSessionManager.h"
+
+#define DEVICE_COPY			_T("DeviceCopy")
+
+DeviceCopy::DeviceCopy(Device* source, int maxChunks) :
+	m_pSource(source), m_nMaxChunks((std::max)(maxChunks, 1)), m_bEnd(false), m_bFailed(false)
+{
+}
+
+bool DeviceCopy::Copy(const TString remotePath, std::vector<Target>& vecTargets,
+	SyncService::ISyncProgressMonitor* monitor)
+{
+	for (Target& target : vecTargets)
+	{
+		target.bCopied = false;
+	}
+	if (vecTargets.empty() || !CheckTargets(vecTargets))
+	{
+		return false;
+	}
+
+	// the slots of all devices are taken up front in serial order, so two copies in
+	// opposite directions cannot each hold the slot the other one waits for
+	std::vector<std::tstring> vecSerials(1, m_pSource->GetSerialNumber());
+	for (const Target& target : vecTargets)
+	{
+		vecSerials.push_back(target.pDevice->GetSerialNumber());
+	}
+	std::sort(vecSerials.begin(), vecSerials.end());
+	std::vector<std::unique_ptr<DeviceScheduler::Ticket>> vecTickets;
+	for (const std::tstring& serial : vecSerials)
+	{
+		vecTickets.push_back(std::unique_ptr<DeviceScheduler::Ticket>(new DeviceScheduler::Ticket(serial.c_str(),
+			DeviceScheduler::PRIORITY_BULK, monitor->GetCancellationToken())));
+		if (!*vecTickets.back())
+		{
+			return false;
+		}
+	}
+
+	SyncSessionManager::Lease source = SyncSessionManager::GetInstance().Acquire(m_pSource);
+	if (!source)
+	{
+		return false;
+	}
+	SyncService::FileStat* fileStat = NULL;
+	if (!source->StatFile(remotePath, &fileStat))
+	{
+		source.SetFailed();
+		return false;
+	}
+	const int mode = fileStat->GetMode();
+	const int size = fileStat->GetSize();
+	const int lastModified = static_cast<int>(fileStat->GetLastModified());
+	delete fileStat;
+	if (mode == 0)
+	{
+		LogEEx(DEVICE_COPY, _T("%s does not exist on device '%s'"), remotePath, m_pSource->GetSerialNumber());
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_vecPipes.assign(vecTargets.size(), Pipe());
+		for (Pipe& pipe : m_vecPipes)
+		{
+			pipe.nOffset = 0;
+			pipe.bAlive = true;
+		}
+		m_bEnd = false;
+		m_bFailed = false;
+	}
+
+	std::vector<std::thread> vecThreads;
+	for (size_t i = 0; i < vecTargets.size(); i++)
+	{
+		vecThreads.push_back(std::thread(&DeviceCopy::PushTarget, this, std::ref(vecTargets[i]),
+			static_cast<int>(i), size, mode, lastModified));
+	}
+
+	PipelineSink sink(this);
+	bool bPulled = source->PullStream(remotePath, size, &sink, monitor);
+	if (!bPulled)
+	{
+		// the RECV was cut short, the connection is out of step
+		source.SetFailed();
+	}
+	Finish(bPulled);
+	for (std::thread& thread : vecThreads)
+	{
+		thread.join();
+	}
+
+	bool bRet = bPulled;
+	for (const Target& target : vecTargets)
+	{
+		if (!target.bCopied)
+		{
+			LogEEx(DEVICE_COPY, _T("Unable to copy %s to device '%s'"), remotePath,
+				target.pDevice->GetSerialNumber());
+			bRet = false;
+		}
+	}
+	return bRet;
+}
+
+bool DeviceCopy::CheckTargets(const std::vector<Target>& vecTargets) const
+{
+	// two sessions on one device could wait on each other through the pool limit
+	std::set<std::tstring> setSerials;
+	setSerials.insert(m_pSource->GetSerialNumber());
+	for (const Target& target : vecTargets)
+	{
+		if (!setSerials.insert(target.pDevice->GetSerialNumber()).second)
+		{
+			LogEEx(DEVICE_COPY, _T("Device '%s' listed twice in a copy"), target.pDevice->GetSerialNumber());
+			return false;
+		}
+	}
+	return true;
+}
+
+void DeviceCopy::PushTarget(Target& target, int index, int size, int mode, int lastModified)
+{
+	SyncSessionManager::Lease sync = SyncSessionManager::GetInstance().Acquire(target.pDevice);
+	if (!sync)
+	{
+		Abandon(index);
+		return;
+	}
+	PipelineSource source(this, index);
+	target.bCopied = sync->PushStream(&source, size, mode, lastModified, target.strRemotePath.c_str(),
+		SyncService::GetNullProgressMonitor());
+	if (!target.bCopied)
+	{
+		// the SEND was not finished with DONE
+		sync.SetFailed();
+		Abandon(index);
+	}
+}
+
+bool DeviceCopy::Put(const char* data, int length)
+{
+	Chunk chunk = std::make_shared<const std::vector<char>>(data, data + length);
+
+	std::unique_lock<std::mutex> lock(m_lock);
+	while (true)
+	{
+		bool bAnyAlive = false;
+		bool bFull = false;
+		for (const Pipe& pipe : m_vecPipes)
+		{
+			if (pipe.bAlive)
+			{
+				bAnyAlive = true;
+				bFull = bFull || pipe.deqChunks.size() >= m_nMaxChunks;
+			}
+		}
+		if (!bAnyAlive)
+		{
+			return false;
+		}
+		if (!bFull)
+		{
+			break;
+		}
+		m_cvChanged.wait(lock);
+	}
+
+	for (Pipe& pipe : m_vecPipes)
+	{
+		if (pipe.bAlive)
+		{
+			pipe.deqChunks.push_back(chunk);
+		}
+	}
+	m_cvChanged.notify_all();
+	return true;
+}
+
+int DeviceCopy::Take(int index, char* buffer, int size)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	Pipe& pipe = m_vecPipes[index];
+	while (pipe.deqChunks.empty() && !m_bEnd)
+	{
+		m_cvChanged.wait(lock);
+	}
+	if (pipe.deqChunks.empty())
+	{
+		// a failed source must not end in DONE, that would commit a truncated file
+		return m_bFailed ? -1 : 0;
+	}
+
+	const std::vector<char>& chunk = *pipe.deqChunks.front();
+	const int length = (std::min)(size, static_cast<int>(chunk.size() - pipe.nOffset));
+	memcpy(buffer, chunk.data() + pipe.nOffset, length);
+	pipe.nOffset += length;
+	if (pipe.nOffset == chunk.size())
+	{
+		pipe.deqChunks.pop_front();
+		pipe.nOffset = 0;
+		m_cvChanged.notify_all();
+	}
+	return length;
+}
+
+void DeviceCopy::Abandon(int index)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	Pipe& pipe = m_vecPipes[index];
+	pipe.bAlive = false;
+	pipe.deqChunks.clear();
+	m_cvChanged.notify_all();
+}
+
+void DeviceCopy::Finish(bool success)
+{
+	std::lock_guard<std::mutex> lock(m_lock);
+	m_bEnd = true;
+	m_bFailed = !success;
+	if (m_bFailed)
+	{
+		for (Pipe& pipe : m_vecPipes)
+		{
+			pipe.deqChunks.clear();
+		}
+	}
+	m_cvChanged.notify_all();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for PipelineSink
+
+DeviceCopy::PipelineSink::PipelineSink(DeviceCopy* owner) : m_pOwner(owner)
+{
+}
+
+bool DeviceCopy::PipelineSink::Open()
+{
+	return true;
+}
+
+bool DeviceCopy::PipelineSink::WriteData(const char* data, int length)
+{
+	return m_pOwner->Put(data, length);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for PipelineSource
+
+DeviceCopy::PipelineSource::PipelineSource(DeviceCopy* owner, int index) : m_pOwner(owner), m_nIndex(index)
+{
+}
+
+int DeviceCopy::PipelineSource::ReadData(char* buffer, int size)
+{
+	return m_pOwner->Take(m_nIndex, buffer, size);
+}
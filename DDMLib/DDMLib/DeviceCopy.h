@@ -0,0 +1,107 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "CommonDefine.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "SyncService.h"
+
+// chunks queued per target, up to 64KB each
+#define DEVICE_COPY_MAX_CHUNKS		64
+
+// define class
+class Device;
+
+/**
+ * Copies a file from one device to others without going through the local
+ * disk. The RECV stream of the source is fanned out to one SEND stream per
+ * target through bounded in-memory queues; the source only reads ahead as
+ * far as the slowest target allows. A target that fails is dropped while
+ * the others carry on.
+ */
+class DeviceCopy
+{
+public:
+	struct Target
+	{
+		Device* pDevice;
+		std::tstring strRemotePath;
+		bool bCopied;	// set by Copy
+	};
+
+private:
+	typedef std::shared_ptr<const std::vector<char>> Chunk;
+
+	struct Pipe
+	{
+		std::deque<Chunk> deqChunks;
+		size_t nOffset;		// already consumed from the front chunk
+		bool bAlive;
+	};
+
+	class PipelineSink : public SyncService::IDataSink
+	{
+	private:
+		DeviceCopy* m_pOwner;
+	public:
+		explicit PipelineSink(DeviceCopy* owner);
+		virtual bool Open() override;
+		virtual bool WriteData(const char* data, int length) override;
+	};
+
+	class PipelineSource : public SyncService::IDataSource
+	{
+	private:
+		DeviceCopy* m_pOwner;
+		const int m_nIndex;
+	public:
+		PipelineSource(DeviceCopy* owner, int index);
+		virtual int ReadData(char* buffer, int size) override;
+	};
+
+private:
+	Device* m_pSource;
+	const size_t m_nMaxChunks;
+
+	std::mutex m_lock;
+	std::condition_variable m_cvChanged;
+	std::vector<Pipe> m_vecPipes;
+	bool m_bEnd;
+	bool m_bFailed;
+
+public:
+	explicit DeviceCopy(Device* source, int maxChunks = DEVICE_COPY_MAX_CHUNKS);
+
+	/**
+	 * Copies remotePath of the source device to every target, at most one
+	 * target per device and none on the source itself.
+	 * @return true if every target received the whole file
+	 */
+	bool Copy(const TString remotePath, std::vector<Target>& vecTargets, SyncService::ISyncProgressMonitor* monitor);
+
+private:
+	bool CheckTargets(const std::vector<Target>& vecTargets) const;
+	void PushTarget(Target& target, int index, int size, int mode, int lastModified);
+	bool Put(const char* data, int length);
+	int Take(int index, char* buffer, int size);
+	void Abandon(int index);
+	void Finish(bool success);
+};
@@ -0,0 +1,223 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "DeviceScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include "CancellationToken.h"
+#include "DdmPreferences.h"
+#include "TransferStats.h"
+
+#define SCHEDULER_POLL_MS			50		// waiters look at cancel and limit changes this often
+
+static const TCHAR* const s_arrPriorityNames[DeviceScheduler::PRIORITY_COUNT] =
+{
+	_T("interactive"),
+	_T("normal"),
+	_T("bulk"),
+};
+
+DeviceScheduler DeviceScheduler::s_instance;
+thread_local int DeviceScheduler::t_nPriority = -1;
+
+DeviceScheduler::DeviceScheduler()
+{
+}
+
+DeviceScheduler& DeviceScheduler::GetInstance()
+{
+	return s_instance;
+}
+
+void DeviceScheduler::GetDeviceStats(std::vector<DeviceStats>& vecStats)
+{
+	std::vector<std::pair<std::tstring, std::shared_ptr<DeviceQueue>>> vecQueues;
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		vecQueues.assign(m_mapQueues.begin(), m_mapQueues.end());
+	}
+
+	vecStats.clear();
+	const int limit = GetLimit();
+	for (const auto& entry : vecQueues)
+	{
+		DeviceQueue& queue = *entry.second;
+		std::unique_lock<std::mutex> lock(queue.lock);
+		DeviceStats stats;
+		stats.strSerial = entry.first;
+		stats.nLimit = limit;
+		stats.nRunning = queue.nRunning;
+		std::copy(queue.arrStats, queue.arrStats + PRIORITY_COUNT, stats.arrClasses);
+		vecStats.push_back(stats);
+	}
+}
+
+void DeviceScheduler::Export(std::tstring& report)
+{
+	std::vector<DeviceStats> vecStats;
+	GetDeviceStats(vecStats);
+
+	std::tostringstream oss;
+	// one line per device and priority class, waits in microseconds
+	for (const DeviceStats& stats : vecStats)
+	{
+		for (int i = 0; i < PRIORITY_COUNT; i++)
+		{
+			const ClassStats& cls = stats.arrClasses[i];
+			oss << stats.strSerial
+				<< _T(" class=") << s_arrPriorityNames[i]
+				<< _T(" limit=") << stats.nLimit
+				<< _T(" running=") << stats.nRunning
+				<< _T(" queued=") << cls.nQueued
+				<< _T(" max_queued=") << cls.nMaxQueued
+				<< _T(" dispatched=") << cls.llDispatched
+				<< _T(" wait_us=") << cls.llWaitMicros
+				<< _T(" max_wait_us=") << cls.llMaxWaitMicros
+				<< _T("\n");
+		}
+	}
+	report = oss.str();
+}
+
+std::shared_ptr<DeviceScheduler::DeviceQueue> DeviceScheduler::GetQueue(const TString serialNumber)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	std::shared_ptr<DeviceQueue>& pQueue = m_mapQueues[serialNumber];
+	if (!pQueue)
+	{
+		pQueue = std::make_shared<DeviceQueue>();
+	}
+	return pQueue;
+}
+
+// queue.lock must be held
+bool DeviceScheduler::CanRun(const DeviceQueue& queue, Priority priority, const void* waiter, int limit)
+{
+	for (int i = 0; i < priority; i++)
+	{
+		if (!queue.arrWaiting[i].empty())
+		{
+			return false;
+		}
+	}
+	if (queue.arrWaiting[priority].front() != waiter)
+	{
+		return false;
+	}
+	// keep one slot for the classes above bulk
+	const int slots = priority == PRIORITY_BULK && limit > 1 ? limit - 1 : limit;
+	return queue.nRunning < slots;
+}
+
+int DeviceScheduler::GetLimit()
+{
+	return (std::max)(DdmPreferences::GetDeviceCommandLimit(), 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for Ticket
+
+DeviceScheduler::Ticket::Ticket(const TString serialNumber, Priority priority, CancellationToken* token) :
+	m_pQueue(DeviceScheduler::GetInstance().GetQueue(serialNumber)), m_bGranted(false), m_bNested(false)
+{
+	if (t_nPriority >= 0)
+	{
+		priority = static_cast<Priority>(t_nPriority);
+	}
+
+	DeviceQueue& queue = *m_pQueue;
+	std::unique_lock<std::mutex> lock(queue.lock);
+	const std::thread::id self = std::this_thread::get_id();
+	auto owner = queue.mapOwners.find(self);
+	if (owner != queue.mapOwners.end())
+	{
+		owner->second++;
+		m_bNested = true;
+		m_bGranted = true;
+		return;
+	}
+
+	ClassStats& stats = queue.arrStats[priority];
+	std::deque<const void*>& deqWaiting = queue.arrWaiting[priority];
+	deqWaiting.push_back(this);
+	stats.nQueued = static_cast<int>(deqWaiting.size());
+	stats.nMaxQueued = (std::max)(stats.nMaxQueued, stats.nQueued);
+	const long long llWaitStart = TransferStats::NowMicros();
+
+	while (!CanRun(queue, priority, this, GetLimit()))
+	{
+		if (token != NULL && token->IsCancelled())
+		{
+			deqWaiting.erase(std::find(deqWaiting.begin(), deqWaiting.end(), this));
+			stats.nQueued = static_cast<int>(deqWaiting.size());
+			// whoever queued behind this ticket may be the head now
+			queue.cvChanged.notify_all();
+			return;
+		}
+		queue.cvChanged.wait_for(lock, std::chrono::milliseconds(SCHEDULER_POLL_MS));
+	}
+
+	deqWaiting.pop_front();
+	stats.nQueued = static_cast<int>(deqWaiting.size());
+	queue.nRunning++;
+	queue.mapOwners[self] = 1;
+	const long long llWait = TransferStats::NowMicros() - llWaitStart;
+	stats.llDispatched++;
+	stats.llWaitMicros += llWait;
+	stats.llMaxWaitMicros = (std::max)(stats.llMaxWaitMicros, llWait);
+	m_bGranted = true;
+	// there may be a free slot for the next in line as well
+	queue.cvChanged.notify_all();
+}
+
+DeviceScheduler::Ticket::~Ticket()
+{
+	if (!m_bGranted)
+	{
+		return;
+	}
+	DeviceQueue& queue = *m_pQueue;
+	std::unique_lock<std::mutex> lock(queue.lock);
+	auto owner = queue.mapOwners.find(std::this_thread::get_id());
+	if (owner != queue.mapOwners.end() && --owner->second == 0)
+	{
+		queue.mapOwners.erase(owner);
+	}
+	if (!m_bNested)
+	{
+		queue.nRunning--;
+		queue.cvChanged.notify_all();
+	}
+}
+
+DeviceScheduler::Ticket::operator bool() const
+{
+	return m_bGranted;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for PriorityScope
+
+DeviceScheduler::PriorityScope::PriorityScope(Priority priority) : m_nPrevious(t_nPriority)
+{
+	t_nPriority = priority;
+}
+
+DeviceScheduler::PriorityScope::~PriorityScope()
+{
+	t_nPriority = m_nPrevious;
+}
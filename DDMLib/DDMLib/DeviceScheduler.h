@@ -0,0 +1,143 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "CommonDefine.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// define class
+class CancellationToken;
+
+/**
+ * Limits how many shell, sync and install operations run on one device at
+ * once, so callers cannot open more connections than adbd keeps up with.
+ * Operations beyond DdmPreferences::GetDeviceCommandLimit wait in one queue
+ * per priority class, first in first out within a class, the highest class
+ * first. Bulk work never takes the last slot, so an interactive query gets
+ * in while an install runs.
+ *
+ * An operation started by a thread that already holds a slot of the same
+ * device, such as the pm call of an install, runs in that slot instead of
+ * queueing behind its own caller.
+ */
+class DeviceScheduler
+{
+public:
+	enum Priority
+	{
+		PRIORITY_INTERACTIVE,	// a user is waiting for the answer
+		PRIORITY_NORMAL,
+		PRIORITY_BULK,			// installs and transfers
+		PRIORITY_COUNT,
+	};
+
+	struct ClassStats
+	{
+		int nQueued;
+		int nMaxQueued;
+		long long llDispatched;
+		long long llWaitMicros;		// total time spent in the queue
+		long long llMaxWaitMicros;
+	};
+
+	struct DeviceStats
+	{
+		std::tstring strSerial;
+		int nLimit;
+		int nRunning;
+		ClassStats arrClasses[PRIORITY_COUNT];
+	};
+
+private:
+	struct DeviceQueue
+	{
+		std::mutex lock;
+		std::condition_variable cvChanged;
+		std::deque<const void*> arrWaiting[PRIORITY_COUNT];
+		std::map<std::thread::id, int> mapOwners;	// slots held per thread, nested ones included
+		int nRunning = 0;
+		ClassStats arrStats[PRIORITY_COUNT] = {};
+	};
+
+public:
+	/**
+	 * One slot of a device, waited for in the constructor and given back by
+	 * the destructor. Check it before use: waiting ends without a slot if
+	 * the token is cancelled.
+	 */
+	class Ticket
+	{
+	private:
+		std::shared_ptr<DeviceQueue> m_pQueue;
+		bool m_bGranted;
+		bool m_bNested;
+
+	public:
+		Ticket(const TString serialNumber, Priority priority, CancellationToken* token = NULL);
+		~Ticket();
+
+		explicit operator bool() const;
+
+	private:
+		Ticket(const Ticket&) = delete;
+		Ticket& operator=(const Ticket&) = delete;
+	};
+
+	/**
+	 * Runs the operations a thread starts while it lives in another class,
+	 * e.g. a file browser marks its listings interactive.
+	 */
+	class PriorityScope
+	{
+	private:
+		const int m_nPrevious;
+
+	public:
+		explicit PriorityScope(Priority priority);
+		~PriorityScope();
+
+	private:
+		PriorityScope(const PriorityScope&) = delete;
+		PriorityScope& operator=(const PriorityScope&) = delete;
+	};
+
+private:
+	static DeviceScheduler s_instance;
+	static thread_local int t_nPriority;	// -1 when no PriorityScope is active
+
+	std::mutex m_lock;
+	std::map<std::tstring, std::shared_ptr<DeviceQueue>> m_mapQueues;
+
+private:
+	DeviceScheduler();
+
+public:
+	static DeviceScheduler& GetInstance();
+
+	void GetDeviceStats(std::vector<DeviceStats>& vecStats);
+	void Export(std::tstring& report);
+
+private:
+	std::shared_ptr<DeviceQueue> GetQueue(const TString serialNumber);
+	static bool CanRun(const DeviceQueue& queue, Priority priority, const void* waiter, int limit);
+	static int GetLimit();
+};
@@ -17,9 +17,15 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "FileListingService.h"
-#include <regex>
+#include <algorithm>
+#include <chrono>
+#include "Device.h"
+#include "SyncService.h"
+#include "DeviceScheduler.h"
+#include "SyncSessionManager.h"
+#include "StringUtils.h"
 
-#define APK_PATTERN			".*\\.apk"
+#define APK_EXTENSION		".apk"
 
 #define  DIRECTORY_DATA		"data"
 #define  DIRECTORY_SDCARD		"sdcard"
@@ -31,20 +37,21 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define REFRESH_RATE			5000L
 #define REFRESH_TEST			(long)(REFRESH_RATE * .8)
 
-#define TYPE_FILE				0
-#define TYPE_DIRECTORY			1
-#define TYPE_DIRECTORY_LINK	2
-#define TYPE_BLOCK				3
-#define TYPE_CHARACTER			4
-#define TYPE_LINK				5
-#define TYPE_SOCKET			6
-#define TYPE_FIFO				7
-#define TYPE_OTHER				8
+// file type bits of st_mode
+#define S_IFMT_MASK			0170000
+#define S_IFSOCK_VALUE			0140000
+#define S_IFLNK_VALUE			0120000
+#define S_IFREG_VALUE			0100000
+#define S_IFBLK_VALUE			0060000
+#define S_IFDIR_VALUE			0040000
+#define S_IFCHR_VALUE			0020000
+#define S_IFIFO_VALUE			0010000
 
 #define FILE_SEPARATOR			"/"
 #define FILE_ROOT				"/"
 
-#define ESCAPE_PATTERN_REGEX	"([\\\\()*+?\"'&#/\\s])"
+// escaped with a backslash, as are white spaces
+#define ESCAPE_CHARACTERS		"\\()*+?\"'&#/"
 
 //////////////////////////////////////////////////////////////////////////
 // implements for FileEntry
@@ -59,34 +66,94 @@ FileListingService::FileEntry::FileEntry(FileEntry* parent, const char* name, in
 	CheckAppPackageStatus();
 }
 
+FileListingService::FileEntry::FileEntry(FileEntry* parent, const char* name, int mode, long long size,
+	time_t lastModified)
+{
+	m_pParent = parent;
+	m_strName = name;
+	m_nType = GetTypeFromMode(mode);
+	m_nMode = mode;
+	m_llSize = size;
+	m_tLastModified = lastModified;
+	m_bIsRoot = false;
+
+	CheckAppPackageStatus();
+}
+
+FileListingService::FileEntry::~FileEntry()
+{
+	for (FileEntry* child : m_vecChildren)
+	{
+		delete child;
+	}
+	m_vecChildren.clear();
+	for (FileEntry* child : m_vecRemoved)
+	{
+		delete child;
+	}
+	m_vecRemoved.clear();
+}
+
 const char * FileListingService::FileEntry::GetName() const
 {
 	return m_strName.c_str();
 }
 
-const char* FileListingService::FileEntry::GetSize() const
+void FileListingService::FileEntry::GetSize(std::string& size) const
+{
+	std::ostringstream oss;
+	oss << m_llSize;
+	size = oss.str();
+}
+
+long long FileListingService::FileEntry::GetSizeValue() const
+{
+	return m_llSize;
+}
+
+int FileListingService::FileEntry::GetMode() const
 {
-	return m_strSize.c_str();
+	return m_nMode;
 }
 
-int FileListingService::FileEntry::GetSizeValue() const
+time_t FileListingService::FileEntry::GetLastModified() const
 {
-	return atoi(m_strSize.c_str());
+	return m_tLastModified;
 }
 
-const char* FileListingService::FileEntry::GetDate() const
+void FileListingService::FileEntry::GetDate(std::string& date) const
 {
-	return m_strDate.c_str();
+	char szDate[16] = { 0 };
+	struct tm tmModified;
+	if (localtime_s(&tmModified, &m_tLastModified) == 0)
+	{
+		strftime(szDate, sizeof(szDate), "%Y-%m-%d", &tmModified);
+	}
+	date = szDate;
 }
 
-const char* FileListingService::FileEntry::GetTime() const
+void FileListingService::FileEntry::GetTime(std::string& time) const
 {
-	return m_strTime.c_str();
+	char szTime[8] = { 0 };
+	struct tm tmModified;
+	if (localtime_s(&tmModified, &m_tLastModified) == 0)
+	{
+		strftime(szTime, sizeof(szTime), "%H:%M", &tmModified);
+	}
+	time = szTime;
 }
 
-const char* FileListingService::FileEntry::GetPermissions() const
+void FileListingService::FileEntry::GetPermissions(std::string& permissions) const
 {
-	return m_strPermissions.c_str();
+	// same layout as the first column of ls -l
+	static const char s_szTypeLetter[] = "-dlbclsp?";
+	static const char s_szRwx[] = "rwxrwxrwx";
+	permissions.resize(10);
+	permissions[0] = s_szTypeLetter[m_nType];
+	for (int i = 0; i < 9; i++)
+	{
+		permissions[i + 1] = (m_nMode & (0400 >> i)) != 0 ? s_szRwx[i] : '-';
+	}
 }
 
 const char* FileListingService::FileEntry::GetOwner() const
@@ -176,18 +243,48 @@ void FileListingService::FileEntry::AddChild(FileEntry* child)
 
 void FileListingService::FileEntry::SetChildren(const std::vector<FileEntry*>& newChildren)
 {
-	m_vecChildren.clear();
-	m_vecChildren.assign(newChildren.begin(), newChildren.end());
+	// GetChildren hands the entries out, so a refresh must not free them: a name listed
+	// before keeps its entry and takes the new attributes, an entry that is gone is kept
+	// until this one is destroyed
+	std::map<std::string, FileEntry*> mapOld;
+	for (FileEntry* child : m_vecChildren)
+	{
+		mapOld[child->m_strName] = child;
+	}
+	std::vector<FileEntry*> vecMerged;
+	vecMerged.reserve(newChildren.size());
+	for (FileEntry* child : newChildren)
+	{
+		auto iter = mapOld.find(child->m_strName);
+		if (iter == mapOld.end())
+		{
+			vecMerged.push_back(child);
+			continue;
+		}
+		FileEntry* existing = iter->second;
+		mapOld.erase(iter);
+		if (existing != child)
+		{
+			existing->Update(*child);
+			delete child;
+		}
+		vecMerged.push_back(existing);
+	}
+	for (auto iter = mapOld.begin(); iter != mapOld.end(); ++iter)
+	{
+		m_vecRemoved.push_back(iter->second);
+	}
+	m_vecChildren.swap(vecMerged);
+	m_llFetchTime = NowMillis();
 }
 
 bool FileListingService::FileEntry::NeedFetch() const
 {
-	if (m_tFetchTime == 0)
+	if (m_llFetchTime == 0)
 	{
 		return true;
 	}
-	time_t current = time(NULL);
-	return current - m_tFetchTime > REFRESH_TEST;
+	return NowMillis() - m_llFetchTime > REFRESH_TEST;
 }
 
 bool FileListingService::FileEntry::IsApplicationPackage() const
@@ -197,13 +294,33 @@ bool FileListingService::FileEntry::IsApplicationPackage() const
 
 bool FileListingService::FileEntry::IsAppFileName() const
 {
-	std::regex rxName(APK_PATTERN, std::tregex::icase);
-	std::smatch results;
-	if (std::regex_match(m_strName, results, rxName) && results[0].matched)
+	// same as matching ".*\.apk" case insensitively
+	const size_t extLength = sizeof(APK_EXTENSION) - 1;
+	const size_t length = m_strName.length();
+	if (length < extLength || !StringUtils::EqualsIgnoreCase(m_strName.c_str() + length - extLength, APK_EXTENSION, extLength))
 	{
-		return true;
+		return false;
 	}
-	return false;
+	return std::none_of(m_strName.begin(), m_strName.end() - extLength, StringUtils::IsLineTerminator<char>);
+}
+
+void FileListingService::FileEntry::Update(const FileEntry& entry)
+{
+	// the name, parent and cached children stay
+	m_strInfo = entry.m_strInfo;
+	m_strOwner = entry.m_strOwner;
+	m_strGroup = entry.m_strGroup;
+	m_nType = entry.m_nType;
+	m_nMode = entry.m_nMode;
+	m_llSize = entry.m_llSize;
+	m_tLastModified = entry.m_tLastModified;
+	m_bIsAppPackage = entry.m_bIsAppPackage;
+}
+
+long long FileListingService::FileEntry::NowMillis()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 void FileListingService::FileEntry::FillPathBuilder(std::string& pathBuilder, bool escapePath) const
@@ -260,12 +377,103 @@ void FileListingService::FileEntry::CheckAppPackageStatus()
 
 void FileListingService::FileEntry::Escape(const char* entryName, std::string& escaped)
 {
-	std::regex rxName(ESCAPE_PATTERN_REGEX);
-	std::smatch results;
-	std::string enrty(entryName);
-	if (std::regex_match(enrty, results, rxName) && results[0].matched)
+	escaped.clear();
+	for (const char* p = entryName; *p != '\0'; p++)
+	{
+		if (StringUtils::IsSpace(*p) || strchr(ESCAPE_CHARACTERS, *p) != NULL)
+		{
+			escaped.push_back('\\');
+		}
+		escaped.push_back(*p);
+	}
+}
+
+int FileListingService::FileEntry::GetTypeFromMode(int mode)
+{
+	switch (mode & S_IFMT_MASK)
+	{
+	case S_IFREG_VALUE:
+		return TYPE_FILE;
+	case S_IFDIR_VALUE:
+		return TYPE_DIRECTORY;
+	case S_IFLNK_VALUE:
+		return TYPE_LINK;
+	case S_IFBLK_VALUE:
+		return TYPE_BLOCK;
+	case S_IFCHR_VALUE:
+		return TYPE_CHARACTER;
+	case S_IFSOCK_VALUE:
+		return TYPE_SOCKET;
+	case S_IFIFO_VALUE:
+		return TYPE_FIFO;
+	default:
+		return TYPE_OTHER;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for FileListingService
+
+FileListingService::FileListingService(Device* device)
+{
+	m_pDevice = device;
+	m_pRoot = NULL;
+}
+
+FileListingService::~FileListingService()
+{
+	if (m_pRoot != NULL)
+	{
+		delete m_pRoot;
+		m_pRoot = NULL;
+	}
+}
+
+FileListingService::FileEntry* FileListingService::GetRoot()
+{
+	if (m_pRoot == NULL)
+	{
+		m_pRoot = new FileEntry(NULL, "", TYPE_DIRECTORY, true);
+	}
+	return m_pRoot;
+}
+
+bool FileListingService::GetChildren(FileEntry* entry, bool useCache, std::vector<FileEntry*>& vecChildren)
+{
+	if (useCache && !entry->NeedFetch())
+	{
+		entry->GetCachedChildren(vecChildren);
+		return true;
+	}
+
+	// someone is looking at the listing, it goes ahead of installs and transfers
+	DeviceScheduler::Ticket ticket(m_pDevice->GetSerialNumber(), DeviceScheduler::PRIORITY_INTERACTIVE);
+	if (!ticket)
+	{
+		return false;
+	}
+	SyncSessionManager::Lease sync = SyncSessionManager::GetInstance().Acquire(m_pDevice);
+	if (!sync)
+	{
+		return false;
+	}
+
+	std::string fullPath;
+	entry->GetFullPath(fullPath);
+#ifdef _UNICODE
+	std::wstring remotePath;
+	ConvertUtils::StringToWstring(fullPath, remotePath);
+#else
+	std::string& remotePath = fullPath;
+#endif
+	bool bRet = sync->ListDirectory(remotePath.c_str(), entry);
+	if (!bRet)
+	{
+		sync.SetFailed();
+	}
+	if (bRet)
 	{
-		// todo escaped
-		escaped;
+		entry->GetCachedChildren(vecChildren);
 	}
+	return bRet;
 }
@@ -20,38 +20,58 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "CommonDefine.h"
 
+#define TYPE_FILE				0
+#define TYPE_DIRECTORY			1
+#define TYPE_DIRECTORY_LINK	2
+#define TYPE_BLOCK				3
+#define TYPE_CHARACTER			4
+#define TYPE_LINK				5
+#define TYPE_SOCKET			6
+#define TYPE_FIFO				7
+#define TYPE_OTHER				8
+
+// define class
+class Device;
+class SyncService;
+
 class FileListingService
 {
 public:
 	class FileEntry
 	{
+		friend class SyncService;
+		friend class FileListingService;
 	private:
 		FileEntry* m_pParent;
 		std::string m_strName;
 		std::string m_strInfo;
-		std::string m_strPermissions;
-		std::string m_strSize;
-		std::string m_strDate;
-		std::string m_strTime;
 		std::string m_strOwner;
 		std::string m_strGroup;
 		int m_nType;
+		int m_nMode = 0;
+		long long m_llSize = 0;
+		time_t m_tLastModified = 0;
 		bool m_bIsAppPackage;
 		bool m_bIsRoot;
-		time_t m_tFetchTime = 0;
+		long long m_llFetchTime = 0;	// steady clock, in ms
 
 		std::vector<FileEntry*> m_vecChildren;
+		std::vector<FileEntry*> m_vecRemoved;	// gone on the device, callers may still hold them
 
 	private:
 		FileEntry(FileEntry* parent, const char* name, int type, bool isRoot);
+		FileEntry(FileEntry* parent, const char* name, int mode, long long size, time_t lastModified);
 
 	public:
+		~FileEntry();
 		const char* GetName() const;
-		const char* GetSize() const;
-		int GetSizeValue() const;
-		const char* GetDate() const;
-		const char* GetTime() const;
-		const char* GetPermissions() const;
+		void GetSize(std::string& size) const;
+		long long GetSizeValue() const;
+		int GetMode() const;
+		time_t GetLastModified() const;
+		void GetDate(std::string& date) const;
+		void GetTime(std::string& time) const;
+		void GetPermissions(std::string& permissions) const;
 		const char* GetOwner() const;
 		const char* GetGroup() const;
 		const char* GetInfo() const;
@@ -75,7 +95,21 @@ public:
 		void FillPathSegments(std::vector<std::string>& list) const;
 	private:
 		void CheckAppPackageStatus();
+		void Update(const FileEntry& entry);
+		static long long NowMillis();
 	public:
 		static void Escape(const char* entryName, std::string& escaped);
+		static int GetTypeFromMode(int mode);
 	};
+
+private:
+	Device* m_pDevice;
+	FileEntry* m_pRoot;
+
+public:
+	FileListingService(Device* device);
+	~FileListingService();
+
+	FileEntry* GetRoot();
+	bool GetChildren(FileEntry* entry, bool useCache, std::vector<FileEntry*>& vecChildren);
 };
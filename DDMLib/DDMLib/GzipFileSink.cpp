@@ -0,0 +1,190 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "GzipFileSink.h"
+#include <algorithm>
+#include "../System/Deflate.h"
+
+#define GZIP_OS_NTFS			0x0B
+#define GZIP_XFL_BEST			2
+#define GZIP_XFL_FASTEST		4
+
+// reflected CRC-32 (polynomial 0xEDB88320), as gzip and zip use it
+struct GzipCrcTable
+{
+	UINT32 table[256];
+
+	GzipCrcTable()
+	{
+		for (UINT32 i = 0; i < 256; i++)
+		{
+			UINT32 crc = i;
+			for (int bit = 0; bit < 8; bit++)
+			{
+				crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+			}
+			table[i] = crc;
+		}
+	}
+};
+
+static const GzipCrcTable s_crcTable;
+
+GzipFileSink::GzipFileSink(const TString path, int level, int workers) :
+	m_file(path), m_nLevel((std::max)((std::min)(level, DEFLATE_MAX_LEVEL), 0)),
+	m_nMaxPending(static_cast<size_t>((std::max)(workers, 1))), m_nCrc(0), m_nSize(0), m_bError(false)
+{
+}
+
+GzipFileSink::~GzipFileSink()
+{
+	// clearing waits for segments still compressing, they only hold their own buffers
+	m_deqPending.clear();
+	m_fWrite.Close();
+	m_fWrite.Delete();
+}
+
+bool GzipFileSink::Open()
+{
+	m_fWrite = m_file.GetWrite();
+	if (!m_fWrite.IsValid())
+	{
+		return false;
+	}
+	m_pSegment = std::make_shared<std::vector<BYTE>>();
+	m_pSegment->reserve(GZIP_SEGMENT_SIZE);
+
+	// magic, deflate, no flags, no mtime
+	const BYTE xfl = m_nLevel >= DEFLATE_MAX_LEVEL ? GZIP_XFL_BEST : (m_nLevel == 1 ? GZIP_XFL_FASTEST : 0);
+	const BYTE arrHeader[10] = { 0x1F, 0x8B, 8, 0, 0, 0, 0, 0, xfl, GZIP_OS_NTFS };
+	return WriteRaw(arrHeader, sizeof(arrHeader));
+}
+
+bool GzipFileSink::WriteData(const char* data, int length)
+{
+	if (m_bError)
+	{
+		return false;
+	}
+	const BYTE* pData = reinterpret_cast<const BYTE*>(data);
+	m_nCrc = UpdateCrc(m_nCrc, pData, length);
+	m_nSize += static_cast<UINT32>(length);
+	while (length > 0)
+	{
+		const int count = (std::min)(length, static_cast<int>(GZIP_SEGMENT_SIZE - m_pSegment->size()));
+		m_pSegment->insert(m_pSegment->end(), pData, pData + count);
+		pData += count;
+		length -= count;
+		if (m_pSegment->size() == GZIP_SEGMENT_SIZE)
+		{
+			QueueSegment(false);
+			// compressed segments go out in order, at most m_nMaxPending keep compressing
+			if (!WritePending(m_nMaxPending))
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool GzipFileSink::Finish()
+{
+	if (m_bError || !m_pSegment)
+	{
+		return false;
+	}
+	QueueSegment(true);
+	if (!WritePending(0))
+	{
+		return false;
+	}
+	// crc and size modulo 2^32, little endian
+	BYTE arrTrailer[8];
+	for (int i = 0; i < 4; i++)
+	{
+		arrTrailer[i] = static_cast<BYTE>(m_nCrc >> (8 * i));
+		arrTrailer[4 + i] = static_cast<BYTE>(m_nSize >> (8 * i));
+	}
+	return WriteRaw(arrTrailer, sizeof(arrTrailer));
+}
+
+void GzipFileSink::QueueSegment(bool final)
+{
+	std::shared_ptr<std::vector<BYTE>> pSegment = m_pSegment;
+	std::shared_ptr<std::vector<BYTE>> pHistory = m_pPrevious;
+	const int level = m_nLevel;
+	auto compress = [pSegment, pHistory, level, final]()
+	{
+		std::vector<BYTE> vecOut;
+		vecOut.reserve(pSegment->size() / 2);
+		const size_t historyLength = pHistory ? (std::min)(pHistory->size(), static_cast<size_t>(DEFLATE_WINDOW_SIZE)) : 0;
+		const BYTE* history = pHistory ? pHistory->data() + pHistory->size() - historyLength : NULL;
+		Deflate::CompressSegment(history, historyLength, pSegment->data(), pSegment->size(), level, final, vecOut);
+		return vecOut;
+	};
+	// a single worker, or the whole file in one segment, does not need a thread
+	if (m_nMaxPending <= 1 || (final && m_deqPending.empty()))
+	{
+		std::promise<std::vector<BYTE>> promise;
+		promise.set_value(compress());
+		m_deqPending.push_back(promise.get_future());
+	}
+	else
+	{
+		m_deqPending.push_back(std::async(std::launch::async, compress));
+	}
+
+	m_pPrevious = pSegment;
+	m_pSegment = std::make_shared<std::vector<BYTE>>();
+	m_pSegment->reserve(GZIP_SEGMENT_SIZE);
+}
+
+bool GzipFileSink::WritePending(size_t keep)
+{
+	while (m_deqPending.size() > keep)
+	{
+		std::vector<BYTE> vecOut = m_deqPending.front().get();
+		m_deqPending.pop_front();
+		if (!WriteRaw(vecOut.data(), vecOut.size()))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool GzipFileSink::WriteRaw(const BYTE* data, size_t length)
+{
+	DWORD dwWrite = 0;
+	if (!::WriteFile(m_fWrite, data, static_cast<DWORD>(length), &dwWrite, NULL) || dwWrite != length)
+	{
+		m_bError = true;
+		return false;
+	}
+	return true;
+}
+
+UINT32 GzipFileSink::UpdateCrc(UINT32 crc, const BYTE* data, size_t length)
+{
+	crc = ~crc;
+	for (size_t i = 0; i < length; i++)
+	{
+		crc = (crc >> 8) ^ s_crcTable.table[(crc ^ data[i]) & 0xFF];
+	}
+	return ~crc;
+}
@@ -0,0 +1,67 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "CommonDefine.h"
+#include <deque>
+#include <future>
+#include <memory>
+#include "SyncService.h"
+
+#define GZIP_SEGMENT_SIZE		1024*1024
+
+/**
+ * Pull sink writing a gzip file as the data arrives, so artifacts that are
+ * archived compressed anyway are written once instead of twice. Input is
+ * cut into segments compressed by up to `workers` threads at once, each
+ * primed with the tail of the previous segment so the ratio matches a
+ * single stream. Finish must be called after a successful pull to write
+ * the trailer.
+ */
+class GzipFileSink : public SyncService::IDataSink
+{
+private:
+	File m_file;
+	FileReadWrite m_fWrite;
+	const int m_nLevel;
+	const size_t m_nMaxPending;
+
+	std::shared_ptr<std::vector<BYTE>> m_pSegment;
+	std::shared_ptr<std::vector<BYTE>> m_pPrevious;	// history for the next segment
+	std::deque<std::future<std::vector<BYTE>>> m_deqPending;
+	UINT32 m_nCrc;
+	UINT32 m_nSize;
+	bool m_bError;
+
+public:
+	GzipFileSink(const TString path, int level, int workers);
+	~GzipFileSink();
+
+	virtual bool Open() override;
+	virtual bool WriteData(const char* data, int length) override;
+	bool Finish();
+
+private:
+	void QueueSegment(bool final);
+	bool WritePending(size_t keep);
+	bool WriteRaw(const BYTE* data, size_t length);
+
+public:
+	// the reflected CRC-32 of the gzip trailer, also used to check decoded streams
+	static UINT32 UpdateCrc(UINT32 crc, const BYTE* data, size_t length);
+};
@@ -47,6 +47,7 @@ public:
 	{
 		virtual bool IsCancelled() = 0;
 		virtual void OnProgress(int progress) = 0;
+		virtual CancellationToken* GetCancellationToken() { return NULL; }
 	};
 
 	interface IInstallNotify : public ISyncNotify
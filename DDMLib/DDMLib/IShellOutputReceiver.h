@@ -20,6 +20,8 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "CommonDefine.h"
 
+class CancellationToken;
+
 interface IShellOutputReceiver
 {
 	virtual void AddOutput(char* pData, int offset, int length) = 0;
@@ -27,4 +29,7 @@ interface IShellOutputReceiver
 	virtual void Flush() = 0;
 
 	virtual bool IsCancelled() = 0;
+
+	// lets the command be cancelled while it blocks on the socket, not just between reads
+	virtual CancellationToken* GetCancellationToken() { return NULL; }
 };
\ No newline at end of file
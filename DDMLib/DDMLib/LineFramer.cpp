@@ -0,0 +1,139 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "LineFramer.h"
+#include <cstring>
+#include "StringUtils.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#include <intrin.h>
+#define LINE_FRAMER_SSE2
+#endif
+
+LineFramer::LineFramer(bool trim) : m_bTrim(trim)
+{
+}
+
+void LineFramer::SetTrim(bool trim)
+{
+	m_bTrim = trim;
+}
+
+const std::vector<LineView>& LineFramer::Feed(const char* data, int length)
+{
+	m_vecLines.clear();
+	m_vecJoined.clear();
+
+	const char* p = data;
+	const char* end = data + length;
+	if (!m_vecPartial.empty())
+	{
+		const char* nl = FindNewLine(p, end);
+		if (nl == NULL)
+		{
+			m_vecPartial.insert(m_vecPartial.end(), p, end);
+			return m_vecLines;
+		}
+		// keep both buffers around so their capacity is reused
+		m_vecJoined.swap(m_vecPartial);
+		m_vecJoined.insert(m_vecJoined.end(), p, nl);
+		AddLine(m_vecJoined.data(), m_vecJoined.data() + m_vecJoined.size());
+		m_vecPartial.clear();
+		p = nl + 1;
+	}
+
+	const char* nl;
+	while ((nl = FindNewLine(p, end)) != NULL)
+	{
+		AddLine(p, nl);
+		p = nl + 1;
+	}
+	m_vecPartial.assign(p, end);
+	return m_vecLines;
+}
+
+const std::vector<LineView>& LineFramer::Finish()
+{
+	m_vecLines.clear();
+	m_vecJoined.clear();
+	if (!m_vecPartial.empty())
+	{
+		m_vecJoined.swap(m_vecPartial);
+		AddLine(m_vecJoined.data(), m_vecJoined.data() + m_vecJoined.size());
+	}
+	return m_vecLines;
+}
+
+const char* LineFramer::FindNewLine(const char* begin, const char* end)
+{
+	const char* p = begin;
+#ifdef LINE_FRAMER_SSE2
+	const __m128i newLine = _mm_set1_epi8('\n');
+	// most lines are longer than 64 bytes, test four blocks per branch
+	while (end - p >= 64)
+	{
+		__m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), newLine);
+		__m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16)), newLine);
+		__m128i c = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32)), newLine);
+		__m128i d = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48)), newLine);
+		if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) != 0)
+		{
+			break;
+		}
+		p += 64;
+	}
+	while (end - p >= 16)
+	{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newLine));
+		if (mask != 0)
+		{
+			unsigned long index;
+			_BitScanForward(&index, static_cast<unsigned long>(mask));
+			return p + index;
+		}
+		p += 16;
+	}
+#endif
+	if (p >= end)
+	{
+		return NULL;
+	}
+	return static_cast<const char*>(memchr(p, '\n', end - p));
+}
+
+void LineFramer::AddLine(const char* begin, const char* end)
+{
+	if (m_bTrim)
+	{
+		while (begin < end && StringUtils::IsSpace(*begin))
+		{
+			begin++;
+		}
+		while (end > begin && StringUtils::IsSpace(end[-1]))
+		{
+			end--;
+		}
+	}
+	else if (end > begin && end[-1] == '\r')
+	{
+		end--;
+	}
+	LineView line = { begin, static_cast<int>(end - begin) };
+	m_vecLines.push_back(line);
+}
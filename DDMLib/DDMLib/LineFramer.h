@@ -0,0 +1,60 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "CommonDefine.h"
+
+// a line inside a LineFramer buffer, without its terminator
+struct LineView
+{
+	const char* pData;
+	int nLength;
+};
+
+/**
+ * Splits a byte stream into lines. Lines end at '\n' (a '\r' before it is
+ * dropped too), lines cut by the end of a chunk are held back until the
+ * rest arrives. The views point into the caller's chunk or an internal
+ * buffer and stay valid until the next Feed or Finish.
+ */
+class LineFramer
+{
+private:
+	bool m_bTrim;
+	std::vector<char> m_vecPartial;	// start of a line still waiting for its '\n'
+	std::vector<char> m_vecJoined;	// the partial line completed by the current chunk
+	std::vector<LineView> m_vecLines;
+
+public:
+	explicit LineFramer(bool trim = true);
+
+	// strips leading and trailing white space from every line
+	void SetTrim(bool trim);
+
+	// @return the lines completed by this chunk
+	const std::vector<LineView>& Feed(const char* data, int length);
+
+	// @return the last line if the stream did not end with a '\n'
+	const std::vector<LineView>& Finish();
+
+	// like memchr for '\n', 16 bytes at a time with SSE2 where available
+	static const char* FindNewLine(const char* begin, const char* end);
+
+private:
+	void AddLine(const char* begin, const char* end);
+};
@@ -0,0 +1,526 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "MirrorSync.h"
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include "Device.h"
+#include "DdmPreferences.h"
+#include "DeviceScheduler.h"
+#include "Log.h"
+#include "NullOutputReceiver.h"
+#include "StringUtils.h"
+#include "SyncSessionManager.h"
+#include "../System/File.h"
+
+#define MIRROR					_T("mirror")
+#define WATCH_BUFFER_SIZE		64*1024
+#define DEBOUNCE_MS				200		// quiet time before a batch goes out
+#define MAX_BATCH_DELAY_MS		800		// a batch waits no longer than this under constant changes
+#define MAX_COMMAND_LENGTH		4000	// one rm per this many characters of paths
+#define TREE_LIST_COMMAND		_T("find . -mindepth 1 -exec stat -c '%f %s %Y %n' {} + 2>/dev/null")
+#define MODE_TYPE_MASK			0xF000
+#define MODE_DIRECTORY			0x4000
+
+MirrorSync::MirrorSync(Device* device, const TString localRoot, const TString remoteRoot) :
+	m_pDevice(device), m_strLocalRoot(localRoot), m_strRemoteRoot(remoteRoot),
+	m_hDirectory(INVALID_HANDLE_VALUE), m_hStopEvent(NULL), m_llLastEvent(0), m_bRescan(false), m_bStopping(false)
+{
+}
+
+MirrorSync::~MirrorSync()
+{
+	Stop();
+}
+
+bool MirrorSync::Start(bool initialSync)
+{
+	if (m_hDirectory != INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	// open the directory before returning, so no change after Start is missed
+	m_hDirectory = ::CreateFile(m_strLocalRoot.c_str(), FILE_LIST_DIRECTORY,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	if (m_hDirectory == INVALID_HANDLE_VALUE)
+	{
+		LogEEx(MIRROR, _T("Unable to watch %s"), m_strLocalRoot.c_str());
+		return false;
+	}
+	m_hStopEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_mapPending.clear();
+		m_bRescan = initialSync;
+		m_bStopping = false;
+		m_llLastEvent = 0;
+	}
+	m_threadWatch = std::thread(&MirrorSync::WatchLoop, this);
+	m_threadSync = std::thread(&MirrorSync::SyncLoop, this);
+	LogDEx(MIRROR, _T("Mirroring %s to %s on '%s'"), m_strLocalRoot.c_str(), m_strRemoteRoot.c_str(),
+		m_pDevice->GetSerialNumber());
+	return true;
+}
+
+void MirrorSync::Stop()
+{
+	if (m_hDirectory == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_bStopping = true;
+		m_cvChanged.notify_all();
+	}
+	::SetEvent(m_hStopEvent);
+	m_threadWatch.join();
+	m_threadSync.join();
+	::CloseHandle(m_hStopEvent);
+	::CloseHandle(m_hDirectory);
+	m_hStopEvent = NULL;
+	m_hDirectory = INVALID_HANDLE_VALUE;
+}
+
+void MirrorSync::WatchLoop()
+{
+	// FILE_NOTIFY_INFORMATION records must be DWORD aligned
+	std::vector<DWORD> vecBuffer(WATCH_BUFFER_SIZE / sizeof(DWORD));
+	OVERLAPPED overlapped = { 0 };
+	overlapped.hEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+	const DWORD dwFilter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+		FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+
+	while (true)
+	{
+		::ResetEvent(overlapped.hEvent);
+		if (!::ReadDirectoryChangesW(m_hDirectory, vecBuffer.data(), WATCH_BUFFER_SIZE, TRUE, dwFilter,
+			NULL, &overlapped, NULL))
+		{
+			LogEEx(MIRROR, _T("Stopped watching %s"), m_strLocalRoot.c_str());
+			break;
+		}
+
+		HANDLE arrHandles[2] = { m_hStopEvent, overlapped.hEvent };
+		DWORD dwWait = ::WaitForMultipleObjects(2, arrHandles, FALSE, INFINITE);
+		DWORD dwBytes = 0;
+		if (dwWait != WAIT_OBJECT_0 + 1)
+		{
+			::CancelIoEx(m_hDirectory, &overlapped);
+			::GetOverlappedResult(m_hDirectory, &overlapped, &dwBytes, TRUE);
+			break;
+		}
+		if (!::GetOverlappedResult(m_hDirectory, &overlapped, &dwBytes, FALSE))
+		{
+			break;
+		}
+
+		if (dwBytes == 0)
+		{
+			// the buffer overflowed and the changes are lost, compare everything again
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_bRescan = true;
+			m_llLastEvent = NowMillis();
+			m_cvChanged.notify_all();
+			continue;
+		}
+
+		const BYTE* pRecord = reinterpret_cast<const BYTE*>(vecBuffer.data());
+		while (true)
+		{
+			const FILE_NOTIFY_INFORMATION* pInfo = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(pRecord);
+#ifdef _UNICODE
+			std::tstring name(pInfo->FileName, pInfo->FileNameLength / sizeof(WCHAR));
+#else
+			std::tstring name;
+			ConvertUtils::WstringToString(std::wstring(pInfo->FileName, pInfo->FileNameLength / sizeof(WCHAR)), name);
+#endif
+			OnChange(name, pInfo->Action);
+			if (pInfo->NextEntryOffset == 0)
+			{
+				break;
+			}
+			pRecord += pInfo->NextEntryOffset;
+		}
+	}
+	::CloseHandle(overlapped.hEvent);
+}
+
+void MirrorSync::SyncLoop()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	while (true)
+	{
+		while (!m_bStopping && m_mapPending.empty() && !m_bRescan)
+		{
+			m_cvChanged.wait(lock);
+		}
+
+		// debounce: wait for a quiet moment, but not longer than the maximum delay
+		while (!m_bStopping)
+		{
+			long long llOldest = m_llLastEvent;
+			for (auto iter = m_mapPending.begin(); iter != m_mapPending.end(); ++iter)
+			{
+				llOldest = (std::min)(llOldest, iter->second.llFirstSeen);
+			}
+			const long long llNow = NowMillis();
+			const long long llWait = (std::min)(m_llLastEvent + DEBOUNCE_MS, llOldest + MAX_BATCH_DELAY_MS) - llNow;
+			if (llWait <= 0)
+			{
+				break;
+			}
+			m_cvChanged.wait_for(lock, std::chrono::milliseconds(llWait));
+		}
+		if (m_bStopping)
+		{
+			break;
+		}
+
+		std::map<std::tstring, PendingChange> mapBatch;
+		mapBatch.swap(m_mapPending);
+		const bool bRescan = m_bRescan;
+		m_bRescan = false;
+
+		lock.unlock();
+		ApplyBatch(mapBatch, bRescan);
+		lock.lock();
+	}
+}
+
+void MirrorSync::OnChange(const std::tstring& relativePath, DWORD action)
+{
+	if (IsTemporaryName(relativePath))
+	{
+		return;
+	}
+	const bool bArrived = action == FILE_ACTION_ADDED || action == FILE_ACTION_RENAMED_NEW_NAME;
+	const Change emChange = (action == FILE_ACTION_REMOVED || action == FILE_ACTION_RENAMED_OLD_NAME) ?
+		CHANGE_REMOVE : CHANGE_UPDATE;
+
+	std::unique_lock<std::mutex> lock(m_lock);
+	const long long llNow = NowMillis();
+	auto iter = m_mapPending.find(relativePath);
+	if (iter == m_mapPending.end())
+	{
+		PendingChange change = { emChange, bArrived, bArrived, llNow };
+		m_mapPending[relativePath] = change;
+	}
+	else if (emChange == CHANGE_REMOVE && iter->second.bCreated)
+	{
+		// came and went within the batch, the device never needs to know
+		m_mapPending.erase(iter);
+	}
+	else
+	{
+		PendingChange& change = iter->second;
+		change.emChange = emChange;
+		change.bArrived = emChange == CHANGE_UPDATE && (bArrived || change.bArrived);
+	}
+	m_llLastEvent = llNow;
+	m_cvChanged.notify_all();
+}
+
+void MirrorSync::ApplyBatch(std::map<std::tstring, PendingChange>& mapBatch, bool rescan)
+{
+	std::vector<std::tstring> vecRemoved;
+	std::vector<std::tstring> vecFiles;
+	if (rescan && CompareTree(vecFiles, vecRemoved))
+	{
+		// the compare covers every change in the batch as well
+		mapBatch.clear();
+	}
+	else if (rescan)
+	{
+		CollectFiles(_T(""), vecFiles);
+	}
+	for (auto iter = mapBatch.begin(); iter != mapBatch.end(); ++iter)
+	{
+		const std::tstring& relativePath = iter->first;
+		if (iter->second.emChange == CHANGE_REMOVE)
+		{
+			vecRemoved.push_back(relativePath);
+			continue;
+		}
+		File file(ToLocalPath(relativePath).c_str());
+		if (file.IsDirectory())
+		{
+			// a directory only changes on its own when it moves in, its files report themselves
+			if (iter->second.bArrived && !rescan)
+			{
+				CollectFiles(relativePath, vecFiles);
+			}
+		}
+		else if (file.Exists() && !rescan)
+		{
+			vecFiles.push_back(relativePath);
+		}
+	}
+
+	// removes first, a rename moves the old name out of the way
+	if (!vecRemoved.empty())
+	{
+		RemoveRemote(vecRemoved);
+	}
+	if (vecFiles.empty())
+	{
+		return;
+	}
+
+	DeviceScheduler::Ticket ticket(m_pDevice->GetSerialNumber(), DeviceScheduler::PRIORITY_BULK);
+	SyncSessionManager::Lease sync = SyncSessionManager::GetInstance().Acquire(m_pDevice);
+	int nFailed = 0;
+	for (const std::tstring& relativePath : vecFiles)
+	{
+		if (!sync)
+		{
+			sync = SyncSessionManager::GetInstance().Acquire(m_pDevice);
+		}
+		if (!sync || !sync->PushFile(ToLocalPath(relativePath).c_str(), ToRemotePath(relativePath).c_str(),
+			SyncService::GetNullProgressMonitor()))
+		{
+			// the file may have gone meanwhile, its remove is already on the way
+			if (File(ToLocalPath(relativePath).c_str()).Exists())
+			{
+				LogEEx(MIRROR, _T("Unable to mirror %s"), relativePath.c_str());
+				nFailed++;
+			}
+			if (sync)
+			{
+				sync.SetFailed();
+				sync = SyncSessionManager::Lease();
+			}
+		}
+	}
+	LogVEx(MIRROR, _T("Mirrored %d files, removed %d, %d failed"), static_cast<int>(vecFiles.size()) - nFailed,
+		static_cast<int>(vecRemoved.size()), nFailed);
+}
+
+bool MirrorSync::CompareTree(std::vector<std::tstring>& vecFiles, std::vector<std::tstring>& vecRemoved)
+{
+	std::tstring quotedRoot;
+	StringUtils::QuoteShellArgument(m_strRemoteRoot.c_str(), quotedRoot);
+	// a missing root lists nothing, so everything is pushed
+	std::tstring cmd(_T("cd "));
+	cmd.append(quotedRoot).append(_T(" 2>/dev/null && ")).append(TREE_LIST_COMMAND);
+	TreeReceiver receiver;
+	if (m_pDevice->ExecuteShellCommand(cmd.c_str(), &receiver, DdmPreferences::GetTimeOut()) != 0)
+	{
+		LogWEx(MIRROR, _T("Unable to list %s on '%s', pushing every file"), m_strRemoteRoot.c_str(),
+			m_pDevice->GetSerialNumber());
+		return false;
+	}
+	const std::map<std::tstring, RemoteEntry>& mapRemote = receiver.GetEntries();
+
+	std::vector<std::tstring> vecLocal;
+	CollectFiles(_T(""), vecLocal);
+	for (const std::tstring& relativePath : vecLocal)
+	{
+		// the push keeps the local modified time, so an unchanged file matches to the second
+		auto iter = mapRemote.find(relativePath);
+		if (iter != mapRemote.end() && !iter->second.bDirectory)
+		{
+			File file(ToLocalPath(relativePath).c_str());
+			if (iter->second.llSize == file.GetLength64() && iter->second.tModified == file.GetLastModifiedTime())
+			{
+				continue;
+			}
+		}
+		vecFiles.push_back(relativePath);
+	}
+
+	// an rm of a directory takes its contents along, skip whatever lies below one
+	const std::set<std::tstring> setLocal(vecLocal.begin(), vecLocal.end());
+	std::set<std::tstring> setRemovedDirectories;
+	for (auto iter = mapRemote.begin(); iter != mapRemote.end(); ++iter)
+	{
+		const std::tstring& relativePath = iter->first;
+		bool bParentRemoved = false;
+		for (size_t pos = relativePath.find_last_of(_T('\\')); pos != std::tstring::npos && pos > 0;
+			pos = relativePath.find_last_of(_T('\\'), pos - 1))
+		{
+			if (setRemovedDirectories.count(relativePath.substr(0, pos)) != 0)
+			{
+				bParentRemoved = true;
+				break;
+			}
+		}
+		if (bParentRemoved)
+		{
+			continue;
+		}
+		if (iter->second.bDirectory)
+		{
+			if (!File(ToLocalPath(relativePath).c_str()).IsDirectory())
+			{
+				setRemovedDirectories.insert(relativePath);
+				vecRemoved.push_back(relativePath);
+			}
+		}
+		else if (setLocal.count(relativePath) == 0)
+		{
+			vecRemoved.push_back(relativePath);
+		}
+	}
+	LogDEx(MIRROR, _T("Rescanned %s, %d files differ, %d gone"), m_strLocalRoot.c_str(),
+		static_cast<int>(vecFiles.size()), static_cast<int>(vecRemoved.size()));
+	return true;
+}
+
+void MirrorSync::RemoveRemote(const std::vector<std::tstring>& vecPaths)
+{
+	size_t index = 0;
+	while (index < vecPaths.size())
+	{
+		std::tostringstream oss;
+		oss << _T("rm -rf");
+		for (; index < vecPaths.size() && oss.tellp() < MAX_COMMAND_LENGTH; index++)
+		{
+			std::tstring quotedPath;
+			StringUtils::QuoteShellArgument(ToRemotePath(vecPaths[index]).c_str(), quotedPath);
+			oss << _T(" ") << quotedPath;
+		}
+		if (m_pDevice->ExecuteShellCommand(oss.str().c_str(), &NullOutputReceiver::GetReceiver(),
+			DdmPreferences::GetTimeOut()) != 0)
+		{
+			LogEEx(MIRROR, _T("Unable to remove files from '%s'"), m_pDevice->GetSerialNumber());
+		}
+	}
+}
+
+void MirrorSync::CollectFiles(const std::tstring& relativePath, std::vector<std::tstring>& vecFiles) const
+{
+	std::vector<std::tstring> vecNames;
+	if (!File(ToLocalPath(relativePath).c_str()).ListFiles(vecNames))
+	{
+		return;
+	}
+	for (const std::tstring& name : vecNames)
+	{
+		const std::tstring childPath = relativePath.empty() ? name : relativePath + _T("\\") + name;
+		if (IsTemporaryName(childPath))
+		{
+			continue;
+		}
+		if (File(ToLocalPath(childPath).c_str()).IsDirectory())
+		{
+			CollectFiles(childPath, vecFiles);
+		}
+		else
+		{
+			vecFiles.push_back(childPath);
+		}
+	}
+}
+
+std::tstring MirrorSync::ToLocalPath(const std::tstring& relativePath) const
+{
+	if (relativePath.empty())
+	{
+		return m_strLocalRoot;
+	}
+	return m_strLocalRoot + _T("\\") + relativePath;
+}
+
+std::tstring MirrorSync::ToRemotePath(const std::tstring& relativePath) const
+{
+	std::tstring remotePath(relativePath);
+	std::replace(remotePath.begin(), remotePath.end(), _T('\\'), _T('/'));
+	return m_strRemoteRoot + _T("/") + remotePath;
+}
+
+bool MirrorSync::IsTemporaryName(const std::tstring& relativePath)
+{
+	size_t pos = relativePath.find_last_of(_T('\\'));
+	const std::tstring name = pos == std::tstring::npos ? relativePath : relativePath.substr(pos + 1);
+	if (name.empty())
+	{
+		return false;
+	}
+	// vim writes 4913 to probe the directory, jetbrains IDEs save through ___jb_ files
+	static const TCHAR* const s_arrSuffixes[] = { _T("~"), _T(".swp"), _T(".swx"), _T(".swo"), _T(".tmp"),
+		_T("___jb_tmp___"), _T("___jb_old___") };
+	for (const TCHAR* suffix : s_arrSuffixes)
+	{
+		const size_t length = _tcslen(suffix);
+		if (name.length() >= length && name.compare(name.length() - length, length, suffix) == 0)
+		{
+			return true;
+		}
+	}
+	return name == _T("4913") || name.compare(0, 2, _T(".#")) == 0 || name.compare(0, 2, _T("~$")) == 0;
+}
+
+long long MirrorSync::NowMillis()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for TreeReceiver
+
+void MirrorSync::TreeReceiver::ProcessNewLines(const std::vector<std::string>& vecArray)
+{
+	for (const std::string& line : vecArray)
+	{
+		// <raw mode in hex> <size> <mtime> ./<path>, the path may hold spaces
+		std::istringstream iss(line);
+		unsigned int mode = 0;
+		long long size = 0;
+		long long modified = 0;
+		if (!(iss >> std::hex >> mode >> std::dec >> size >> modified) || iss.get() != ' ')
+		{
+			continue;
+		}
+		std::string path;
+		std::getline(iss, path);
+		if (path.compare(0, 2, "./") != 0 || path.length() <= 2)
+		{
+			continue;
+		}
+		path.erase(0, 2);
+		std::replace(path.begin(), path.end(), '/', '\\');
+
+		RemoteEntry entry = { (mode & MODE_TYPE_MASK) == MODE_DIRECTORY, size, static_cast<time_t>(modified) };
+#ifdef _UNICODE
+		const int length = ::MultiByteToWideChar(CP_UTF8, 0, path.c_str(), static_cast<int>(path.size()), NULL, 0);
+		if (length <= 0)
+		{
+			continue;
+		}
+		std::wstring wide(length, L'\0');
+		::MultiByteToWideChar(CP_UTF8, 0, path.c_str(), static_cast<int>(path.size()), &wide[0], length);
+		m_mapEntries[wide] = entry;
+#else
+		m_mapEntries[path] = entry;
+#endif
+	}
+}
+
+bool MirrorSync::TreeReceiver::IsCancelled()
+{
+	return false;
+}
+
+std::map<std::tstring, MirrorSync::RemoteEntry>& MirrorSync::TreeReceiver::GetEntries()
+{
+	return m_mapEntries;
+}
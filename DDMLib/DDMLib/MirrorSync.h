@@ -0,0 +1,113 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "CommonDefine.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "MultiLineReceiver.h"
+
+// define class
+class Device;
+
+/**
+ * Mirrors a local directory onto the device while it is being edited.
+ * Changes reported by ReadDirectoryChangesW are collected per path and
+ * pushed once the tree has been quiet for a moment, or after at most a
+ * second of continuous changes. A path that comes and goes within one
+ * batch, like an editor's save-by-rename, costs nothing; editor temp and
+ * swap files are ignored; deletes are batched into one rm on the device.
+ * When the change buffer overflows the remote tree is listed and compared
+ * by size and modified time, so only what differs is pushed or removed.
+ * The device must outlive the mirror.
+ */
+class MirrorSync
+{
+private:
+	enum Change
+	{
+		CHANGE_UPDATE,
+		CHANGE_REMOVE
+	};
+
+	struct PendingChange
+	{
+		Change emChange;
+		bool bCreated;		// did not exist when the batch began, a remove cancels it out
+		bool bArrived;		// created or renamed in, a directory is pushed whole
+		long long llFirstSeen;
+	};
+
+	struct RemoteEntry
+	{
+		bool bDirectory;
+		long long llSize;
+		time_t tModified;
+	};
+
+	class TreeReceiver : public MultiLineReceiver
+	{
+	private:
+		std::map<std::tstring, RemoteEntry> m_mapEntries;	// keyed by path relative to the remote root
+
+	public:
+		virtual void ProcessNewLines(const std::vector<std::string>& vecArray) override;
+		virtual bool IsCancelled() override;
+		std::map<std::tstring, RemoteEntry>& GetEntries();
+	};
+
+private:
+	Device* m_pDevice;
+	const std::tstring m_strLocalRoot;
+	const std::tstring m_strRemoteRoot;
+
+	HANDLE m_hDirectory;
+	HANDLE m_hStopEvent;
+	std::thread m_threadWatch;
+	std::thread m_threadSync;
+
+	std::mutex m_lock;
+	std::condition_variable m_cvChanged;
+	std::map<std::tstring, PendingChange> m_mapPending;	// keyed by path relative to the local root
+	long long m_llLastEvent;
+	bool m_bRescan;
+	bool m_bStopping;
+
+public:
+	MirrorSync(Device* device, const TString localRoot, const TString remoteRoot);
+	~MirrorSync();
+
+	// starts watching, an initial sync pushes every local file first
+	bool Start(bool initialSync);
+	void Stop();
+
+private:
+	void WatchLoop();
+	void SyncLoop();
+	void OnChange(const std::tstring& relativePath, DWORD action);
+	void ApplyBatch(std::map<std::tstring, PendingChange>& mapBatch, bool rescan);
+	// lists the remote tree and picks what differs from the local one, false when it cannot be listed
+	bool CompareTree(std::vector<std::tstring>& vecFiles, std::vector<std::tstring>& vecRemoved);
+	void RemoveRemote(const std::vector<std::tstring>& vecPaths);
+	void CollectFiles(const std::tstring& relativePath, std::vector<std::tstring>& vecFiles) const;
+	std::tstring ToLocalPath(const std::tstring& relativePath) const;
+	std::tstring ToRemotePath(const std::tstring& relativePath) const;
+	static bool IsTemporaryName(const std::tstring& relativePath);
+	static long long NowMillis();
+};
@@ -22,52 +22,35 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include "IShellOutputReceiver.h"
 #include <memory>
 #include "StringUtils.h"
+#include "LineFramer.h"
 
 class MultiLineReceiver : public IShellOutputReceiver
 {
 private:
-	bool m_bTrimLines = true;
+	LineFramer m_framer;
+	std::vector<std::string> m_vecLines;	// reused so the line strings keep their capacity
 
 public:
 	void SetTrimLine(bool trim)
 	{
-		m_bTrimLines = trim;
+		m_framer.SetTrim(trim);
 	}
 
 	virtual void AddOutput(char* pData, int offset, int length) override
 	{
 		if (!IsCancelled())
 		{
-// 			std::string s;
-// 			s.append(pData + offset, length);
-
-			std::stringstream iss;
-			iss.width(length);
-			iss << pData + offset;
-
-			// now we split the lines
-			std::vector<std::string> vecArray;
-
-			std::string line;
-			while (std::getline(iss, line))
-			{
-				if (m_bTrimLines)
-				{
-					StringUtils::TrimString(line);
-				}
-				vecArray.push_back(line);
-			}
-
-			if (!vecArray.empty())
-			{
-				// send it for final processing
-				ProcessNewLines(vecArray);
-			}
+			// a line cut by the end of the chunk is held back until the rest arrives
+			DispatchLines(m_framer.Feed(pData + offset, length));
 		}
 	}
 
 	virtual void Flush() override
 	{
+		if (!IsCancelled())
+		{
+			DispatchLines(m_framer.Finish());
+		}
 		Done();
 	}
 
@@ -76,4 +59,20 @@ public:
 	}
 
 	virtual void ProcessNewLines(const std::vector<std::string>& vecArray) = 0;
+
+private:
+	void DispatchLines(const std::vector<LineView>& vecViews)
+	{
+		if (vecViews.empty())
+		{
+			return;
+		}
+		m_vecLines.resize(vecViews.size());
+		for (size_t i = 0; i < vecViews.size(); i++)
+		{
+			m_vecLines[i].assign(vecViews[i].pData, vecViews[i].nLength);
+		}
+		// send it for final processing
+		ProcessNewLines(m_vecLines);
+	}
 };
\ No newline at end of file
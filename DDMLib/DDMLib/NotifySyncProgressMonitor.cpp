@@ -0,0 +1,106 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "NotifySyncProgressMonitor.h"
+#include "DdmPreferences.h"
+#include <algorithm>
+#include <chrono>
+
+NotifySyncProgressMonitor::NotifySyncProgressMonitor(IDevice::ISyncNotify* pNotify)
+	: m_nInterval(DdmPreferences::GetProgressInterval()), m_nStep((std::max)(DdmPreferences::GetProgressStep(), 1))
+{
+	m_pNotify = pNotify;
+	m_llTotalWork = 0;
+	m_llWorked = 0;
+	m_nReported = -1;
+	m_llReportedAt = 0;
+}
+
+void NotifySyncProgressMonitor::Advance(int work)
+{
+	m_llWorked += work;
+	// directory transfers do not know their total up front, Stop reports their end
+	if (m_llTotalWork <= 0)
+	{
+		return;
+	}
+	int nProgress = static_cast<int>((std::min)(m_llWorked * 100 / m_llTotalWork, 100LL));
+	if (nProgress == m_nReported)
+	{
+		return;
+	}
+	// the final update bypasses the throttle so a transfer never ends short of 100%
+	if (nProgress == 100)
+	{
+		Report(nProgress, NowMillis());
+		return;
+	}
+	if (nProgress - m_nReported < m_nStep)
+	{
+		return;
+	}
+	long long now = NowMillis();
+	if (m_nReported >= 0 && now - m_llReportedAt < m_nInterval)
+	{
+		return;
+	}
+	Report(nProgress, now);
+}
+
+bool NotifySyncProgressMonitor::IsCanceled()
+{
+	return m_pNotify->IsCancelled();
+}
+
+CancellationToken* NotifySyncProgressMonitor::GetCancellationToken()
+{
+	return m_pNotify->GetCancellationToken();
+}
+
+void NotifySyncProgressMonitor::Start(int totalWork)
+{
+	m_llTotalWork = totalWork;
+	m_llWorked = 0;
+	m_nReported = -1;
+	m_llReportedAt = 0;
+}
+
+void NotifySyncProgressMonitor::StartSubTask(const TString name)
+{
+}
+
+void NotifySyncProgressMonitor::Stop()
+{
+	// without a total there is nothing to report until the transfer is over
+	if (m_llTotalWork <= 0 && m_nReported != 100 && !m_pNotify->IsCancelled())
+	{
+		Report(100, NowMillis());
+	}
+}
+
+void NotifySyncProgressMonitor::Report(int progress, long long now)
+{
+	m_nReported = progress;
+	m_llReportedAt = now;
+	m_pNotify->OnProgress(progress);
+}
+
+long long NotifySyncProgressMonitor::NowMillis()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
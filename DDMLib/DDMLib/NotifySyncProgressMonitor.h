@@ -15,47 +15,35 @@ GNU General Public License for more details.
 You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
-
 #pragma once
 
 #include "SyncService.h"
 
+// Forwards sync progress to an ISyncNotify as a percentage. Updates are coalesced so that
+// at most one is delivered per progress interval and only when the percentage moved by
+// at least the progress step, see DdmPreferences. 100% is always delivered.
 class NotifySyncProgressMonitor : public SyncService::ISyncProgressMonitor
 {
 private:
 	IDevice::ISyncNotify* m_pNotify;
-	int m_nTotalWork;
-	long m_lPushed;
+	long long m_llTotalWork;
+	long long m_llWorked;
+	int m_nReported;
+	long long m_llReportedAt;
+	const int m_nInterval;
+	const int m_nStep;
+
 public:
-	NotifySyncProgressMonitor(IDevice::ISyncNotify* pNotify)
-	{
-		m_nTotalWork = 0;
-		m_lPushed = 0;
-		m_pNotify = pNotify;
-	}
-
-	void Advance(int work) override
-	{
-		m_lPushed += work;
-		int nProgress = m_lPushed * 100 / m_nTotalWork;
-		m_pNotify->OnProgress(nProgress);
-	}
-
-	bool IsCanceled() override
-	{
-		return m_pNotify->IsCancelled();
-	}
-
-	void Start(int totalWork) override
-	{
-		m_nTotalWork = totalWork;
-	}
-
-	void StartSubTask(const TString name) override
-	{
-	}
-
-	void Stop() override
-	{
-	}
-};
\ No newline at end of file
+	NotifySyncProgressMonitor(IDevice::ISyncNotify* pNotify);
+
+	void Advance(int work) override;
+	bool IsCanceled() override;
+	CancellationToken* GetCancellationToken() override;
+	void Start(int totalWork) override;
+	void StartSubTask(const TString name) override;
+	void Stop() override;
+
+private:
+	void Report(int progress, long long now);
+	static long long NowMillis();
+};
@@ -0,0 +1,289 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PackageCache.h"
+#include <climits>
+#include "Device.h"
+#include "DdmPreferences.h"
+#include "Log.h"
+#include "NullOutputReceiver.h"
+#include "SyncSessionManager.h"
+#include "../System/File.h"
+#include "../System/FileDigest.h"
+
+#define PACKAGE_CACHE				_T("cache")
+
+#define CACHE_DIRECTORY			"/data/local/tmp/.apkcache"
+#define CACHE_EXTENSION			".apk"
+#define CACHE_LIST_COMMAND		_T("stat -c '%s %Y %n' /data/local/tmp/.apkcache/*.apk 2>/dev/null")
+#define CACHE_TIMEOUT_MS			10000
+
+PackageCache PackageCache::s_instance;
+
+PackageCache::PackageCache()
+{
+}
+
+PackageCache& PackageCache::GetInstance()
+{
+	return s_instance;
+}
+
+int PackageCache::SyncPackage(Device* device, const TString localFilePath, std::tstring& remotePath,
+	IDevice::ISyncNotify* pNotify)
+{
+	std::string sha256;
+	if (!GetDigest(localFilePath, sha256))
+	{
+		LogEEx(PACKAGE_CACHE, _T("Unable to hash %s"), localFilePath);
+		return -1;
+	}
+	GetRemotePath(sha256, remotePath);
+	const long long size = File(localFilePath).GetLength64();
+
+	// one install at a time per device, so the same package is never pushed twice
+	std::shared_ptr<DeviceCache> pCache = GetDeviceCache(device->GetSerialNumber());
+	std::unique_lock<std::mutex> lock(pCache->lock);
+	if (!pCache->bLoaded)
+	{
+		LoadEntries(device, *pCache);
+	}
+
+	for (auto iter = pCache->lstEntries.begin(); iter != pCache->lstEntries.end(); ++iter)
+	{
+		if (iter->strSha256 != sha256)
+		{
+			continue;
+		}
+		// the cache directory lives in /data/local/tmp and may have been wiped
+		if (iter->llSize == size && IsOnDevice(device, remotePath.c_str(), size))
+		{
+			LogDEx(PACKAGE_CACHE, _T("Reusing cached copy of %s on device '%s'"),
+				File::GetName(localFilePath), device->GetSerialNumber());
+			pCache->lstEntries.splice(pCache->lstEntries.begin(), pCache->lstEntries, iter);
+			Touch(device, remotePath.c_str());
+			if (pNotify != NULL)
+			{
+				pNotify->OnProgress(100);
+			}
+			return 0;
+		}
+		pCache->llTotal -= iter->llSize;
+		pCache->lstEntries.erase(iter);
+		break;
+	}
+
+	int nRet = device->SyncFileToDevice(localFilePath, remotePath.c_str(), pNotify);
+	if (nRet != 0)
+	{
+		return nRet;
+	}
+
+	// the sync keeps the local modified time, record the push as the last use instead
+	Touch(device, remotePath.c_str());
+	CacheEntry entry;
+	entry.strSha256 = sha256;
+	entry.llSize = size;
+	pCache->lstEntries.push_front(entry);
+	pCache->llTotal += size;
+	Evict(device, *pCache);
+	return 0;
+}
+
+bool PackageCache::GetDigest(const TString localFilePath, std::string& sha256)
+{
+	File file(localFilePath);
+	if (!file.IsFile())
+	{
+		return false;
+	}
+	const long long llSize = file.GetLength64();
+	const time_t tModified = file.GetLastModifiedTime();
+
+	{
+		std::unique_lock<std::mutex> lock(m_lockDigest);
+		auto iter = m_mapDigest.find(localFilePath);
+		if (iter != m_mapDigest.end() &&
+			iter->second.llSize == llSize && iter->second.tModified == tModified)
+		{
+			sha256 = iter->second.strSha256;
+			return true;
+		}
+	}
+
+	// hash outside of the lock, large packages take a while
+	if (!FileDigest::Sha256(localFilePath, sha256))
+	{
+		return false;
+	}
+
+	std::unique_lock<std::mutex> lock(m_lockDigest);
+	LocalDigest& digest = m_mapDigest[localFilePath];
+	digest.llSize = llSize;
+	digest.tModified = tModified;
+	digest.strSha256 = sha256;
+	return true;
+}
+
+std::shared_ptr<PackageCache::DeviceCache> PackageCache::GetDeviceCache(const TString serialNumber)
+{
+	std::unique_lock<std::mutex> lock(m_lockDevices);
+	std::shared_ptr<DeviceCache>& pCache = m_mapDevices[serialNumber];
+	if (!pCache)
+	{
+		pCache = std::make_shared<DeviceCache>();
+	}
+	return pCache;
+}
+
+void PackageCache::LoadEntries(Device* device, DeviceCache& cache)
+{
+	ListReceiver receiver;
+	int nRet = device->ExecuteShellCommand(CACHE_LIST_COMMAND, &receiver, CACHE_TIMEOUT_MS);
+	if (nRet != 0)
+	{
+		// try again on the next install rather than forgetting what is on the device
+		LogWEx(PACKAGE_CACHE, _T("Unable to list cached packages on device '%s'"), device->GetSerialNumber());
+		return;
+	}
+	receiver.GetEntries(cache.lstEntries, cache.llTotal);
+	cache.bLoaded = true;
+
+	LogDEx(PACKAGE_CACHE, _T("Found %d cached packages on device '%s'"),
+		static_cast<int>(cache.lstEntries.size()), device->GetSerialNumber());
+}
+
+bool PackageCache::IsOnDevice(Device* device, const TString remotePath, long long size)
+{
+	SyncSessionManager::Lease sync = SyncSessionManager::GetInstance().Acquire(device);
+	if (!sync)
+	{
+		return false;
+	}
+	SyncService::FileStat* fileStat = NULL;
+	bool bRet = sync->StatFile(remotePath, &fileStat);
+	if (!bRet || fileStat == NULL)
+	{
+		sync.SetFailed();
+		return false;
+	}
+	// STAT only reports 32 bits of size, larger packages are matched by name alone
+	bRet = fileStat->GetMode() != 0 &&
+		(size > INT_MAX || fileStat->GetSize() == static_cast<int>(size));
+	delete fileStat;
+	return bRet;
+}
+
+void PackageCache::Touch(Device* device, const TString remotePath)
+{
+	std::tstring cmd(_T("touch -c \""));
+	cmd.append(remotePath).append(_T("\""));
+	IShellOutputReceiver& receiver = NullOutputReceiver::GetReceiver();
+	device->ExecuteShellCommand(cmd.c_str(), &receiver, CACHE_TIMEOUT_MS);
+}
+
+void PackageCache::Evict(Device* device, DeviceCache& cache)
+{
+	const long long llBudget = DdmPreferences::GetPackageCacheSize();
+	std::tostringstream oss;
+	int nCount = 0;
+	// always keep the package we just pushed, even if it alone exceeds the budget
+	while (cache.llTotal > llBudget && cache.lstEntries.size() > 1)
+	{
+		const CacheEntry& entry = cache.lstEntries.back();
+		std::tstring remotePath;
+		GetRemotePath(entry.strSha256, remotePath);
+		oss << _T(" \"") << remotePath << _T("\"");
+		cache.llTotal -= entry.llSize;
+		cache.lstEntries.pop_back();
+		nCount++;
+	}
+	if (nCount == 0)
+	{
+		return;
+	}
+
+	LogDEx(PACKAGE_CACHE, _T("Evicting %d cached packages from device '%s'"), nCount, device->GetSerialNumber());
+	std::tstring cmd(_T("rm -f"));
+	cmd.append(oss.str());
+	IShellOutputReceiver& receiver = NullOutputReceiver::GetReceiver();
+	device->ExecuteShellCommand(cmd.c_str(), &receiver, CACHE_TIMEOUT_MS);
+}
+
+void PackageCache::GetRemotePath(const std::string& sha256, std::tstring& remotePath)
+{
+	std::ostringstream oss;
+	oss << CACHE_DIRECTORY << "/" << sha256 << CACHE_EXTENSION;
+#ifdef _UNICODE
+	ConvertUtils::StringToWstring(oss.str(), remotePath);
+#else
+	remotePath = oss.str();
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for ListReceiver
+
+void PackageCache::ListReceiver::ProcessNewLines(const std::vector<std::string>& vecArray)
+{
+	for (const std::string& line : vecArray)
+	{
+		// <size> <mtime> /data/local/tmp/.apkcache/<sha256>.apk
+		std::istringstream iss(line);
+		long long size = 0;
+		long long modified = 0;
+		std::string path;
+		if (!(iss >> size >> modified >> path))
+		{
+			continue;
+		}
+		size_t nameStart = path.find_last_of('/');
+		size_t nameEnd = path.rfind(CACHE_EXTENSION);
+		if (nameStart == std::string::npos || nameEnd == std::string::npos ||
+			nameEnd - nameStart - 1 != SHA256_DIGEST_LENGTH * 2)
+		{
+			continue;
+		}
+		CacheEntry entry;
+		entry.strSha256 = path.substr(nameStart + 1, SHA256_DIGEST_LENGTH * 2);
+		entry.llSize = size;
+		m_vecEntries.push_back(std::make_pair(static_cast<time_t>(modified), entry));
+	}
+}
+
+bool PackageCache::ListReceiver::IsCancelled()
+{
+	return false;
+}
+
+void PackageCache::ListReceiver::GetEntries(std::list<CacheEntry>& lstEntries, long long& llTotal)
+{
+	// hits touch the cached file, so its modified time is the last use across host restarts
+	std::stable_sort(m_vecEntries.begin(), m_vecEntries.end(),
+		[](const std::pair<time_t, CacheEntry>& l, const std::pair<time_t, CacheEntry>& r)
+	{
+		return l.first > r.first;
+	});
+	lstEntries.clear();
+	llTotal = 0;
+	for (const auto& item : m_vecEntries)
+	{
+		lstEntries.push_back(item.second);
+		llTotal += item.second.llSize;
+	}
+}
@@ -0,0 +1,89 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonDefine.h"
+#include <list>
+#include <mutex>
+#include "IDevice.h"
+#include "MultiLineReceiver.h"
+
+// define class
+class Device;
+
+class PackageCache
+{
+private:
+	struct LocalDigest
+	{
+		long long llSize;
+		time_t tModified;
+		std::string strSha256;
+	};
+
+	struct CacheEntry
+	{
+		std::string strSha256;
+		long long llSize;
+	};
+
+	struct DeviceCache
+	{
+		std::mutex lock;
+		bool bLoaded = false;
+		long long llTotal = 0;
+		std::list<CacheEntry> lstEntries;	// most recently used first
+	};
+
+	class ListReceiver : public MultiLineReceiver
+	{
+	private:
+		std::vector<std::pair<time_t, CacheEntry>> m_vecEntries;
+	public:
+		virtual void ProcessNewLines(const std::vector<std::string>& vecArray) override;
+		virtual bool IsCancelled() override;
+		void GetEntries(std::list<CacheEntry>& lstEntries, long long& llTotal);
+	};
+
+private:
+	static PackageCache s_instance;
+
+	std::mutex m_lockDigest;
+	std::map<std::tstring, LocalDigest> m_mapDigest;
+	std::mutex m_lockDevices;
+	std::map<std::tstring, std::shared_ptr<DeviceCache>> m_mapDevices;
+
+private:
+	PackageCache();
+
+public:
+	static PackageCache& GetInstance();
+
+	int SyncPackage(Device* device, const TString localFilePath, std::tstring& remotePath,
+		IDevice::ISyncNotify* pNotify = NULL);
+
+private:
+	bool GetDigest(const TString localFilePath, std::string& sha256);
+	std::shared_ptr<DeviceCache> GetDeviceCache(const TString serialNumber);
+	static void LoadEntries(Device* device, DeviceCache& cache);
+	static bool IsOnDevice(Device* device, const TString remotePath, long long size);
+	static void Touch(Device* device, const TString remotePath);
+	static void Evict(Device* device, DeviceCache& cache);
+	static void GetRemotePath(const std::string& sha256, std::tstring& remotePath);
+};
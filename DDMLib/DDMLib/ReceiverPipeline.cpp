@@ -0,0 +1,532 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ReceiverPipeline.h"
+#include <algorithm>
+#include "GzipFileSink.h"
+#include "Log.h"
+
+#define PIPELINE				_T("pipeline")
+
+#define GZIP_ID1				0x1F
+#define GZIP_ID2				0x8B
+#define GZIP_CM_DEFLATE			8
+#define GZIP_FHCRC				0x02
+#define GZIP_FEXTRA				0x04
+#define GZIP_FNAME				0x08
+#define GZIP_FCOMMENT			0x10
+#define GZIP_FRESERVED			0xE0
+#define GZIP_HEADER_SIZE		10
+#define GZIP_TRAILER_SIZE		8
+
+ReceiverStage::ReceiverStage(IShellOutputReceiver* next) : m_pNext(next)
+{
+}
+
+ReceiverStage::~ReceiverStage()
+{
+}
+
+void ReceiverStage::SetNext(IShellOutputReceiver* next)
+{
+	m_pNext = next;
+}
+
+void ReceiverStage::AddOutput(char* pData, int offset, int length)
+{
+	if (m_pNext != NULL)
+	{
+		m_pNext->AddOutput(pData, offset, length);
+	}
+}
+
+void ReceiverStage::Flush()
+{
+	if (m_pNext != NULL)
+	{
+		m_pNext->Flush();
+	}
+}
+
+bool ReceiverStage::IsCancelled()
+{
+	return m_pNext != NULL && m_pNext->IsCancelled();
+}
+
+CancellationToken* ReceiverStage::GetCancellationToken()
+{
+	return m_pNext != NULL ? m_pNext->GetCancellationToken() : NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for ReceiverPipeline
+
+ReceiverPipeline::ReceiverPipeline() : m_pHead(NULL)
+{
+}
+
+ReceiverPipeline& ReceiverPipeline::Then(ReceiverStage* stage)
+{
+	if (m_vecStages.empty())
+	{
+		m_pHead = stage;
+	}
+	else
+	{
+		m_vecStages.back()->SetNext(stage);
+	}
+	m_vecStages.push_back(std::unique_ptr<ReceiverStage>(stage));
+	return *this;
+}
+
+ReceiverPipeline& ReceiverPipeline::Into(IShellOutputReceiver* sink)
+{
+	if (m_vecStages.empty())
+	{
+		m_pHead = sink;
+	}
+	else
+	{
+		m_vecStages.back()->SetNext(sink);
+	}
+	return *this;
+}
+
+void ReceiverPipeline::AddOutput(char* pData, int offset, int length)
+{
+	if (m_pHead != NULL)
+	{
+		m_pHead->AddOutput(pData, offset, length);
+	}
+}
+
+void ReceiverPipeline::Flush()
+{
+	if (m_pHead != NULL)
+	{
+		m_pHead->Flush();
+	}
+}
+
+bool ReceiverPipeline::IsCancelled()
+{
+	return m_pHead != NULL && m_pHead->IsCancelled();
+}
+
+CancellationToken* ReceiverPipeline::GetCancellationToken()
+{
+	return m_pHead != NULL ? m_pHead->GetCancellationToken() : NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for TeeStage
+
+TeeStage::TeeStage(IShellOutputReceiver* branch, IShellOutputReceiver* next) :
+	ReceiverStage(next), m_pBranch(branch)
+{
+}
+
+void TeeStage::AddOutput(char* pData, int offset, int length)
+{
+	if (!m_pBranch->IsCancelled())
+	{
+		m_pBranch->AddOutput(pData, offset, length);
+	}
+	if (!ReceiverStage::IsCancelled())
+	{
+		ReceiverStage::AddOutput(pData, offset, length);
+	}
+}
+
+void TeeStage::Flush()
+{
+	m_pBranch->Flush();
+	ReceiverStage::Flush();
+}
+
+bool TeeStage::IsCancelled()
+{
+	// a branch that has seen enough does not stop the main chain, and the other way round
+	return m_pBranch->IsCancelled() && (m_pNext == NULL || m_pNext->IsCancelled());
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for LineStage
+
+LineStage::LineStage(IShellOutputReceiver* next) : ReceiverStage(next), m_framer(false)
+{
+}
+
+void LineStage::AddOutput(char* pData, int offset, int length)
+{
+	const char* chunk = pData + offset;
+	PassLines(m_framer.Feed(chunk, length), chunk, length);
+}
+
+void LineStage::Flush()
+{
+	PassLines(m_framer.Finish(), NULL, 0);
+	ReceiverStage::Flush();
+}
+
+bool LineStage::AcceptLine(const char* data, int length)
+{
+	return true;
+}
+
+void LineStage::PassLines(const std::vector<LineView>& vecLines, const char* chunk, int length)
+{
+	for (const LineView& line : vecLines)
+	{
+		if (IsCancelled())
+		{
+			return;
+		}
+		if (!AcceptLine(line.pData, line.nLength))
+		{
+			continue;
+		}
+		if (line.pData >= chunk && line.pData + line.nLength < chunk + length && line.pData[line.nLength] == '\n')
+		{
+			// the line and its '\n' are still in the caller's buffer, lend that
+			ReceiverStage::AddOutput(const_cast<char*>(line.pData), 0, line.nLength + 1);
+		}
+		else
+		{
+			// joined across chunks, cut off by the end or ending in "\r\n"
+			m_strLine.assign(line.pData, line.nLength);
+			m_strLine.push_back('\n');
+			ReceiverStage::AddOutput(&m_strLine[0], 0, static_cast<int>(m_strLine.size()));
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for FilterStage
+
+FilterStage::FilterStage(const std::string& pattern, Match match, bool invert, IShellOutputReceiver* next) :
+	LineStage(next), m_emMatch(match), m_bInvert(invert), m_strPattern(pattern)
+{
+	if (m_emMatch == MATCH_REGEX)
+	{
+		m_rxPattern.assign(pattern, std::regex::ECMAScript | std::regex::optimize);
+	}
+}
+
+bool FilterStage::AcceptLine(const char* data, int length)
+{
+	bool found;
+	if (m_emMatch == MATCH_REGEX)
+	{
+		found = std::regex_search(data, data + length, m_rxPattern);
+	}
+	else if (m_strPattern.empty())
+	{
+		found = true;
+	}
+	else
+	{
+		found = std::search(data, data + length, m_strPattern.begin(), m_strPattern.end()) != data + length;
+	}
+	return found != m_bInvert;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for GzipDecodeStage
+
+GzipDecodeStage::GzipDecodeStage(IShellOutputReceiver* next) : ReceiverStage(next),
+	m_emState(GZIP_HEADER), m_nCrc(0), m_nSize(0), m_nMembers(0)
+{
+}
+
+void GzipDecodeStage::AddOutput(char* pData, int offset, int length)
+{
+	Consume(reinterpret_cast<const BYTE*>(pData + offset), static_cast<size_t>(length));
+}
+
+void GzipDecodeStage::Flush()
+{
+	switch (m_emState)
+	{
+	case GZIP_BODY:
+		if (!ReceiverStage::IsCancelled())
+		{
+			// pass on what can still be decoded before reporting the cut
+			m_inflate.Finish(this);
+			Fail(_T("stream is truncated"));
+		}
+		break;
+	case GZIP_HEADER:
+	case GZIP_TRAILER:
+		if (m_nMembers == 0 || !m_vecPending.empty())
+		{
+			Fail(_T("stream is truncated"));
+		}
+		break;
+	case GZIP_END:
+		if (!m_vecPending.empty())
+		{
+			LogW(PIPELINE, _T("Ignoring a byte after the gzip stream"));
+		}
+		break;
+	default:
+		break;
+	}
+	ReceiverStage::Flush();
+}
+
+bool GzipDecodeStage::IsCancelled()
+{
+	return m_emState == GZIP_ERROR || ReceiverStage::IsCancelled();
+}
+
+bool GzipDecodeStage::HasError() const
+{
+	return m_emState == GZIP_ERROR;
+}
+
+bool GzipDecodeStage::OnInflated(const BYTE* data, size_t length)
+{
+	m_nCrc = GzipFileSink::UpdateCrc(m_nCrc, data, length);
+	m_nSize += static_cast<UINT32>(length);
+	if (m_pNext == NULL)
+	{
+		return true;
+	}
+	// pieces are at most the inflate window, lent to the next stage like any other output
+	m_pNext->AddOutput(const_cast<char*>(reinterpret_cast<const char*>(data)), 0, static_cast<int>(length));
+	return !m_pNext->IsCancelled();
+}
+
+void GzipDecodeStage::Consume(const BYTE* data, size_t length)
+{
+	std::vector<BYTE> vecRest;
+	while (length > 0)
+	{
+		size_t used;
+		switch (m_emState)
+		{
+		case GZIP_HEADER:
+			used = ReadHeader(data, length);
+			break;
+		case GZIP_BODY:
+		{
+			// inflate keeps a copy of whatever it cannot decode yet
+			int result = m_inflate.Feed(data, length, this);
+			if (result < 0)
+			{
+				if (!ReceiverStage::IsCancelled())
+				{
+					Fail(_T("corrupt deflate data"));
+				}
+				return;
+			}
+			if (result == 0)
+			{
+				return;
+			}
+			// the rest of the input starts with the trailer
+			m_inflate.TakeRemainder(vecRest);
+			m_emState = GZIP_TRAILER;
+			data = vecRest.data();
+			length = vecRest.size();
+			continue;
+		}
+		case GZIP_TRAILER:
+			used = ReadTrailer(data, length);
+			break;
+		case GZIP_END:
+			used = ReadNextMember(data, length);
+			break;
+		default:
+			return;
+		}
+		data += used;
+		length -= used;
+	}
+}
+
+size_t GzipDecodeStage::ReadHeader(const BYTE* data, size_t length)
+{
+	const size_t held = m_vecPending.size();
+	m_vecPending.insert(m_vecPending.end(), data, data + length);
+	int headerLength = GetHeaderLength(m_vecPending);
+	if (headerLength < 0)
+	{
+		Fail(_T("not a gzip stream"));
+		return length;
+	}
+	if (headerLength == 0)
+	{
+		// not all of the optional fields are here yet
+		return length;
+	}
+	m_vecPending.clear();
+	m_inflate.Reset();
+	m_nCrc = 0;
+	m_nSize = 0;
+	m_emState = GZIP_BODY;
+	return static_cast<size_t>(headerLength) - held;
+}
+
+size_t GzipDecodeStage::ReadTrailer(const BYTE* data, size_t length)
+{
+	const size_t used = (std::min)(length, GZIP_TRAILER_SIZE - m_vecPending.size());
+	m_vecPending.insert(m_vecPending.end(), data, data + used);
+	if (m_vecPending.size() < GZIP_TRAILER_SIZE)
+	{
+		return used;
+	}
+
+	const BYTE* p = m_vecPending.data();
+	const UINT32 crc = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<UINT32>(p[3]) << 24);
+	const UINT32 size = p[4] | (p[5] << 8) | (p[6] << 16) | (static_cast<UINT32>(p[7]) << 24);
+	m_vecPending.clear();
+	if (crc != m_nCrc)
+	{
+		Fail(_T("CRC mismatch"));
+		return length;
+	}
+	if (size != m_nSize)
+	{
+		Fail(_T("size mismatch"));
+		return length;
+	}
+	m_nMembers++;
+	m_emState = GZIP_END;
+	return used;
+}
+
+size_t GzipDecodeStage::ReadNextMember(const BYTE* data, size_t length)
+{
+	// gzip concatenates members as is, anything else after a member is padding or junk
+	const size_t used = (std::min)(length, 2 - m_vecPending.size());
+	m_vecPending.insert(m_vecPending.end(), data, data + used);
+	if (m_vecPending.size() < 2)
+	{
+		return used;
+	}
+	if (m_vecPending[0] == GZIP_ID1 && m_vecPending[1] == GZIP_ID2)
+	{
+		// the magic stays pending as the start of the next header
+		m_emState = GZIP_HEADER;
+		return used;
+	}
+	LogWEx(PIPELINE, _T("Ignoring data after %d gzip member(s)"), m_nMembers);
+	m_vecPending.clear();
+	m_emState = GZIP_IGNORE;
+	return length;
+}
+
+int GzipDecodeStage::GetHeaderLength(const std::vector<BYTE>& header)
+{
+	const size_t size = header.size();
+	if ((size > 0 && header[0] != GZIP_ID1) || (size > 1 && header[1] != GZIP_ID2)
+		|| (size > 2 && header[2] != GZIP_CM_DEFLATE) || (size > 3 && (header[3] & GZIP_FRESERVED) != 0))
+	{
+		return -1;
+	}
+	if (size < GZIP_HEADER_SIZE)
+	{
+		return 0;
+	}
+
+	const BYTE flags = header[3];
+	size_t pos = GZIP_HEADER_SIZE;
+	if (flags & GZIP_FEXTRA)
+	{
+		if (size < pos + 2)
+		{
+			return 0;
+		}
+		pos += 2 + (header[pos] | (header[pos + 1] << 8));
+	}
+	for (BYTE field : { GZIP_FNAME, GZIP_FCOMMENT })
+	{
+		if (flags & field)
+		{
+			// zero terminated
+			while (pos < size && header[pos] != 0)
+			{
+				pos++;
+			}
+			if (pos++ >= size)
+			{
+				return 0;
+			}
+		}
+	}
+	if (flags & GZIP_FHCRC)
+	{
+		pos += 2;
+	}
+	return pos <= size ? static_cast<int>(pos) : 0;
+}
+
+void GzipDecodeStage::Fail(const TString reason)
+{
+	LogEEx(PIPELINE, _T("Unable to decode gzip output: %s"), reason);
+	m_vecPending.clear();
+	m_emState = GZIP_ERROR;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for FileSinkStage
+
+FileSinkStage::FileSinkStage(const TString path, IShellOutputReceiver* next) :
+	ReceiverStage(next), m_file(path), m_bError(false)
+{
+}
+
+FileSinkStage::~FileSinkStage()
+{
+	m_fWrite.Close();
+	m_fWrite.Delete();
+}
+
+bool FileSinkStage::Open()
+{
+	m_fWrite = m_file.GetWrite();
+	m_bError = !m_fWrite.IsValid();
+	return !m_bError;
+}
+
+void FileSinkStage::AddOutput(char* pData, int offset, int length)
+{
+	if (m_bError)
+	{
+		return;
+	}
+	DWORD dwWrite = 0;
+	if (!::WriteFile(m_fWrite, pData + offset, length, &dwWrite, NULL) || static_cast<int>(dwWrite) != length)
+	{
+		LogEEx(PIPELINE, _T("Unable to write %s"), m_file.GetPath());
+		m_bError = true;
+		return;
+	}
+	ReceiverStage::AddOutput(pData, offset, length);
+}
+
+bool FileSinkStage::IsCancelled()
+{
+	return m_bError || ReceiverStage::IsCancelled();
+}
+
+bool FileSinkStage::HasError() const
+{
+	return m_bError;
+}
@@ -0,0 +1,199 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "CommonDefine.h"
+#include <memory>
+#include <regex>
+#include "../System/File.h"
+#include "../System/Inflate.h"
+#include "IShellOutputReceiver.h"
+#include "LineFramer.h"
+
+/**
+ * A receiver that hands its output on to the next one, so behaviours can be
+ * chained instead of written as one-off receivers. Output is lent, not
+ * copied: a stage passes on pointers into the buffer it was given or into
+ * its own, valid only for the duration of the AddOutput call. Stages run on
+ * the thread reading the socket, a slow stage holds up the next read so the
+ * connection pushes back on the device, and a stage that wants no more
+ * output reports IsCancelled, which ends the command.
+ * Any IShellOutputReceiver, such as a MultiLineReceiver, can end a chain.
+ */
+class ReceiverStage : public IShellOutputReceiver
+{
+protected:
+	IShellOutputReceiver* m_pNext;
+
+public:
+	explicit ReceiverStage(IShellOutputReceiver* next = NULL);
+	virtual ~ReceiverStage();
+
+	void SetNext(IShellOutputReceiver* next);
+
+	virtual void AddOutput(char* pData, int offset, int length) override;
+	virtual void Flush() override;
+	virtual bool IsCancelled() override;
+	virtual CancellationToken* GetCancellationToken() override;
+};
+
+/**
+ * Owns a chain of stages and is the receiver passed to the command, e.g.
+ *   ReceiverPipeline pipeline;
+ *   pipeline.Then(new GzipDecodeStage()).Then(new FilterStage("error")).Into(&lineReceiver);
+ */
+class ReceiverPipeline : public IShellOutputReceiver
+{
+private:
+	std::vector<std::unique_ptr<ReceiverStage>> m_vecStages;
+	IShellOutputReceiver* m_pHead;
+
+public:
+	ReceiverPipeline();
+
+	// appends a stage, the pipeline deletes it
+	ReceiverPipeline& Then(ReceiverStage* stage);
+	// ends the chain in a receiver the caller keeps owning
+	ReceiverPipeline& Into(IShellOutputReceiver* sink);
+
+	virtual void AddOutput(char* pData, int offset, int length) override;
+	virtual void Flush() override;
+	virtual bool IsCancelled() override;
+	virtual CancellationToken* GetCancellationToken() override;
+};
+
+// passes the output to a second receiver as well, until that one is cancelled
+class TeeStage : public ReceiverStage
+{
+private:
+	IShellOutputReceiver* m_pBranch;
+
+public:
+	explicit TeeStage(IShellOutputReceiver* branch, IShellOutputReceiver* next = NULL);
+
+	virtual void AddOutput(char* pData, int offset, int length) override;
+	virtual void Flush() override;
+	virtual bool IsCancelled() override;
+};
+
+// passes the output on one whole line per call, each ending in a single '\n'
+class LineStage : public ReceiverStage
+{
+private:
+	LineFramer m_framer;
+	std::string m_strLine;		// for lines that have to be copied to get their '\n'
+
+public:
+	explicit LineStage(IShellOutputReceiver* next = NULL);
+
+	virtual void AddOutput(char* pData, int offset, int length) override;
+	virtual void Flush() override;
+
+protected:
+	virtual bool AcceptLine(const char* data, int length);
+
+private:
+	void PassLines(const std::vector<LineView>& vecLines, const char* chunk, int length);
+};
+
+// like grep, passes on the lines that contain a text or match a regex
+class FilterStage : public LineStage
+{
+public:
+	enum Match
+	{
+		MATCH_SUBSTRING,
+		MATCH_REGEX,
+	};
+
+private:
+	const Match m_emMatch;
+	const bool m_bInvert;
+	std::string m_strPattern;
+	std::regex m_rxPattern;		// built once, not per line
+
+public:
+	FilterStage(const std::string& pattern, Match match = MATCH_SUBSTRING, bool invert = false,
+		IShellOutputReceiver* next = NULL);
+
+protected:
+	virtual bool AcceptLine(const char* data, int length) override;
+};
+
+/**
+ * Decodes gzip output, e.g. of `gzip -c` or a .gz file cat on the device,
+ * including several members in a row. Each member's CRC and size are
+ * checked, a damaged stream cancels the command.
+ */
+class GzipDecodeStage : public ReceiverStage, private Inflate::ISink
+{
+private:
+	enum State
+	{
+		GZIP_HEADER,
+		GZIP_BODY,
+		GZIP_TRAILER,
+		GZIP_END,			// a member ended, another may follow
+		GZIP_IGNORE,		// trailing bytes that are not gzip
+		GZIP_ERROR,
+	};
+
+	Inflate m_inflate;
+	State m_emState;
+	std::vector<BYTE> m_vecPending;		// header or trailer bytes read so far
+	UINT32 m_nCrc;
+	UINT32 m_nSize;
+	int m_nMembers;
+
+public:
+	explicit GzipDecodeStage(IShellOutputReceiver* next = NULL);
+
+	virtual void AddOutput(char* pData, int offset, int length) override;
+	virtual void Flush() override;
+	virtual bool IsCancelled() override;
+	bool HasError() const;
+
+private:
+	virtual bool OnInflated(const BYTE* data, size_t length) override;
+	void Consume(const BYTE* data, size_t length);
+	size_t ReadHeader(const BYTE* data, size_t length);
+	size_t ReadTrailer(const BYTE* data, size_t length);
+	size_t ReadNextMember(const BYTE* data, size_t length);
+	static int GetHeaderLength(const std::vector<BYTE>& header);
+	void Fail(const TString reason);
+};
+
+// writes the output to a local file, and passes it on if a next receiver is set
+class FileSinkStage : public ReceiverStage
+{
+private:
+	File m_file;
+	FileReadWrite m_fWrite;
+	bool m_bError;
+
+public:
+	explicit FileSinkStage(const TString path, IShellOutputReceiver* next = NULL);
+	~FileSinkStage();
+
+	// creates the file, must succeed before the command runs
+	bool Open();
+
+	virtual void AddOutput(char* pData, int offset, int length) override;
+	virtual bool IsCancelled() override;
+	bool HasError() const;
+};
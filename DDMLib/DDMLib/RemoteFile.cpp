@@ -0,0 +1,249 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "RemoteFile.h"
+#include <algorithm>
+#include <climits>
+#include "Device.h"
+#include "AndroidDebugBridge.h"
+#include "AdbHelper.h"
+#include "DdmPreferences.h"
+#include "DeviceScheduler.h"
+#include "Log.h"
+#include "StringUtils.h"
+
+#define REMOTE_FILE				_T("RemoteFile")
+#define MAX_READAHEAD_BLOCKS		16
+
+RemoteFile::RemoteFile(Device* device, const TString path, int blockSize, int cacheBlocks) :
+	m_pDevice(device), m_strPath(path), m_nBlockSize((std::max)(blockSize, 512)),
+	m_nCacheBlocks((std::max)(cacheBlocks, 2)), m_llSize(-1), m_llNextOffset(-1), m_nReadahead(0)
+{
+}
+
+bool RemoteFile::Open()
+{
+	std::tstring quotedPath;
+	StringUtils::QuoteShellArgument(m_strPath.c_str(), quotedPath);
+	std::tostringstream oss;
+	oss << _T("stat -c %s ") << quotedPath << _T(" 2>/dev/null || wc -c < ") << quotedPath << _T(" 2>/dev/null");
+
+	SizeReceiver receiver;
+	int nRet = m_pDevice->ExecuteShellCommand(oss.str().c_str(), &receiver, DdmPreferences::GetTimeOut());
+	m_llSize = nRet == 0 ? receiver.GetSize() : -1;
+	if (m_llSize < 0)
+	{
+		LogEEx(REMOTE_FILE, _T("Unable to get the size of %s"), m_strPath.c_str());
+		return false;
+	}
+	Invalidate();
+	return true;
+}
+
+long long RemoteFile::GetSize() const
+{
+	return m_llSize;
+}
+
+int RemoteFile::ReadAt(long long offset, char* buffer, int length)
+{
+	if (m_llSize < 0 || offset < 0 || length < 0)
+	{
+		return -1;
+	}
+	if (offset >= m_llSize || length == 0)
+	{
+		return 0;
+	}
+	length = static_cast<int>((std::min)(static_cast<long long>(length), m_llSize - offset));
+
+	// a read picking up where the last one ended doubles the readahead, any other resets it
+	if (offset == m_llNextOffset)
+	{
+		m_nReadahead = (std::min)((std::max)(m_nReadahead * 2, 1), MAX_READAHEAD_BLOCKS);
+	}
+	else
+	{
+		m_nReadahead = 0;
+	}
+	m_llNextOffset = offset + length;
+
+	const long long first = offset / m_nBlockSize;
+	const long long last = (offset + length - 1) / m_nBlockSize;
+	const long long lastInFile = (m_llSize - 1) / m_nBlockSize;
+	// half the cache, so one fetch never evicts blocks it is about to copy
+	const long long maxFetch = static_cast<long long>(m_nCacheBlocks / 2);
+
+	int copied = 0;
+	for (long long index = first; index <= last; index++)
+	{
+		const Block* block = FindBlock(index);
+		if (block == NULL)
+		{
+			// fetch the run of missing blocks starting here in one command
+			const long long end = (std::min)(last + m_nReadahead, lastInFile);
+			long long count = 1;
+			while (index + count <= end && count < maxFetch && m_mapBlocks.find(index + count) == m_mapBlocks.end())
+			{
+				count++;
+			}
+			if (!FetchBlocks(index, count))
+			{
+				return -1;
+			}
+			block = FindBlock(index);
+			if (block == NULL)
+			{
+				// the file shrank since Open
+				break;
+			}
+		}
+
+		const long long blockStart = index * m_nBlockSize;
+		const long long from = (std::max)(offset, blockStart) - blockStart;
+		const long long to = (std::min)(offset + length, blockStart + static_cast<long long>(block->vecData.size())) - blockStart;
+		if (to <= from)
+		{
+			break;
+		}
+		memcpy(buffer + copied, block->vecData.data() + from, static_cast<size_t>(to - from));
+		copied += static_cast<int>(to - from);
+		if (block->vecData.size() < static_cast<size_t>(m_nBlockSize))
+		{
+			break;
+		}
+	}
+	return copied;
+}
+
+void RemoteFile::Invalidate()
+{
+	m_lstBlocks.clear();
+	m_mapBlocks.clear();
+	m_llNextOffset = -1;
+	m_nReadahead = 0;
+}
+
+bool RemoteFile::FetchBlocks(long long first, long long count)
+{
+	std::tstring quotedPath;
+	StringUtils::QuoteShellArgument(m_strPath.c_str(), quotedPath);
+	std::tostringstream oss;
+	oss << _T("dd if=") << quotedPath << _T(" bs=") << m_nBlockSize << _T(" skip=") << first
+		<< _T(" count=") << count << _T(" 2>/dev/null");
+
+	std::vector<char> vecData;
+	vecData.reserve(static_cast<size_t>(count * m_nBlockSize));
+	BufferReceiver receiver(vecData);
+	// a reader is waiting on the block, cached reads do not need a slot
+	DeviceScheduler::Ticket ticket(m_pDevice->GetSerialNumber(), DeviceScheduler::PRIORITY_INTERACTIVE);
+	int nRet = AdbHelper::ExecuteRemoteCommand(AndroidDebugBridge::GetSocketAddress(), AdbHelper::EXEC,
+		oss.str().c_str(), m_pDevice, &receiver, DdmPreferences::GetTimeOut(), NULL);
+	if (nRet != 0)
+	{
+		LogEEx(REMOTE_FILE, _T("Unable to read %s at block %lld"), m_strPath.c_str(), first);
+		return false;
+	}
+
+	for (size_t pos = 0; pos < vecData.size(); pos += m_nBlockSize)
+	{
+		const int length = static_cast<int>((std::min)(vecData.size() - pos, static_cast<size_t>(m_nBlockSize)));
+		AddBlock(first++, vecData.data() + pos, length);
+	}
+	return true;
+}
+
+const RemoteFile::Block* RemoteFile::FindBlock(long long index)
+{
+	auto iter = m_mapBlocks.find(index);
+	if (iter == m_mapBlocks.end())
+	{
+		return NULL;
+	}
+	m_lstBlocks.splice(m_lstBlocks.begin(), m_lstBlocks, iter->second);
+	return &m_lstBlocks.front();
+}
+
+void RemoteFile::AddBlock(long long index, const char* data, int length)
+{
+	auto iter = m_mapBlocks.find(index);
+	if (iter != m_mapBlocks.end())
+	{
+		m_lstBlocks.erase(iter->second);
+		m_mapBlocks.erase(iter);
+	}
+	Block block;
+	block.llIndex = index;
+	block.vecData.assign(data, data + length);
+	m_lstBlocks.push_front(std::move(block));
+	m_mapBlocks[index] = m_lstBlocks.begin();
+
+	while (m_lstBlocks.size() > m_nCacheBlocks)
+	{
+		m_mapBlocks.erase(m_lstBlocks.back().llIndex);
+		m_lstBlocks.pop_back();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for BufferReceiver
+
+RemoteFile::BufferReceiver::BufferReceiver(std::vector<char>& vecData) : m_vecData(vecData)
+{
+}
+
+void RemoteFile::BufferReceiver::AddOutput(char* pData, int offset, int length)
+{
+	m_vecData.insert(m_vecData.end(), pData + offset, pData + offset + length);
+}
+
+void RemoteFile::BufferReceiver::Flush()
+{
+}
+
+bool RemoteFile::BufferReceiver::IsCancelled()
+{
+	return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for SizeReceiver
+
+RemoteFile::SizeReceiver::SizeReceiver() : m_llSize(-1)
+{
+}
+
+void RemoteFile::SizeReceiver::ProcessNewLines(const std::vector<std::string>& vecArray)
+{
+	for (const std::string& line : vecArray)
+	{
+		if (m_llSize < 0 && !line.empty() && isdigit(static_cast<unsigned char>(line[0])))
+		{
+			m_llSize = strtoll(line.c_str(), NULL, 10);
+		}
+	}
+}
+
+bool RemoteFile::SizeReceiver::IsCancelled()
+{
+	return false;
+}
+
+long long RemoteFile::SizeReceiver::GetSize() const
+{
+	return m_llSize;
+}
@@ -0,0 +1,103 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "CommonDefine.h"
+#include <list>
+#include "IShellOutputReceiver.h"
+#include "MultiLineReceiver.h"
+
+#define REMOTE_FILE_BLOCK_SIZE		64*1024
+#define REMOTE_FILE_CACHE_BLOCKS	64
+
+// define class
+class Device;
+
+/**
+ * Random access to a file on the device without pulling all of it, for
+ * peeking at a zip central directory, a database header or the tail of a
+ * log. Ranges are read with dd over exec:, the sync protocol has no
+ * ranged reads. Blocks are kept in an LRU cache, and reads that continue
+ * where the previous one stopped fetch a growing number of blocks ahead.
+ * Not thread safe, use one instance per reader.
+ */
+class RemoteFile
+{
+private:
+	struct Block
+	{
+		long long llIndex;
+		std::vector<char> vecData;	// shorter than a block only at the end of the file
+	};
+
+	class BufferReceiver : public IShellOutputReceiver
+	{
+	private:
+		std::vector<char>& m_vecData;
+	public:
+		explicit BufferReceiver(std::vector<char>& vecData);
+		virtual void AddOutput(char* pData, int offset, int length) override;
+		virtual void Flush() override;
+		virtual bool IsCancelled() override;
+	};
+
+	class SizeReceiver : public MultiLineReceiver
+	{
+	private:
+		long long m_llSize;
+	public:
+		SizeReceiver();
+		virtual void ProcessNewLines(const std::vector<std::string>& vecArray) override;
+		virtual bool IsCancelled() override;
+		long long GetSize() const;
+	};
+
+private:
+	Device* m_pDevice;
+	std::tstring m_strPath;
+	const int m_nBlockSize;
+	const size_t m_nCacheBlocks;
+	long long m_llSize;
+
+	std::list<Block> m_lstBlocks;	// most recently used first
+	std::map<long long, std::list<Block>::iterator> m_mapBlocks;
+	long long m_llNextOffset;		// where a sequential reader continues
+	int m_nReadahead;
+
+public:
+	RemoteFile(Device* device, const TString path, int blockSize = REMOTE_FILE_BLOCK_SIZE,
+		int cacheBlocks = REMOTE_FILE_CACHE_BLOCKS);
+
+	// reads the size of the file, must succeed before ReadAt
+	bool Open();
+	long long GetSize() const;
+
+	/**
+	 * Copies up to length bytes starting at offset.
+	 * @return the number of bytes copied, 0 past the end of the file, -1 on error
+	 */
+	int ReadAt(long long offset, char* buffer, int length);
+
+	// drops cached blocks, for a file that changed on the device
+	void Invalidate();
+
+private:
+	bool FetchBlocks(long long first, long long count);
+	const Block* FindBlock(long long index);
+	void AddBlock(long long index, const char* data, int length);
+};
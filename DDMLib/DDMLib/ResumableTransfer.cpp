@@ -0,0 +1,473 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ResumableTransfer.h"
+#include <algorithm>
+#include <climits>
+#include <thread>
+#include "Device.h"
+#include "AndroidDebugBridge.h"
+#include "AdbHelper.h"
+#include "DdmPreferences.h"
+#include "Log.h"
+#include "NullOutputReceiver.h"
+#include "StringUtils.h"
+#include "../System/File.h"
+#include "../System/FileDigest.h"
+#include "../System/StreamReader.h"
+
+#define RESUMABLE					_T("resume")
+
+#define PARTIAL_EXTENSION			_T(".partial")
+#define TRANSFER_BUFFER_SIZE		64*1024
+#define COMMAND_TIMEOUT_MS			10000
+#define DIGEST_TIMEOUT_MS			300000	// hashing a large file on the device is slow
+#define MAX_RETRY_COUNT			5
+#define RETRY_DELAY_MS				500
+#define MAX_RETRY_DELAY_MS			8000
+#define RETRY_POLL_MS				100
+#define COMMAND_OK					"ok"
+#define COMMAND_OK_SUFFIX			_T(" && echo ok")
+
+ResumableTransfer::ResumableTransfer(Device* device) : m_pDevice(device)
+{
+}
+
+bool ResumableTransfer::PushFile(const TString local, const TString remote,
+	SyncService::ISyncProgressMonitor* monitor)
+{
+	File file(local);
+	if (!file.IsFile())
+	{
+		LogEEx(RESUMABLE, _T("Unable to push %s: not a file"), local);
+		return false;
+	}
+	const long long total = file.GetLength64();
+
+	std::tstring partial(remote);
+	partial.append(PARTIAL_EXTENSION);
+	std::tstring quotedPartial;
+	std::tstring quotedRemote;
+	StringUtils::QuoteShellArgument(partial.c_str(), quotedPartial);
+	StringUtils::QuoteShellArgument(remote, quotedRemote);
+
+	ProgressTracker progress(monitor);
+	monitor->Start(static_cast<int>((std::min)(total, static_cast<long long>(INT_MAX))));
+
+	bool bRet = false;
+	long long committed = -1;	// bytes of the partial file known to match the local file
+	long long trusted = -1;		// length the partial file has after a clean stream
+	int failures = 0;
+	while (!monitor->IsCanceled())
+	{
+		long long length = 0;
+		if (!GetRemoteLength(quotedPartial, length))
+		{
+			if (!WaitBeforeRetry(++failures, monitor))
+			{
+				break;
+			}
+			continue;
+		}
+		length = (std::max)(length, 0LL);	// missing, head creates it
+		if (length == trusted)
+		{
+			committed = length;
+		}
+		else if (length != committed)
+		{
+			// left by an earlier run or a broken stream, only keep it if it is our prefix
+			bool match = length == 0;
+			if (length > 0 && length <= total && !ValidatePushPrefix(local, quotedPartial, length, match))
+			{
+				if (!WaitBeforeRetry(++failures, monitor))
+				{
+					break;
+				}
+				continue;
+			}
+			if (!match)
+			{
+				LogDEx(RESUMABLE, _T("Discarding %lld stale bytes of %s"), length, partial.c_str());
+				if (!RunCommand(_T("rm -f ") + quotedPartial))
+				{
+					if (!WaitBeforeRetry(++failures, monitor))
+					{
+						break;
+					}
+					continue;
+				}
+				length = 0;
+			}
+			else if (length > 0)
+			{
+				LogDEx(RESUMABLE, _T("Resuming upload of %s at %lld of %lld bytes"), local, length, total);
+			}
+			committed = length;
+		}
+		progress.SetPosition(committed);
+		if (committed == total)
+		{
+			bRet = true;
+			break;
+		}
+
+		FileReadWrite fRead = file.GetRead();
+		if (!fRead.IsValid() || !fRead.Seek(committed))
+		{
+			LogEEx(RESUMABLE, _T("Unable to read %s"), local);
+			fRead.Close();
+			fRead.Delete();
+			break;
+		}
+		CharStreamReader reader(fRead, TRANSFER_BUFFER_SIZE);
+		std::tostringstream oss;
+		oss << _T("head -c ") << (total - committed) << _T(" >> ") << quotedPartial;
+		int nRet = AdbHelper::ExecuteRemoteCommand(AndroidDebugBridge::GetSocketAddress(), AdbHelper::EXEC,
+			oss.str().c_str(), m_pDevice, &NullOutputReceiver::GetReceiver(), DdmPreferences::GetTimeOut(),
+			&reader, &progress);
+		fRead.Close();
+		fRead.Delete();
+		if (nRet == 0)
+		{
+			trusted = total;
+			failures = 0;
+		}
+		else
+		{
+			trusted = -1;
+			if (!WaitBeforeRetry(++failures, monitor))
+			{
+				break;
+			}
+		}
+	}
+
+	if (bRet)
+	{
+		bRet = RunCommand(_T("mv -f ") + quotedPartial + _T(" ") + quotedRemote);
+		if (!bRet)
+		{
+			LogEEx(RESUMABLE, _T("Unable to move %s into place"), partial.c_str());
+		}
+	}
+	monitor->Stop();
+	return bRet;
+}
+
+bool ResumableTransfer::PullFile(const TString remote, const TString local,
+	SyncService::ISyncProgressMonitor* monitor)
+{
+	std::tstring quotedRemote;
+	StringUtils::QuoteShellArgument(remote, quotedRemote);
+	long long total = -1;
+	if (!GetRemoteLength(quotedRemote, total) || total < 0)
+	{
+		LogEEx(RESUMABLE, _T("Unable to pull %s: remote file not found"), remote);
+		return false;
+	}
+
+	std::tstring partial(local);
+	partial.append(PARTIAL_EXTENSION);
+	File partialFile(partial.c_str());
+
+	ProgressTracker progress(monitor);
+	monitor->Start(static_cast<int>((std::min)(total, static_cast<long long>(INT_MAX))));
+
+	bool bRet = false;
+	long long committed = -1;	// bytes of the partial file known to match the remote file
+	int failures = 0;
+	while (!monitor->IsCanceled())
+	{
+		long long length = partialFile.Exists() ? partialFile.GetLength64() : 0;
+		if (length != committed)
+		{
+			// left by an earlier run, only keep it if it is a prefix of the remote file
+			bool match = length == 0;
+			if (length > 0 && length <= total && !ValidatePullPrefix(quotedRemote, partial.c_str(), length, match))
+			{
+				if (!WaitBeforeRetry(++failures, monitor))
+				{
+					break;
+				}
+				continue;
+			}
+			if (!match)
+			{
+				LogDEx(RESUMABLE, _T("Discarding %lld stale bytes of %s"), length, partial.c_str());
+				partialFile.Delete();
+				length = 0;
+			}
+			else if (length > 0)
+			{
+				LogDEx(RESUMABLE, _T("Resuming download of %s at %lld of %lld bytes"), remote, length, total);
+			}
+			committed = length;
+		}
+		progress.SetPosition(committed);
+		if (committed == total)
+		{
+			bRet = true;
+			break;
+		}
+
+		FileReadWrite fWrite = partialFile.GetAppend();
+		if (!fWrite.IsValid())
+		{
+			LogEEx(RESUMABLE, _T("Unable to write %s"), partial.c_str());
+			fWrite.Delete();
+			break;
+		}
+		FileAppendReceiver receiver(fWrite, &progress);
+		std::tostringstream oss;
+		// bounded, so a file still growing on the device cannot run past the size it was pulled at
+		oss << _T("dd if=") << quotedRemote << _T(" bs=") << TRANSFER_BUFFER_SIZE
+			<< _T(" skip=") << committed << _T(" count=") << total - committed
+			<< _T(" iflag=skip_bytes,count_bytes 2>/dev/null");
+		int nRet = AdbHelper::ExecuteRemoteCommand(AndroidDebugBridge::GetSocketAddress(), AdbHelper::EXEC,
+			oss.str().c_str(), m_pDevice, &receiver, DdmPreferences::GetTimeOut(), NULL);
+		fWrite.Close();
+		fWrite.Delete();
+		if (receiver.HasError())
+		{
+			LogEEx(RESUMABLE, _T("Unable to write %s"), partial.c_str());
+			break;
+		}
+		if (nRet != 0)
+		{
+			// what arrived before the failure is still a valid prefix
+			LogDEx(RESUMABLE, _T("Reading %s failed after %lld bytes"), remote, receiver.GetWritten());
+		}
+
+		// our own appends, in order, so they need no validation
+		committed += receiver.GetWritten();
+		if (committed > total)
+		{
+			LogEEx(RESUMABLE, _T("Unable to pull %s: more data than the %lld bytes stat reported"), remote, total);
+			break;
+		}
+		if (receiver.GetWritten() > 0)
+		{
+			failures = 0;
+		}
+		if (committed != total && !WaitBeforeRetry(++failures, monitor))
+		{
+			break;
+		}
+	}
+
+	if (bRet)
+	{
+		bRet = partialFile.MoveTo(local) != FALSE;
+		if (!bRet)
+		{
+			LogEEx(RESUMABLE, _T("Unable to move %s into place"), partial.c_str());
+		}
+	}
+	monitor->Stop();
+	return bRet;
+}
+
+bool ResumableTransfer::ValidatePushPrefix(const TString local, const std::tstring& quotedPartial,
+	long long length, bool& match)
+{
+	std::string remoteDigest;
+	if (!RunForToken(_T("sha256sum ") + quotedPartial, DIGEST_TIMEOUT_MS, remoteDigest))
+	{
+		return false;
+	}
+	std::string localDigest;
+	match = FileDigest::Sha256(local, length, localDigest) && localDigest == remoteDigest;
+	return true;
+}
+
+bool ResumableTransfer::ValidatePullPrefix(const std::tstring& quotedRemote, const TString localPartial,
+	long long length, bool& match)
+{
+	std::tostringstream oss;
+	oss << _T("head -c ") << length << _T(" ") << quotedRemote << _T(" | sha256sum");
+	std::string remoteDigest;
+	if (!RunForToken(oss.str(), DIGEST_TIMEOUT_MS, remoteDigest))
+	{
+		return false;
+	}
+	std::string localDigest;
+	match = FileDigest::Sha256(localPartial, localDigest) && localDigest == remoteDigest;
+	return true;
+}
+
+bool ResumableTransfer::GetRemoteLength(const std::tstring& quotedPath, long long& length)
+{
+	std::string token;
+	if (!RunForToken(_T("stat -c %s ") + quotedPath + _T(" 2>/dev/null || echo -1"), COMMAND_TIMEOUT_MS, token))
+	{
+		return false;
+	}
+	char* end = NULL;
+	length = strtoll(token.c_str(), &end, 10);
+	return end != token.c_str() && *end == '\0';
+}
+
+bool ResumableTransfer::RunForToken(const std::tstring& command, long timeOut, std::string& token)
+{
+	// every command we run prints something, no output means the device went away
+	FirstTokenReceiver receiver;
+	if (m_pDevice->ExecuteShellCommand(command.c_str(), &receiver, timeOut) != 0)
+	{
+		return false;
+	}
+	token = receiver.GetToken();
+	return !token.empty();
+}
+
+bool ResumableTransfer::RunCommand(const std::tstring& command)
+{
+	std::string token;
+	return RunForToken(command + COMMAND_OK_SUFFIX, COMMAND_TIMEOUT_MS, token) && token == COMMAND_OK;
+}
+
+bool ResumableTransfer::WaitBeforeRetry(int failures, SyncService::ISyncProgressMonitor* monitor)
+{
+	if (failures > MAX_RETRY_COUNT)
+	{
+		LogE(RESUMABLE, _T("Giving up after repeated transfer failures"));
+		return false;
+	}
+	int delay = (std::min)(RETRY_DELAY_MS << (failures - 1), MAX_RETRY_DELAY_MS);
+	LogDEx(RESUMABLE, _T("Transfer interrupted, retrying in %d ms"), delay);
+	for (; delay > 0; delay -= RETRY_POLL_MS)
+	{
+		if (monitor->IsCanceled())
+		{
+			return false;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(RETRY_POLL_MS));
+	}
+	return !monitor->IsCanceled();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for ProgressTracker
+
+ResumableTransfer::ProgressTracker::ProgressTracker(SyncService::ISyncProgressMonitor* monitor) :
+	m_pMonitor(monitor), m_llPosition(0), m_llReported(0)
+{
+}
+
+void ResumableTransfer::ProgressTracker::SetPosition(long long position)
+{
+	// bytes resent after a failure were already reported once
+	m_llPosition = position;
+	if (m_llPosition > m_llReported)
+	{
+		m_pMonitor->Advance(static_cast<int>(m_llPosition - m_llReported));
+		m_llReported = m_llPosition;
+	}
+}
+
+void ResumableTransfer::ProgressTracker::Start(int totalWork)
+{
+}
+
+void ResumableTransfer::ProgressTracker::Stop()
+{
+}
+
+bool ResumableTransfer::ProgressTracker::IsCanceled()
+{
+	return m_pMonitor->IsCanceled();
+}
+
+void ResumableTransfer::ProgressTracker::StartSubTask(const TString name)
+{
+}
+
+void ResumableTransfer::ProgressTracker::Advance(int work)
+{
+	SetPosition(m_llPosition + work);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for FileAppendReceiver
+
+ResumableTransfer::FileAppendReceiver::FileAppendReceiver(FileReadWrite fWrite, ProgressTracker* progress) :
+	m_fWrite(fWrite), m_pProgress(progress), m_llWritten(0), m_bError(false)
+{
+}
+
+void ResumableTransfer::FileAppendReceiver::AddOutput(char* pData, int offset, int length)
+{
+	if (m_bError)
+	{
+		return;
+	}
+	DWORD dwWrite = 0;
+	if (!::WriteFile(m_fWrite, pData + offset, length, &dwWrite, NULL) ||
+		dwWrite != static_cast<DWORD>(length))
+	{
+		m_bError = true;
+		return;
+	}
+	m_llWritten += length;
+	m_pProgress->Advance(length);
+}
+
+void ResumableTransfer::FileAppendReceiver::Flush()
+{
+}
+
+bool ResumableTransfer::FileAppendReceiver::IsCancelled()
+{
+	return m_bError || m_pProgress->IsCanceled();
+}
+
+long long ResumableTransfer::FileAppendReceiver::GetWritten() const
+{
+	return m_llWritten;
+}
+
+bool ResumableTransfer::FileAppendReceiver::HasError() const
+{
+	return m_bError;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for FirstTokenReceiver
+
+void ResumableTransfer::FirstTokenReceiver::ProcessNewLines(const std::vector<std::string>& vecArray)
+{
+	for (const std::string& line : vecArray)
+	{
+		if (!m_strToken.empty())
+		{
+			break;
+		}
+		std::istringstream iss(line);
+		iss >> m_strToken;
+	}
+}
+
+bool ResumableTransfer::FirstTokenReceiver::IsCancelled()
+{
+	return false;
+}
+
+const std::string& ResumableTransfer::FirstTokenReceiver::GetToken() const
+{
+	return m_strToken;
+}
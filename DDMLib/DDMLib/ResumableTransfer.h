@@ -0,0 +1,96 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonDefine.h"
+#include "SyncService.h"
+#include "MultiLineReceiver.h"
+
+// define class
+class Device;
+
+/**
+ * Push and pull through a ".partial" file that survives a dropped
+ * connection, so a retried transfer continues from the bytes already
+ * committed instead of starting over. The sync protocol cannot seek and
+ * adbd unlinks the target of a failed SEND, so the data goes over exec:
+ * streams with shell tools doing the seeking on the device.
+ */
+class ResumableTransfer
+{
+private:
+	class ProgressTracker : public SyncService::ISyncProgressMonitor
+	{
+	private:
+		SyncService::ISyncProgressMonitor* m_pMonitor;
+		long long m_llPosition;
+		long long m_llReported;
+	public:
+		explicit ProgressTracker(SyncService::ISyncProgressMonitor* monitor);
+		void SetPosition(long long position);
+		virtual void Start(int totalWork) override;
+		virtual void Stop() override;
+		virtual bool IsCanceled() override;
+		virtual void StartSubTask(const TString name) override;
+		virtual void Advance(int work) override;
+	};
+
+	class FileAppendReceiver : public IShellOutputReceiver
+	{
+	private:
+		FileReadWrite m_fWrite;
+		ProgressTracker* m_pProgress;
+		long long m_llWritten;
+		bool m_bError;
+	public:
+		FileAppendReceiver(FileReadWrite fWrite, ProgressTracker* progress);
+		virtual void AddOutput(char* pData, int offset, int length) override;
+		virtual void Flush() override;
+		virtual bool IsCancelled() override;
+		long long GetWritten() const;
+		bool HasError() const;
+	};
+
+	class FirstTokenReceiver : public MultiLineReceiver
+	{
+	private:
+		std::string m_strToken;
+	public:
+		virtual void ProcessNewLines(const std::vector<std::string>& vecArray) override;
+		virtual bool IsCancelled() override;
+		const std::string& GetToken() const;
+	};
+
+private:
+	Device* m_pDevice;
+
+public:
+	explicit ResumableTransfer(Device* device);
+
+	bool PushFile(const TString local, const TString remote, SyncService::ISyncProgressMonitor* monitor);
+	bool PullFile(const TString remote, const TString local, SyncService::ISyncProgressMonitor* monitor);
+
+private:
+	bool ValidatePushPrefix(const TString local, const std::tstring& quotedPartial, long long length, bool& match);
+	bool ValidatePullPrefix(const std::tstring& quotedRemote, const TString localPartial, long long length, bool& match);
+	bool GetRemoteLength(const std::tstring& quotedPath, long long& length);
+	bool RunForToken(const std::tstring& command, long timeOut, std::string& token);
+	bool RunCommand(const std::tstring& command);
+	static bool WaitBeforeRetry(int failures, SyncService::ISyncProgressMonitor* monitor);
+};
@@ -0,0 +1,311 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ShellProtocol.h"
+#include <algorithm>
+#include "AdbHelper.h"
+#include "ArrayHelper.h"
+#include "CancellationToken.h"
+#include "DdmPreferences.h"
+#include "IDevice.h"
+#include "Log.h"
+#include "StringUtils.h"
+#include "TransferScheduler.h"
+
+#define SHELL					_T("shell")
+#define PACKET_HEADER_LENGTH	5
+#define PACKET_MAX_LENGTH		4096 // the buffer adbd reads a packet into, header included
+
+ShellProtocol::ShellProtocol() : m_pClient(NULL), m_nExitCode(SHELL_EXIT_UNKNOWN),
+	m_nHeaderLength(0), m_nPayloadLeft(0)
+{
+	ZeroMemory(m_arrHeader, sizeof(m_arrHeader));
+}
+
+ShellProtocol::~ShellProtocol()
+{
+	Close();
+}
+
+bool ShellProtocol::Open(const SocketAddress& adbSockAddr, IDevice* device, const TString command, bool usePty)
+{
+	Close();
+	m_nExitCode = SHELL_EXIT_UNKNOWN;
+	m_nHeaderLength = 0;
+	m_nPayloadLeft = 0;
+
+	m_pClient = SocketClient::Open(adbSockAddr);
+	if (m_pClient == NULL)
+	{
+		return false;
+	}
+	m_pClient->ConfigureBlocking(false);
+	m_strSerialNumber = device->GetSerialNumber();
+
+	if (!AdbHelper::SetDevice(m_pClient, device))
+	{
+		Close();
+		return false;
+	}
+
+	const char* szCommand = NULL;
+#ifdef _UNICODE
+	std::string strCmd;
+	ConvertUtils::WstringToString(command, strCmd);
+	szCommand = strCmd.c_str();
+#else
+	szCommand = command;
+#endif
+	std::ostringstream oss;
+	oss << (usePty ? "shell,v2,pty:" : "shell,v2,raw:") << szCommand;
+	std::unique_ptr<const char[]> request(AdbHelper::FormAdbRequest(oss.str().c_str()));
+	if (!AdbHelper::Write(m_pClient, request.get()))
+	{
+		Close();
+		return false;
+	}
+
+	std::unique_ptr<AdbHelper::AdbResponse> resp(AdbHelper::ReadAdbResponse(m_pClient, false /* readDiagString */));
+	if (!resp || !resp->okay)
+	{
+		LogEEx(SHELL, _T("ADB rejected shell v2 command (%s)"), command);
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void ShellProtocol::Close()
+{
+	std::lock_guard<std::mutex> lock(m_lockWrite);
+	if (m_pClient != NULL)
+	{
+		m_pClient->Close();
+		delete m_pClient;
+		m_pClient = NULL;
+	}
+}
+
+int ShellProtocol::Read(IShellOutputReceiver* stdoutRcvr, IShellOutputReceiver* stderrRcvr,
+	long maxTimeToOutputResponse)
+{
+	if (m_pClient == NULL)
+	{
+		return -1;
+	}
+
+	CancellationToken::Scope cancelScope(stdoutRcvr != NULL ? stdoutRcvr->GetCancellationToken() : NULL,
+		m_pClient, CancellationToken::PHASE_OUTPUT);
+	// the socket blocks, a silent command would otherwise hold the read forever
+	m_pClient->SetTimeout(static_cast<int>(maxTimeToOutputResponse));
+	const int bufferLen = 16384;
+	char data[bufferLen];
+	while (true)
+	{
+		if (stdoutRcvr != NULL && stdoutRcvr->IsCancelled())
+		{
+			LogV(SHELL, _T("read: cancelled"));
+			return -1;
+		}
+
+		int count = m_pClient->Read(data, bufferLen);
+		if (count < 0)
+		{
+			int err = AdbHelper::GetLastError();
+			if (err == WSAECANCELLED)
+			{
+				LogV(SHELL, _T("read: cancelled"));
+				return -1;
+			}
+			if (err == WSAETIMEDOUT)
+			{
+				LogD(SHELL, _T("read: timeout"));
+				return -1;
+			}
+			LogDEx(SHELL, _T("read: channel error %d"), err);
+			return -1;
+		}
+		else if (count == 0)
+		{
+			// adbd closes the stream right after the exit packet, so this is a lost connection
+			LogD(SHELL, _T("read: closed before the exit status"));
+			break;
+		}
+		else
+		{
+			TransferScheduler::GetInstance().Charge(m_strSerialNumber.c_str(), count);
+			int nFed = Feed(data, count, stdoutRcvr, stderrRcvr);
+			if (nFed < 0)
+			{
+				LogE(SHELL, _T("read: malformed shell v2 packet"));
+				return -1;
+			}
+			if (nFed > 0)
+			{
+				break;
+			}
+		}
+	}
+
+	if (stdoutRcvr != NULL)
+	{
+		stdoutRcvr->Flush();
+	}
+	if (stderrRcvr != NULL)
+	{
+		stderrRcvr->Flush();
+	}
+	return m_nExitCode == SHELL_EXIT_UNKNOWN ? -1 : 0;
+}
+
+int ShellProtocol::GetExitCode() const
+{
+	return m_nExitCode;
+}
+
+bool ShellProtocol::WriteStdin(const char* data, int length)
+{
+	const int maxPayload = PACKET_MAX_LENGTH - PACKET_HEADER_LENGTH;
+	for (int offset = 0; offset < length; offset += maxPayload)
+	{
+		if (!WritePacket(ID_STDIN, data + offset, (std::min)(length - offset, maxPayload)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ShellProtocol::CloseStdin()
+{
+	return WritePacket(ID_CLOSE_STDIN, NULL, 0);
+}
+
+bool ShellProtocol::SetWindowSize(int rows, int cols, int xPixels, int yPixels)
+{
+	// adbd parses the new size as text, rows x cols then the pixel size
+	std::ostringstream oss;
+	oss << rows << "x" << cols << "," << xPixels << "x" << yPixels;
+	const std::string& size = oss.str();
+	return WritePacket(ID_WINDOW_SIZE_CHANGE, size.c_str(), static_cast<int>(size.length()));
+}
+
+int ShellProtocol::Execute(const SocketAddress& adbSockAddr, const TString command, IDevice* device,
+	IShellOutputReceiver* stdoutRcvr, IShellOutputReceiver* stderrRcvr, long maxTimeToOutputResponse,
+	int* exitCode)
+{
+	LogVEx(SHELL, _T("execute: running %s"), command);
+
+	ShellProtocol shell;
+	if (!shell.Open(adbSockAddr, device, command))
+	{
+		return -1;
+	}
+	// nothing is sent on stdin, let commands that read it see the end at once
+	shell.CloseStdin();
+	int nRet = shell.Read(stdoutRcvr, stderrRcvr, maxTimeToOutputResponse);
+	if (exitCode != NULL)
+	{
+		*exitCode = shell.GetExitCode();
+	}
+	LogVEx(SHELL, _T("execute '%s' on '%s' : exit status %d"), command, device->GetSerialNumber(),
+		shell.GetExitCode());
+	return nRet;
+}
+
+bool ShellProtocol::WritePacket(PacketId id, const char* data, int length)
+{
+	char packet[PACKET_MAX_LENGTH];
+	packet[0] = static_cast<char>(id);
+	ArrayHelper::Swap32bitsToArray(length, packet, 1);
+	if (length > 0)
+	{
+		memcpy(packet + PACKET_HEADER_LENGTH, data, length);
+	}
+
+	std::lock_guard<std::mutex> lock(m_lockWrite);
+	if (m_pClient == NULL)
+	{
+		return false;
+	}
+	return AdbHelper::Write(m_pClient, packet, PACKET_HEADER_LENGTH + length, DdmPreferences::GetTimeOut());
+}
+
+int ShellProtocol::Feed(char* data, int length, IShellOutputReceiver* stdoutRcvr,
+	IShellOutputReceiver* stderrRcvr)
+{
+	int offset = 0;
+	while (offset < length)
+	{
+		if (m_nHeaderLength < PACKET_HEADER_LENGTH)
+		{
+			int count = (std::min)(PACKET_HEADER_LENGTH - m_nHeaderLength, length - offset);
+			memcpy(m_arrHeader + m_nHeaderLength, data + offset, count);
+			m_nHeaderLength += count;
+			offset += count;
+			if (m_nHeaderLength < PACKET_HEADER_LENGTH)
+			{
+				break;
+			}
+			m_nPayloadLeft = ArrayHelper::Swap32bitFromArray(m_arrHeader, 1);
+			if (m_nPayloadLeft < 0)
+			{
+				return -1;
+			}
+			if (m_nPayloadLeft == 0)
+			{
+				m_nHeaderLength = 0;
+			}
+			continue;
+		}
+
+		// payloads are handed on as they come instead of waiting for the whole packet
+		int count = (std::min)(m_nPayloadLeft, length - offset);
+		switch (static_cast<unsigned char>(m_arrHeader[0]))
+		{
+		case ID_STDOUT:
+			if (stdoutRcvr != NULL)
+			{
+				stdoutRcvr->AddOutput(data, offset, count);
+			}
+			break;
+		case ID_STDERR:
+			if (stderrRcvr != NULL)
+			{
+				stderrRcvr->AddOutput(data, offset, count);
+			}
+			break;
+		case ID_EXIT:
+			m_nExitCode = static_cast<unsigned char>(data[offset]);
+			break;
+		default:
+			LogDEx(SHELL, _T("read: skipping packet id %d"), static_cast<int>(m_arrHeader[0]));
+			break;
+		}
+		offset += count;
+		m_nPayloadLeft -= count;
+		if (m_nPayloadLeft == 0)
+		{
+			m_nHeaderLength = 0;
+			if (static_cast<unsigned char>(m_arrHeader[0]) == ID_EXIT)
+			{
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,102 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "CommonDefine.h"
+#include <mutex>
+#include "../System/SocketClient.h"
+#include "IShellOutputReceiver.h"
+
+#define FEATURE_SHELL_V2		"shell_v2"
+#define SHELL_EXIT_UNKNOWN		-1	// the legacy shell: service does not report an exit status
+
+// define class
+class IDevice;
+
+/**
+ * Client side of the framed "shell,v2" service. Every packet is an id
+ * byte, a little-endian payload length and the payload, so stdout and
+ * stderr arrive apart and the exit status comes last in its own packet.
+ * Only usable when the device reports the shell_v2 feature.
+ *
+ * For interactive use one thread runs Read while others send stdin and
+ * window size packets; the writes are serialized internally. Close only
+ * after Read has returned.
+ */
+class ShellProtocol
+{
+public:
+	enum PacketId
+	{
+		ID_STDIN = 0,
+		ID_STDOUT = 1,
+		ID_STDERR = 2,
+		ID_EXIT = 3,
+		ID_CLOSE_STDIN = 4,
+		ID_WINDOW_SIZE_CHANGE = 5,
+	};
+
+private:
+	SocketClient* m_pClient;
+	std::tstring m_strSerialNumber;
+	std::mutex m_lockWrite;
+	int m_nExitCode;
+
+	// packet parser state, a packet may be split across any number of reads
+	char m_arrHeader[5];
+	int m_nHeaderLength;
+	int m_nPayloadLeft;
+
+public:
+	ShellProtocol();
+	~ShellProtocol();
+
+	/**
+	 * Starts command on the device.
+	 * @param usePty true for a terminal session, false for raw byte streams
+	 */
+	bool Open(const SocketAddress& adbSockAddr, IDevice* device, const TString command, bool usePty = false);
+	void Close();
+
+	/**
+	 * Reads packets until the exit status arrives, the output stops for
+	 * longer than maxTimeToOutputResponse (0 waits forever) or stdoutRcvr
+	 * is cancelled. stderrRcvr may be NULL to drop stderr.
+	 * @return 0 once the exit status is known, -1 otherwise
+	 */
+	int Read(IShellOutputReceiver* stdoutRcvr, IShellOutputReceiver* stderrRcvr, long maxTimeToOutputResponse);
+	int GetExitCode() const;
+
+	bool WriteStdin(const char* data, int length);
+	bool CloseStdin();
+	bool SetWindowSize(int rows, int cols, int xPixels = 0, int yPixels = 0);
+
+	/**
+	 * Runs command to completion, the shell_v2 counterpart of
+	 * AdbHelper::ExecuteRemoteCommand.
+	 * @return 0 on success with the status in exitCode, -1 on error
+	 */
+	static int Execute(const SocketAddress& adbSockAddr, const TString command, IDevice* device,
+		IShellOutputReceiver* stdoutRcvr, IShellOutputReceiver* stderrRcvr, long maxTimeToOutputResponse,
+		int* exitCode);
+
+private:
+	bool WritePacket(PacketId id, const char* data, int length);
+	// @return 1 once the exit packet is complete, -1 on a malformed packet, 0 otherwise
+	int Feed(char* data, int length, IShellOutputReceiver* stdoutRcvr, IShellOutputReceiver* stderrRcvr);
+};
@@ -0,0 +1,523 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ShellSessionPool.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+#include "Device.h"
+#include "AndroidDebugBridge.h"
+#include "AdbHelper.h"
+#include "CancellationToken.h"
+#include "DdmPreferences.h"
+#include "Log.h"
+#include "NullOutputReceiver.h"
+#include "ShellProtocol.h"
+#include "StringUtils.h"
+#include "TransferScheduler.h"
+
+#define SHELL_SESSION				_T("shell-session")
+
+#define SESSION_IDLE_TIMEOUT_MS		30000	// idle sessions are closed after this
+#define SESSION_POLL_MS				100		// blocked reads return this often to check for timeout and cancel
+#define SESSION_REAP_INTERVAL_MS	5000	// the reaper looks for idle sessions this often
+#define SESSION_SENTINEL_PREFIX		":ddmlib-"
+
+ShellSessionPool ShellSessionPool::s_instance;
+
+ShellSessionPool::ShellSessionPool()
+{
+}
+
+ShellSessionPool::~ShellSessionPool()
+{
+	StopReaper();
+}
+
+ShellSessionPool& ShellSessionPool::GetInstance()
+{
+	return s_instance;
+}
+
+int ShellSessionPool::Execute(Device* device, const TString command, IShellOutputReceiver* rcvr,
+	long maxTimeToOutputResponse, int* exitCode)
+{
+	std::vector<std::tstring> vecCommands(1, command);
+	std::vector<IShellOutputReceiver*> vecRcvrs(1, rcvr);
+	std::vector<int> vecExitCodes;
+	int nRet = ExecuteBatch(device, vecCommands, vecRcvrs, maxTimeToOutputResponse, &vecExitCodes);
+	if (exitCode != NULL)
+	{
+		*exitCode = vecExitCodes.empty() ? SHELL_EXIT_UNKNOWN : vecExitCodes[0];
+	}
+	return nRet;
+}
+
+int ShellSessionPool::ExecuteBatch(Device* device, const std::vector<std::tstring>& commands,
+	const std::vector<IShellOutputReceiver*>& rcvrs, long maxTimeToOutputResponse, std::vector<int>* exitCodes)
+{
+	if (exitCodes != NULL)
+	{
+		exitCodes->assign(commands.size(), SHELL_EXIT_UNKNOWN);
+	}
+
+	std::shared_ptr<DevicePool> pPool = GetPool(device->GetSerialNumber());
+	Session* pSession = Acquire(*pPool, device);
+	std::vector<std::string> vecSentinels;
+	bool bOneShot = pSession == NULL;
+	if (pSession != NULL && !pSession->Send(commands, vecSentinels))
+	{
+		// nothing reached the shell, the commands can safely run again
+		Release(*pPool, pSession, true);
+		pSession = NULL;
+		bOneShot = true;
+	}
+
+	for (size_t i = 0; i < commands.size() && pSession != NULL; i++)
+	{
+		const bool bReused = pSession->IsUsed();
+		bool bOutputSeen = false;
+		int nExitCode = SHELL_EXIT_UNKNOWN;
+		if (pSession->ReadResult(vecSentinels[i], rcvrs[i], maxTimeToOutputResponse, &nExitCode, &bOutputSeen) == 0)
+		{
+			if (exitCodes != NULL)
+			{
+				(*exitCodes)[i] = nExitCode;
+			}
+			continue;
+		}
+
+		Release(*pPool, pSession, true);
+		pSession = NULL;
+		if (i == 0 && bReused && !bOutputSeen && (rcvrs[i] == NULL || !rcvrs[i]->IsCancelled()))
+		{
+			// an idle session died under us before the batch started
+			LogVEx(SHELL_SESSION, _T("Dropping stale shell session to '%s'"), device->GetSerialNumber());
+			bOneShot = true;
+		}
+		else
+		{
+			return -1;
+		}
+	}
+
+	if (!bOneShot)
+	{
+		Release(*pPool, pSession, false);
+		return 0;
+	}
+
+	int nRet = 0;
+	for (size_t i = 0; i < commands.size(); i++)
+	{
+		int nExitCode = SHELL_EXIT_UNKNOWN;
+		if (ExecuteOneShot(device, commands[i].c_str(), rcvrs[i], maxTimeToOutputResponse, &nExitCode) != 0)
+		{
+			nRet = -1;
+		}
+		if (exitCodes != NULL)
+		{
+			(*exitCodes)[i] = nExitCode;
+		}
+	}
+	return nRet;
+}
+
+void ShellSessionPool::CloseSessions(const TString serialNumber)
+{
+	std::shared_ptr<DevicePool> pPool;
+	{
+		std::unique_lock<std::mutex> lock(m_lockPools);
+		auto iter = m_mapPools.find(serialNumber);
+		if (iter == m_mapPools.end())
+		{
+			return;
+		}
+		pPool = iter->second;
+	}
+	// sessions in use are dropped as their users finish with them
+	std::unique_lock<std::mutex> lock(pPool->lock);
+	CloseIdle(*pPool, LLONG_MAX);
+}
+
+void ShellSessionPool::CloseAll()
+{
+	StopReaper();
+	std::vector<std::shared_ptr<DevicePool>> vecPools;
+	{
+		std::unique_lock<std::mutex> lock(m_lockPools);
+		for (auto iter = m_mapPools.begin(); iter != m_mapPools.end(); ++iter)
+		{
+			vecPools.push_back(iter->second);
+		}
+	}
+	for (const std::shared_ptr<DevicePool>& pPool : vecPools)
+	{
+		std::unique_lock<std::mutex> lock(pPool->lock);
+		CloseIdle(*pPool, LLONG_MAX);
+	}
+}
+
+std::shared_ptr<ShellSessionPool::DevicePool> ShellSessionPool::GetPool(const TString serialNumber)
+{
+	std::shared_ptr<DevicePool> pPool;
+	{
+		std::unique_lock<std::mutex> lock(m_lockPools);
+		std::shared_ptr<DevicePool>& pEntry = m_mapPools[serialNumber];
+		if (!pEntry)
+		{
+			pEntry = std::make_shared<DevicePool>();
+		}
+		pPool = pEntry;
+	}
+	StartReaper();
+	return pPool;
+}
+
+void ShellSessionPool::StartReaper()
+{
+	std::unique_lock<std::mutex> lock(m_lockReaper);
+	if (m_threadReaper.joinable())
+	{
+		return;
+	}
+	m_threadReaper = std::thread(&ShellSessionPool::ReapLoop, this, m_nReaperRun);
+}
+
+void ShellSessionPool::StopReaper()
+{
+	std::thread thread;
+	{
+		std::unique_lock<std::mutex> lock(m_lockReaper);
+		if (!m_threadReaper.joinable())
+		{
+			return;
+		}
+		m_nReaperRun++;
+		thread = std::move(m_threadReaper);
+		m_cvReaper.notify_all();
+	}
+	thread.join();
+}
+
+void ShellSessionPool::ReapLoop(unsigned int run)
+{
+	std::unique_lock<std::mutex> lock(m_lockReaper);
+	while (true)
+	{
+		m_cvReaper.wait_for(lock, std::chrono::milliseconds(SESSION_REAP_INTERVAL_MS));
+		if (run != m_nReaperRun)
+		{
+			return;
+		}
+		lock.unlock();
+
+		std::vector<std::shared_ptr<DevicePool>> vecPools;
+		{
+			std::unique_lock<std::mutex> lockPools(m_lockPools);
+			for (auto iter = m_mapPools.begin(); iter != m_mapPools.end(); ++iter)
+			{
+				vecPools.push_back(iter->second);
+			}
+		}
+		for (const std::shared_ptr<DevicePool>& pPool : vecPools)
+		{
+			std::unique_lock<std::mutex> lockPool(pPool->lock);
+			CloseIdle(*pPool, NowMillis() - SESSION_IDLE_TIMEOUT_MS);
+		}
+		lock.lock();
+	}
+}
+
+ShellSessionPool::Session* ShellSessionPool::Acquire(DevicePool& pool, Device* device)
+{
+	{
+		std::unique_lock<std::mutex> lock(pool.lock);
+		CloseIdle(pool, NowMillis() - SESSION_IDLE_TIMEOUT_MS);
+		if (!pool.vecIdle.empty())
+		{
+			Session* pSession = pool.vecIdle.back();
+			pool.vecIdle.pop_back();
+			return pSession;
+		}
+		// long running commands keep their session, others go one-shot rather than wait
+		if (pool.nOpen >= (std::max)(DdmPreferences::GetShellSessionLimit(), 1))
+		{
+			return NULL;
+		}
+		pool.nOpen++;
+	}
+
+	Session* pSession = new Session();
+	if (pSession->Open(device))
+	{
+		LogVEx(SHELL_SESSION, _T("Opened shell session to '%s'"), device->GetSerialNumber());
+		return pSession;
+	}
+	delete pSession;
+	std::unique_lock<std::mutex> lock(pool.lock);
+	pool.nOpen--;
+	return NULL;
+}
+
+void ShellSessionPool::Release(DevicePool& pool, Session* session, bool failed)
+{
+	// a failed command may leave output or a running process behind, never reuse it
+	std::unique_lock<std::mutex> lock(pool.lock);
+	if (failed)
+	{
+		delete session;
+		pool.nOpen--;
+	}
+	else
+	{
+		pool.vecIdle.push_back(session);
+	}
+}
+
+int ShellSessionPool::ExecuteOneShot(Device* device, const TString command, IShellOutputReceiver* rcvr,
+	long maxTimeToOutputResponse, int* exitCode)
+{
+	// stderr is merged into the same receiver, as the shell: service does
+	return device->ExecuteShellCommand(command, rcvr, rcvr, exitCode, maxTimeToOutputResponse);
+}
+
+void ShellSessionPool::CloseIdle(DevicePool& pool, long long llIdleBefore)
+{
+	// lock pool outside
+	for (auto iter = pool.vecIdle.begin(); iter != pool.vecIdle.end(); )
+	{
+		if ((*iter)->GetLastUsed() < llIdleBefore)
+		{
+			delete *iter;
+			pool.nOpen--;
+			iter = pool.vecIdle.erase(iter);
+		}
+		else
+		{
+			++iter;
+		}
+	}
+}
+
+long long ShellSessionPool::NowMillis()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for Session
+
+ShellSessionPool::Session::Session() : m_pClient(NULL), m_nSequence(0), m_bUsed(false), m_llLastUsed(0)
+{
+}
+
+ShellSessionPool::Session::~Session()
+{
+	Close();
+}
+
+bool ShellSessionPool::Session::Open(Device* device)
+{
+	m_pClient = SocketClient::Open(AndroidDebugBridge::GetSocketAddress());
+	if (m_pClient == NULL)
+	{
+		return false;
+	}
+
+	if (!AdbHelper::SetDevice(m_pClient, device))
+	{
+		Close();
+		return false;
+	}
+
+	// exec: gives a raw stream both ways, shell: may allocate a pty that echoes the input back
+	std::unique_ptr<const char[]> request(AdbHelper::FormAdbRequest("exec:sh"));
+	if (!AdbHelper::Write(m_pClient, request.get()))
+	{
+		Close();
+		return false;
+	}
+	std::unique_ptr<AdbHelper::AdbResponse> resp(AdbHelper::ReadAdbResponse(m_pClient, false /* readDiagString */));
+	if (!resp || !resp->okay)
+	{
+		LogWEx(SHELL_SESSION, _T("ADB rejected shell session on '%s'"), device->GetSerialNumber());
+		Close();
+		return false;
+	}
+	m_pClient->SetTimeout(SESSION_POLL_MS);
+
+	// the nonce keeps output that happens to look like a sentinel from ending a command early
+	std::ostringstream oss;
+	oss << std::hex << NowMillis() << "-" << reinterpret_cast<uintptr_t>(this);
+	m_strNonce = oss.str();
+	m_llLastUsed = NowMillis();
+	return true;
+}
+
+void ShellSessionPool::Session::Close()
+{
+	if (m_pClient != NULL)
+	{
+		m_pClient->Close();
+		delete m_pClient;
+		m_pClient = NULL;
+	}
+}
+
+bool ShellSessionPool::Session::IsUsed() const
+{
+	return m_bUsed;
+}
+
+long long ShellSessionPool::Session::GetLastUsed() const
+{
+	return m_llLastUsed;
+}
+
+bool ShellSessionPool::Session::Send(const std::vector<std::tstring>& commands, std::vector<std::string>& vecSentinels)
+{
+	std::string script;
+	vecSentinels.clear();
+	for (const std::tstring& command : commands)
+	{
+		std::ostringstream oss;
+		oss << SESSION_SENTINEL_PREFIX << m_strNonce << "-" << ++m_nSequence << ":";
+		vecSentinels.push_back(oss.str());
+
+		const char* szCommand = NULL;
+#ifdef _UNICODE
+		std::string strCmd;
+		ConvertUtils::WstringToString(command.c_str(), strCmd);
+		szCommand = strCmd.c_str();
+#else
+		szCommand = command.c_str();
+#endif
+		// a subshell keeps cd, exports and exit from leaking into the next command
+		script.append("(").append(szCommand).append("\n) </dev/null 2>&1; echo \"")
+			.append(vecSentinels.back()).append("$?\"\n");
+	}
+	return AdbHelper::Write(m_pClient, script.c_str(), static_cast<int>(script.length()), DdmPreferences::GetTimeOut());
+}
+
+int ShellSessionPool::Session::ReadResult(const std::string& sentinel, IShellOutputReceiver* rcvr,
+	long maxTimeToOutputResponse, int* exitCode, bool* outputSeen)
+{
+	if (rcvr == NULL)
+	{
+		rcvr = &NullOutputReceiver::GetReceiver();
+	}
+	// the poll timeout still applies, a cancel just ends the wait early
+	CancellationToken::Scope cancelScope(rcvr->GetCancellationToken(), m_pClient, CancellationToken::PHASE_OUTPUT);
+	const int bufferLen = 16384;
+	char data[bufferLen];
+	long timeToResponseCount = 0;
+	while (true)
+	{
+		int statusEnd = -1;
+		int pos = FindSentinel(sentinel, statusEnd, *exitCode);
+		// hold back what could be the start of a sentinel cut by the end of a read
+		int forward = pos >= 0 ? pos : static_cast<int>(m_vecPending.size()) - static_cast<int>(sentinel.length() - 1);
+		if (forward > 0)
+		{
+			rcvr->AddOutput(m_vecPending.data(), 0, forward);
+			m_vecPending.erase(m_vecPending.begin(), m_vecPending.begin() + forward);
+		}
+		if (pos >= 0 && statusEnd >= 0)
+		{
+			m_vecPending.erase(m_vecPending.begin(), m_vecPending.begin() + (statusEnd - pos + 1));
+			rcvr->Flush();
+			m_bUsed = true;
+			m_llLastUsed = NowMillis();
+			return 0;
+		}
+
+		if (rcvr->IsCancelled())
+		{
+			LogV(SHELL_SESSION, _T("read: cancelled"));
+			return -1;
+		}
+
+		int count = m_pClient->Read(data, bufferLen);
+		if (count > 0)
+		{
+			timeToResponseCount = 0;
+			*outputSeen = true;
+			m_vecPending.insert(m_vecPending.end(), data, data + count);
+			continue;
+		}
+		if (count == 0)
+		{
+			// the shell went away, hand on what it printed
+			if (!m_vecPending.empty())
+			{
+				rcvr->AddOutput(m_vecPending.data(), 0, static_cast<int>(m_vecPending.size()));
+				m_vecPending.clear();
+			}
+			rcvr->Flush();
+			return -1;
+		}
+		int err = AdbHelper::GetLastError();
+		if (err == WSAEWOULDBLOCK || err == WSAEINPROGRESS)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(SESSION_POLL_MS));
+		}
+		else if (err == WSAECANCELLED)
+		{
+			// the session is dropped by the caller, its output is out of step now
+			LogV(SHELL_SESSION, _T("read: cancelled"));
+			return -1;
+		}
+		else if (err != WSAETIMEDOUT)
+		{
+			LogDEx(SHELL_SESSION, _T("read: channel error %d"), err);
+			return -1;
+		}
+		timeToResponseCount += SESSION_POLL_MS;
+		if (maxTimeToOutputResponse > 0 && timeToResponseCount > maxTimeToOutputResponse)
+		{
+			LogD(SHELL_SESSION, _T("read: timeout"));
+			return -1;
+		}
+	}
+}
+
+int ShellSessionPool::Session::FindSentinel(const std::string& sentinel, int& statusEnd, int& exitCode) const
+{
+	auto iter = std::search(m_vecPending.begin(), m_vecPending.end(), sentinel.begin(), sentinel.end());
+	if (iter == m_vecPending.end())
+	{
+		return -1;
+	}
+	int pos = static_cast<int>(iter - m_vecPending.begin());
+	int status = 0;
+	for (size_t i = pos + sentinel.length(); i < m_vecPending.size(); i++)
+	{
+		char c = m_vecPending[i];
+		if (c == '\n')
+		{
+			statusEnd = static_cast<int>(i);
+			exitCode = status;
+			break;
+		}
+		status = status * 10 + (c - '0');
+	}
+	return pos;
+}
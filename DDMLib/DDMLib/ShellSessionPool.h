@@ -0,0 +1,133 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "CommonDefine.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "../System/SocketClient.h"
+#include "IShellOutputReceiver.h"
+
+// define class
+class Device;
+
+/**
+ * Keeps a shell running on the device between commands so small commands
+ * (getprop, pidof, settings get) do not each pay for a new connection,
+ * transport switch and shell start. Each command runs in a subshell with
+ * its output followed by a sentinel line carrying a per-session nonce and
+ * the exit status, which frames the output on the shared stream. Several
+ * commands can be written at once and their results read back in order.
+ *
+ * Sessions are pooled per device serial. When the pool is at its limit or
+ * a session cannot be used, commands run one-shot over shell: instead.
+ * A reaper thread closes sessions that stay idle, it runs once a pool
+ * exists and stops in CloseAll.
+ */
+class ShellSessionPool
+{
+private:
+	class Session
+	{
+	private:
+		SocketClient* m_pClient;
+		std::string m_strNonce;
+		unsigned int m_nSequence;
+		std::vector<char> m_vecPending;	// read past the end of the current command
+		bool m_bUsed;
+		long long m_llLastUsed;
+
+	public:
+		Session();
+		~Session();
+
+		bool Open(Device* device);
+		void Close();
+		bool IsUsed() const;
+		long long GetLastUsed() const;
+
+		// writes commands in one go, vecSentinels receives the line that ends each one's output
+		bool Send(const std::vector<std::tstring>& commands, std::vector<std::string>& vecSentinels);
+
+		/**
+		 * Forwards output up to sentinel to rcvr.
+		 * @return 0 with the exit status set, -1 when the session is no longer usable
+		 */
+		int ReadResult(const std::string& sentinel, IShellOutputReceiver* rcvr, long maxTimeToOutputResponse,
+			int* exitCode, bool* outputSeen);
+
+	private:
+		// @return the position of the sentinel in the pending bytes, or -1
+		int FindSentinel(const std::string& sentinel, int& statusEnd, int& exitCode) const;
+	};
+
+	struct DevicePool
+	{
+		std::mutex lock;
+		std::vector<Session*> vecIdle;	// most recently used last
+		int nOpen = 0;
+	};
+
+private:
+	static ShellSessionPool s_instance;
+
+	std::mutex m_lockPools;
+	std::map<std::tstring, std::shared_ptr<DevicePool>> m_mapPools;
+	std::mutex m_lockReaper;
+	std::condition_variable m_cvReaper;
+	std::thread m_threadReaper;
+	unsigned int m_nReaperRun = 0;	// bumped to stop the running reaper
+
+private:
+	ShellSessionPool();
+
+public:
+	~ShellSessionPool();
+	static ShellSessionPool& GetInstance();
+
+	/**
+	 * Runs command on a pooled session, see AdbHelper::ExecuteRemoteCommand.
+	 * exitCode may be NULL, it is SHELL_EXIT_UNKNOWN after a one-shot run.
+	 */
+	int Execute(Device* device, const TString command, IShellOutputReceiver* rcvr, long maxTimeToOutputResponse,
+		int* exitCode = NULL);
+
+	/**
+	 * Writes all commands to one session at once and reads their results
+	 * in order. rcvrs holds one receiver per command, exitCodes may be NULL.
+	 * @return 0 when every command ran, -1 otherwise
+	 */
+	int ExecuteBatch(Device* device, const std::vector<std::tstring>& commands,
+		const std::vector<IShellOutputReceiver*>& rcvrs, long maxTimeToOutputResponse, std::vector<int>* exitCodes);
+
+	void CloseSessions(const TString serialNumber);
+	void CloseAll();
+
+private:
+	std::shared_ptr<DevicePool> GetPool(const TString serialNumber);
+	void StartReaper();
+	void StopReaper();
+	void ReapLoop(unsigned int run);
+	Session* Acquire(DevicePool& pool, Device* device);
+	void Release(DevicePool& pool, Session* session, bool failed);
+	static int ExecuteOneShot(Device* device, const TString command, IShellOutputReceiver* rcvr,
+		long maxTimeToOutputResponse, int* exitCode);
+	static void CloseIdle(DevicePool& pool, long long llIdleBefore);
+	static long long NowMillis();
+};
@@ -0,0 +1,325 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "SpoolingReceiver.h"
+#include <algorithm>
+#include "LineFramer.h"
+#include "Log.h"
+
+#define SPOOL						_T("spool")
+#define SPOOL_VIEW_SIZE				(16*1024*1024)	// a multiple of the 64KB mapping granularity
+#define SPOOL_SCAN_SIZE				4096
+
+SpoolingReceiver::SpoolingReceiver(int memoryWindow) : m_nWindow((std::max)(memoryWindow, SPOOL_SCAN_SIZE)),
+	m_hFile(INVALID_HANDLE_VALUE), m_llFileSize(0), m_bDone(false), m_bCancelled(false),
+	m_hMapping(NULL), m_llMappingSize(0), m_pView(NULL), m_llViewOffset(0), m_nViewLength(0),
+	m_llLines(0), m_llLastLineStart(0), m_llCursorLine(-1), m_llCursorOffset(0)
+{
+	m_vecLineIndex.push_back(0);
+}
+
+SpoolingReceiver::~SpoolingReceiver()
+{
+	Unmap();
+	if (m_hFile != INVALID_HANDLE_VALUE)
+	{
+		// opened delete on close, this removes the spill file too
+		::CloseHandle(m_hFile);
+	}
+}
+
+void SpoolingReceiver::AddOutput(char* pData, int offset, int length)
+{
+	if (m_bCancelled)
+	{
+		return;
+	}
+
+	const char* data = pData + offset;
+	const char* end = data + length;
+	const long long base = GetSize();
+	const char* p = data;
+	const char* nl;
+	while ((nl = LineFramer::FindNewLine(p, end)) != NULL)
+	{
+		m_llLastLineStart = base + (nl + 1 - data);
+		if (++m_llLines % SPOOL_LINE_STRIDE == 0)
+		{
+			m_vecLineIndex.push_back(m_llLastLineStart);
+		}
+		p = nl + 1;
+	}
+
+	while (data < end)
+	{
+		int room = m_nWindow - static_cast<int>(m_vecBuffer.size());
+		if (room == 0)
+		{
+			bool bRet = m_hFile == INVALID_HANDLE_VALUE ? Spill() : WriteBuffer();
+			if (!bRet)
+			{
+				// stop the command rather than lose output silently
+				LogE(SPOOL, _T("Unable to spill command output to disk"));
+				m_bCancelled = true;
+				return;
+			}
+			continue;
+		}
+		int count = (std::min)(room, static_cast<int>(end - data));
+		m_vecBuffer.insert(m_vecBuffer.end(), data, data + count);
+		data += count;
+	}
+}
+
+void SpoolingReceiver::Flush()
+{
+	m_bDone = true;
+}
+
+bool SpoolingReceiver::IsCancelled()
+{
+	return m_bCancelled;
+}
+
+void SpoolingReceiver::Cancel()
+{
+	m_bCancelled = true;
+}
+
+bool SpoolingReceiver::IsDone() const
+{
+	return m_bDone;
+}
+
+bool SpoolingReceiver::IsSpilled() const
+{
+	return m_hFile != INVALID_HANDLE_VALUE;
+}
+
+long long SpoolingReceiver::GetSize() const
+{
+	return m_llFileSize + static_cast<long long>(m_vecBuffer.size());
+}
+
+int SpoolingReceiver::ReadAt(long long offset, char* buffer, int length)
+{
+	const long long size = GetSize();
+	if (offset < 0 || length < 0)
+	{
+		return -1;
+	}
+	int copied = 0;
+	while (copied < length && offset < size)
+	{
+		if (offset < m_llFileSize)
+		{
+			int count = static_cast<int>((std::min)(static_cast<long long>(length - copied), m_llFileSize - offset));
+			const char* p = MapRange(offset, count);
+			if (p == NULL)
+			{
+				return copied > 0 ? copied : -1;
+			}
+			memcpy(buffer + copied, p, count);
+			copied += count;
+			offset += count;
+		}
+		else
+		{
+			size_t start = static_cast<size_t>(offset - m_llFileSize);
+			int count = static_cast<int>((std::min)(static_cast<size_t>(length - copied), m_vecBuffer.size() - start));
+			memcpy(buffer + copied, m_vecBuffer.data() + start, count);
+			copied += count;
+			offset += count;
+		}
+	}
+	return copied;
+}
+
+long long SpoolingReceiver::GetLineCount() const
+{
+	// a last line without '\n' still counts
+	return m_llLines + (GetSize() > m_llLastLineStart ? 1 : 0);
+}
+
+bool SpoolingReceiver::GetLine(long long index, std::string& line)
+{
+	line.clear();
+	long long offset;
+	if (!FindLine(index, offset))
+	{
+		return false;
+	}
+
+	char chunk[SPOOL_SCAN_SIZE];
+	long long next = GetSize();
+	while (true)
+	{
+		int count = ReadAt(offset, chunk, sizeof(chunk));
+		if (count < 0)
+		{
+			return false;
+		}
+		if (count == 0)
+		{
+			break;
+		}
+		const char* nl = LineFramer::FindNewLine(chunk, chunk + count);
+		if (nl != NULL)
+		{
+			line.append(chunk, nl - chunk);
+			next = offset + (nl + 1 - chunk);
+			break;
+		}
+		line.append(chunk, count);
+		offset += count;
+	}
+	if (!line.empty() && line.back() == '\r')
+	{
+		line.pop_back();
+	}
+	m_llCursorLine = index + 1;
+	m_llCursorOffset = next;
+	return true;
+}
+
+bool SpoolingReceiver::FindLine(long long index, long long& offset)
+{
+	if (index < 0 || index >= GetLineCount())
+	{
+		return false;
+	}
+	// continue from the previous line when reading in order, else from the nearest index entry
+	long long line = index - index % SPOOL_LINE_STRIDE;
+	offset = m_vecLineIndex[static_cast<size_t>(index / SPOOL_LINE_STRIDE)];
+	if (m_llCursorLine > line && m_llCursorLine <= index)
+	{
+		line = m_llCursorLine;
+		offset = m_llCursorOffset;
+	}
+
+	char chunk[SPOOL_SCAN_SIZE];
+	while (line < index)
+	{
+		int count = ReadAt(offset, chunk, sizeof(chunk));
+		if (count <= 0)
+		{
+			return false;
+		}
+		const char* p = chunk;
+		const char* end = chunk + count;
+		const char* nl;
+		while (line < index && (nl = LineFramer::FindNewLine(p, end)) != NULL)
+		{
+			line++;
+			p = nl + 1;
+		}
+		offset += line < index ? count : p - chunk;
+	}
+	return true;
+}
+
+bool SpoolingReceiver::Spill()
+{
+	TCHAR szDir[MAX_PATH];
+	TCHAR szPath[MAX_PATH];
+	if (::GetTempPath(MAX_PATH, szDir) == 0 || ::GetTempFileName(szDir, _T("ddm"), 0, szPath) == 0)
+	{
+		return false;
+	}
+	m_hFile = ::CreateFile(szPath, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if (m_hFile == INVALID_HANDLE_VALUE)
+	{
+		::DeleteFile(szPath);
+		return false;
+	}
+	LogVEx(SPOOL, _T("Spilling command output to %s"), szPath);
+	return WriteBuffer();
+}
+
+bool SpoolingReceiver::WriteBuffer()
+{
+	const char* data = m_vecBuffer.data();
+	DWORD dwLeft = static_cast<DWORD>(m_vecBuffer.size());
+	while (dwLeft > 0)
+	{
+		DWORD dwWritten = 0;
+		if (!::WriteFile(m_hFile, data, dwLeft, &dwWritten, NULL) || dwWritten == 0)
+		{
+			return false;
+		}
+		data += dwWritten;
+		dwLeft -= dwWritten;
+	}
+	m_llFileSize += static_cast<long long>(m_vecBuffer.size());
+	m_vecBuffer.clear();
+	return true;
+}
+
+const char* SpoolingReceiver::MapRange(long long offset, int& length)
+{
+	if (m_hMapping != NULL && m_llMappingSize != m_llFileSize)
+	{
+		// a mapping cannot grow with its file
+		Unmap();
+	}
+	if (m_hMapping == NULL)
+	{
+		m_hMapping = ::CreateFileMapping(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_hMapping == NULL)
+		{
+			return NULL;
+		}
+		m_llMappingSize = m_llFileSize;
+	}
+	if (m_pView == NULL || offset < m_llViewOffset || offset >= m_llViewOffset + m_nViewLength)
+	{
+		if (m_pView != NULL)
+		{
+			::UnmapViewOfFile(m_pView);
+			m_pView = NULL;
+		}
+		// views stay small so a 32-bit process never needs the whole file mapped
+		m_llViewOffset = offset - offset % SPOOL_VIEW_SIZE;
+		m_nViewLength = static_cast<int>((std::min)(static_cast<long long>(SPOOL_VIEW_SIZE),
+			m_llMappingSize - m_llViewOffset));
+		m_pView = static_cast<char*>(::MapViewOfFile(m_hMapping, FILE_MAP_READ,
+			static_cast<DWORD>(m_llViewOffset >> 32), static_cast<DWORD>(m_llViewOffset & 0xFFFFFFFF),
+			m_nViewLength));
+		if (m_pView == NULL)
+		{
+			return NULL;
+		}
+	}
+	length = static_cast<int>((std::min)(static_cast<long long>(length), m_llViewOffset + m_nViewLength - offset));
+	return m_pView + (offset - m_llViewOffset);
+}
+
+void SpoolingReceiver::Unmap()
+{
+	if (m_pView != NULL)
+	{
+		::UnmapViewOfFile(m_pView);
+		m_pView = NULL;
+	}
+	if (m_hMapping != NULL)
+	{
+		::CloseHandle(m_hMapping);
+		m_hMapping = NULL;
+	}
+	m_llMappingSize = 0;
+}
@@ -0,0 +1,87 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "CommonDefine.h"
+#include "IShellOutputReceiver.h"
+
+#define SPOOL_MEMORY_WINDOW		(4*1024*1024)	// output kept in memory before spilling to disk
+#define SPOOL_LINE_STRIDE		64			// one line offset is indexed every this many lines
+
+/**
+ * Collects the complete output of a command in bounded memory, for
+ * dumpsys, logcat -d or find / that can print hundreds of MB. Output is
+ * kept in a fixed window and spilled to a temp file once it outgrows it;
+ * the file is read back through mapped views, so memory stays at about
+ * the window plus a sparse line index whatever the output size.
+ * Not thread safe, read only after the command finished or from the
+ * thread that feeds it.
+ */
+class SpoolingReceiver : public IShellOutputReceiver
+{
+private:
+	const int m_nWindow;
+	std::vector<char> m_vecBuffer;		// output past the end of the file
+	HANDLE m_hFile;
+	long long m_llFileSize;
+	bool m_bDone;
+	bool m_bCancelled;
+
+	// mapped view of the temp file, remapped when the file has grown
+	HANDLE m_hMapping;
+	long long m_llMappingSize;
+	char* m_pView;
+	long long m_llViewOffset;
+	int m_nViewLength;
+
+	std::vector<long long> m_vecLineIndex;	// start of every SPOOL_LINE_STRIDE-th line
+	long long m_llLines;					// lines ended by a '\n' so far
+	long long m_llLastLineStart;
+	long long m_llCursorLine;				// where the last GetLine ended, for sequential reads
+	long long m_llCursorOffset;
+
+public:
+	explicit SpoolingReceiver(int memoryWindow = SPOOL_MEMORY_WINDOW);
+	~SpoolingReceiver();
+
+	virtual void AddOutput(char* pData, int offset, int length) override;
+	virtual void Flush() override;
+	virtual bool IsCancelled() override;
+	void Cancel();
+
+	bool IsDone() const;
+	bool IsSpilled() const;
+	long long GetSize() const;
+
+	/**
+	 * Copies up to length bytes of output starting at offset.
+	 * @return the number of bytes copied, 0 past the end, -1 on error
+	 */
+	int ReadAt(long long offset, char* buffer, int length);
+
+	// lines end at '\n', a '\r' before it is dropped like in LineFramer
+	long long GetLineCount() const;
+	bool GetLine(long long index, std::string& line);
+
+private:
+	bool Spill();
+	bool WriteBuffer();
+	const char* MapRange(long long offset, int& length);
+	bool FindLine(long long index, long long& offset);
+	void Unmap();
+};
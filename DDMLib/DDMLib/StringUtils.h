@@ -26,11 +26,50 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 class StringUtils
 {
 public:
+	// white space as the "C" locale sees it, without constructing a locale per character
+	template <class T>
+	inline static bool IsSpace(T c)
+	{
+		return c == ' ' || (c >= '\t' && c <= '\r');
+	}
+
+	template <class T>
+	inline static bool IsDigit(T c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	// the characters '.' in an ECMAScript regex does not match
+	template <class T>
+	inline static bool IsLineTerminator(T c)
+	{
+		return c == '\n' || c == '\r' || c == 0x2028 || c == 0x2029;
+	}
+
+	// compares the first length characters against lower case ascii, like std::regex::icase does
+	template <class T>
+	static bool EqualsIgnoreCase(const T* s, const char* lowerAscii, size_t length)
+	{
+		for (size_t i = 0; i < length; i++)
+		{
+			T c = s[i];
+			if (c >= 'A' && c <= 'Z')
+			{
+				c += 'a' - 'A';
+			}
+			if (c != static_cast<T>(lowerAscii[i]))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
 	template <class T>
 	inline static void TrimString(std::basic_string<T> &s)
 	{
-		auto wsfront = std::find_if_not(s.begin(), s.end(), [](int c) { std::locale loc; return std::isspace(c, loc); });
-		auto wsback = std::find_if_not(s.rbegin(), s.rend(), [](int c) {	std::locale loc; return std::isspace(c, loc); }).base();
+		auto wsfront = std::find_if_not(s.begin(), s.end(), IsSpace<T>);
+		auto wsback = std::find_if_not(s.rbegin(), s.rend(), IsSpace<T>).base();
 		if (wsback <= wsfront)
 		{
 			s.clear();
@@ -54,7 +93,7 @@ public:
 	}
 
 	template <class T>
-	static std::basic_string<T>& ToUpperCase(std::tstring& strIn)
+	static std::basic_string<T>& ToUpperCase(std::basic_string<T>& s)
 	{
 		if (s.empty())
 		{
@@ -64,6 +103,24 @@ public:
 		return s;
 	}
 
+	// single quotes a value for the device shell
+	static void QuoteShellArgument(const TString value, std::tstring& quoted)
+	{
+		quoted = _T("'");
+		for (const TCHAR* p = value; *p != _T('\0'); p++)
+		{
+			if (*p == _T('\''))
+			{
+				quoted.append(_T("'\\''"));
+			}
+			else
+			{
+				quoted.push_back(*p);
+			}
+		}
+		quoted.push_back(_T('\''));
+	}
+
 	static const char* SaveString(const char* value)
 	{
 		return value;
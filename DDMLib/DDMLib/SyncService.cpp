@@ -17,17 +17,24 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "SyncService.h"
-#include "../System/StreamReader.h"
-#include "../System/StreamWriter.h"
+#include <algorithm>
+#include <thread>
 #include "DdmPreferences.h"
 #include "AdbHelper.h"
+#include "GzipFileSink.h"
+#include "StringUtils.h"
 #include "ArrayHelper.h"
+#include "CancellationToken.h"
+#include "TransferScheduler.h"
+#include "TransferTelemetry.h"
 
 #define SYNC						_T("sync")
 
 #define SYNC_DATA_MAX				64*1024
 #define REMOTE_PATH_MAX_LENGTH	1024
 #define SYNC_REQ_LENGTH			8
+#define STAT_RESULT_LENGTH		16
+#define STAT_WINDOW				256	// requests in flight, small enough that neither side blocks
 
 #define ID_OKAY "OKAY"
 #define ID_FAIL "FAIL"
@@ -36,6 +43,17 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #define ID_DATA "DATA"
 #define ID_DONE "DONE"
 #define ID_SEND "SEND"
+#define ID_LIST "LIST"
+#define ID_LIS2 "LIS2"
+#define ID_DENT "DENT"
+#define ID_DNT2 "DNT2"
+
+#define FEATURE_LS_V2				"ls_v2"
+
+// id, mode, size, time, namelen
+#define DENT_LENGTH				20
+// id, error, dev, ino, mode, nlink, uid, gid, size, atime, mtime, ctime, namelen
+#define DENT_V2_LENGTH				76
 
 SyncService::NullSyncProgressMonitor* const SyncService::s_pNullSyncProgressMonitor = new NullSyncProgressMonitor();
 
@@ -104,6 +122,27 @@ void SyncService::Close()
 	}
 }
 
+bool SyncService::Ping()
+{
+	if (m_pClient == NULL)
+	{
+		return false;
+	}
+	// any request will do, the root always exists
+	FileStat* fileStat = NULL;
+	bool bRet = StatFile(_T("/"), &fileStat);
+	if (fileStat != NULL)
+	{
+		delete fileStat;
+	}
+	return bRet;
+}
+
+void SyncService::SetDevice(Device* device)
+{
+	m_pDevice = device;
+}
+
 SyncService::ISyncProgressMonitor* SyncService::GetNullProgressMonitor()
 {
 	return s_pNullSyncProgressMonitor;
@@ -124,7 +163,16 @@ bool SyncService::PushFile(const TString local, const TString remote, ISyncProgr
 
 	monitor->Start(static_cast<int>(file.GetLength()));
 
-	bool bRet = DoPushFile(file, remote, monitor);
+	TransferStats stats(TransferStats::PUSH);
+	Crc32 crc;
+	stats.Begin();
+	bool bRet = DoPushFile(file, remote, monitor, stats, crc);
+	stats.End();
+	RecordTransfer(stats, bRet, monitor);
+	if (bRet && DdmPreferences::GetVerifyTransfers())
+	{
+		bRet = VerifyChecksum(remote, crc);
+	}
 
 	monitor->Stop();
 
@@ -139,17 +187,103 @@ bool SyncService::PullFile(const TString remote, const TString local, ISyncProgr
 	{
 		return false;
 	}
-	if (fileStat->GetMode() == 0)
+	const int mode = fileStat->GetMode();
+	const int size = fileStat->GetSize();
+	delete fileStat;
+	if (mode == 0)
 	{
-		delete fileStat;
 		return false;
 	}
+
+	monitor->Start(size);
+
+	TransferStats stats(TransferStats::PULL);
+	Crc32 crc;
+	stats.Begin();
+	bRet = DoPullFile(remote, local, monitor, stats, crc);
+	stats.End();
+	RecordTransfer(stats, bRet, monitor);
+	if (bRet && DdmPreferences::GetVerifyTransfers())
+	{
+		bRet = VerifyChecksum(remote, crc);
+	}
+
+	monitor->Stop();
+
+	return bRet;
+}
+
+bool SyncService::PullFileCompressed(const TString remote, const TString local, int level,
+	ISyncProgressMonitor* monitor)
+{
+	FileStat* fileStat = NULL;
+	if (!StatFile(remote, &fileStat))
+	{
+		return false;
+	}
+	const int mode = fileStat->GetMode();
+	const int size = fileStat->GetSize();
 	delete fileStat;
+	if (mode == 0)
+	{
+		return false;
+	}
 
-	monitor->Start(0);
-	//TODO: use the {@link FileListingService} to get the file size.
+	monitor->Start(size);
+
+	// the chunks are compressed on their way to disk, no uncompressed copy is written
+	GzipFileSink sink(local, level, (std::max)(static_cast<int>(std::thread::hardware_concurrency()), 1));
+	TransferStats stats(TransferStats::PULL);
+	Crc32 crc;
+	stats.Begin();
+	bool bRet = DoPullStream(remote, &sink, monitor, stats, crc) && sink.Finish();
+	stats.End();
+	RecordTransfer(stats, bRet, monitor);
+	if (bRet && DdmPreferences::GetVerifyTransfers())
+	{
+		bRet = VerifyChecksum(remote, crc);
+	}
+
+	monitor->Stop();
 
-	bRet = DoPullFile(remote, local, monitor);
+	return bRet;
+}
+
+bool SyncService::PushStream(IDataSource* source, int size, int mode, int lastModified, const TString remote,
+	ISyncProgressMonitor* monitor)
+{
+	monitor->Start(size);
+
+	TransferStats stats(TransferStats::PUSH);
+	Crc32 crc;
+	stats.Begin();
+	bool bRet = DoPushStream(source, mode, lastModified, remote, monitor, stats, crc);
+	stats.End();
+	RecordTransfer(stats, bRet, monitor);
+	if (bRet && DdmPreferences::GetVerifyTransfers())
+	{
+		bRet = VerifyChecksum(remote, crc);
+	}
+
+	monitor->Stop();
+
+	return bRet;
+}
+
+bool SyncService::PullStream(const TString remote, int size, IDataSink* sink, ISyncProgressMonitor* monitor)
+{
+	monitor->Start(size);
+
+	TransferStats stats(TransferStats::PULL);
+	Crc32 crc;
+	stats.Begin();
+	bool bRet = DoPullStream(remote, sink, monitor, stats, crc);
+	stats.End();
+	RecordTransfer(stats, bRet, monitor);
+	if (bRet && DdmPreferences::GetVerifyTransfers())
+	{
+		bRet = VerifyChecksum(remote, crc);
+	}
 
 	monitor->Stop();
 
@@ -175,9 +309,8 @@ bool SyncService::StatFile(const TString path, FileStat** fileStat)
 
 	// read the result, in a byte array containing 4 ints
 	// (id, mode, size, time)
-	const int statLen = 16;
-	char* statResult = new char[statLen];
-	bRet = AdbHelper::Read(m_pClient, statResult, statLen, DdmPreferences::GetTimeOut());
+	char statResult[STAT_RESULT_LENGTH] = { 0 };
+	bRet = AdbHelper::Read(m_pClient, statResult, STAT_RESULT_LENGTH, DdmPreferences::GetTimeOut());
 
 	// check we have the proper data back
 	if (!bRet || !CheckResult(statResult, ID_STAT))
@@ -192,25 +325,191 @@ bool SyncService::StatFile(const TString path, FileStat** fileStat)
 	return true;
 }
 
-bool SyncService::DoPushFile(const File& file, const TString remotePath, ISyncProgressMonitor* monitor)
+bool SyncService::StatFiles(const std::vector<std::tstring>& paths, std::vector<StatEntry>& results)
 {
 	const int timeOut = DdmPreferences::GetTimeOut();
+	const int count = static_cast<int>(paths.size());
+	results.resize(count);
+	// the device answers STAT requests in order, so keep a window of them on
+	// the wire instead of paying a round trip per path
+	std::vector<char> request;
+	request.reserve(STAT_WINDOW * (SYNC_REQ_LENGTH + 128));
+	char statResult[STAT_RESULT_LENGTH * STAT_WINDOW];
+	int sent = 0;
+	int received = 0;
+	while (received < count)
+	{
+		request.clear();
+		while (sent < count && sent - received < STAT_WINDOW)
+		{
+			if (!AppendFileReq(ID_STAT, paths[sent].c_str(), request))
+			{
+				LogEEx(SYNC, _T("Unable to stat %s: path too long"), paths[sent].c_str());
+				return false;
+			}
+			sent++;
+		}
+		if (!request.empty() && !AdbHelper::Write(m_pClient, request.data(), static_cast<int>(request.size()), timeOut))
+		{
+			return false;
+		}
 
-	int pathLen = _tcslen(remotePath);
-	if (pathLen > REMOTE_PATH_MAX_LENGTH)
+		// drain half the window before topping it up again, unless nothing is left to send
+		int batch = sent - received;
+		if (sent < count && batch > STAT_WINDOW / 2)
+		{
+			batch = STAT_WINDOW / 2;
+		}
+		if (!AdbHelper::Read(m_pClient, statResult, batch * STAT_RESULT_LENGTH, timeOut))
+		{
+			return false;
+		}
+		for (int i = 0; i < batch; i++)
+		{
+			char* result = statResult + i * STAT_RESULT_LENGTH;
+			if (!CheckResult(result, ID_STAT))
+			{
+				return false;
+			}
+			StatEntry& entry = results[received + i];
+			entry.nMode = ArrayHelper::Swap32bitFromArray(result, 4);
+			entry.nSize = ArrayHelper::Swap32bitFromArray(result, 8);
+			entry.nLastModified = ArrayHelper::Swap32bitFromArray(result, 12);
+		}
+		received += batch;
+	}
+	return true;
+}
+
+bool SyncService::ListDirectory(const TString path, FileListingService::FileEntry* entry)
+{
+	const int timeOut = DdmPreferences::GetTimeOut();
+
+	// ls_v2 reports 64 bits sizes and times, use it when the device knows it
+	const bool bV2 = m_pDevice->HasFeature(FEATURE_LS_V2);
+	const int headerLen = bV2 ? DENT_V2_LENGTH : DENT_LENGTH;
+
+	int len = 0;
+	char* msg = CreateFileReq(bV2 ? ID_LIS2 : ID_LIST, path, len);
+	bool bRet = AdbHelper::Write(m_pClient, msg, len, timeOut);
+	delete[] msg;
+	if (!bRet)
 	{
 		return false;
 	}
 
+	char header[DENT_V2_LENGTH] = { 0 };
+	// entry names are read in place, one at a time
+	char* name = GetBuffer();
+	std::vector<FileListingService::FileEntry*> vecChildren;
+
+	bool bError = false;
+	while (true)
+	{
+		bRet = AdbHelper::Read(m_pClient, header, headerLen, timeOut);
+		if (!bRet)
+		{
+			bError = true;
+			break;
+		}
+
+		// the last entry is an empty one with a DONE id
+		if (CheckResult(header, ID_DONE))
+		{
+			break;
+		}
+		if (!CheckResult(header, bV2 ? ID_DNT2 : ID_DENT))
+		{
+			bError = true;
+			break;
+		}
+
+		int error = 0;
+		int mode;
+		long long size;
+		time_t lastModified;
+		int nameLength;
+		if (bV2)
+		{
+			error = ArrayHelper::Swap32bitFromArray(header, 4);
+			mode = ArrayHelper::Swap32bitFromArray(header, 24);
+			size = ArrayHelper::Swap64bitFromArray(header, 40);
+			lastModified = static_cast<time_t>(ArrayHelper::Swap64bitFromArray(header, 56));
+			nameLength = ArrayHelper::Swap32bitFromArray(header, 72);
+		}
+		else
+		{
+			mode = ArrayHelper::Swap32bitFromArray(header, 4);
+			size = static_cast<unsigned int>(ArrayHelper::Swap32bitFromArray(header, 8));
+			lastModified = static_cast<time_t>(ArrayHelper::Swap32bitFromArray(header, 12));
+			nameLength = ArrayHelper::Swap32bitFromArray(header, 16);
+		}
+		if (nameLength <= 0 || nameLength > REMOTE_PATH_MAX_LENGTH)
+		{
+			bError = true;
+			break;
+		}
+
+		bRet = AdbHelper::Read(m_pClient, name, nameLength, timeOut);
+		if (!bRet)
+		{
+			bError = true;
+			break;
+		}
+		name[nameLength] = '\0';
+
+		// skip the entries we could not stat, and the current and parent directories
+		if (error != 0 || strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+		{
+			continue;
+		}
+		vecChildren.push_back(new FileListingService::FileEntry(entry, name, mode, size, lastModified));
+	}
+
+	if (bError)
+	{
+		for (FileListingService::FileEntry* child : vecChildren)
+		{
+			delete child;
+		}
+		return false;
+	}
+
+	entry->SetChildren(vecChildren);
+	return true;
+}
+
+bool SyncService::DoPushFile(const File& file, const TString remotePath, ISyncProgressMonitor* monitor,
+	TransferStats& stats, Crc32& crc)
+{
 	FileReadWrite fRead = file.GetRead();
+	FileDataSource source(fRead);
+	int time = static_cast<int>(file.GetLastModifiedTime());
+	bool bRet = DoPushStream(&source, 0644, time, remotePath, monitor, stats, crc);
+
+	// close the local file
+	fRead.Close();
+	fRead.Delete();
+	return bRet;
+}
 
-	const int nBuffSize = 1024;
-	// create the stream to read the file
-	CharStreamReader fsr(fRead, SYNC_DATA_MAX);
+bool SyncService::DoPushStream(IDataSource* source, int mode, int lastModified, const TString remotePath,
+	ISyncProgressMonitor* monitor, TransferStats& stats, Crc32& crc)
+{
+	const int timeOut = DdmPreferences::GetTimeOut();
+
+	int pathLen = _tcslen(remotePath);
+	if (pathLen > REMOTE_PATH_MAX_LENGTH)
+	{
+		return false;
+	}
+
+	// a cancel wakes the socket at once, the stream is left mid-packet so the caller must drop the service
+	CancellationToken::Scope cancelScope(monitor->GetCancellationToken(), m_pClient, CancellationToken::PHASE_UPLOAD);
 
 	int len = 0;
 	// create the header for the action
-	char* msg = CreateSendFileReq(ID_SEND, remotePath, 0644, len);
+	char* msg = CreateSendFileReq(ID_SEND, remotePath, mode, len);
 
 	// and send it. We use a custom try/catch block to make the difference between
 	// file and network IO exceptions.
@@ -223,6 +522,7 @@ bool SyncService::DoPushFile(const File& file, const TString remotePath, ISyncPr
 
 	strncpy(GetBuffer(), ID_DATA, _countof(ID_DATA));
 
+	TransferScheduler::Flow flow(m_pDevice->GetSerialNumber());
 	bool bError = false;
 	// look while there is something to read
 	while (true)
@@ -235,7 +535,10 @@ bool SyncService::DoPushFile(const File& file, const TString remotePath, ISyncPr
 		}
 
 		// read up to SYNC_DATA_MAX
-		int readCount = fsr.ReadData(GetBuffer() + SYNC_REQ_LENGTH, SYNC_DATA_MAX);
+		const long long chunkStart = TransferStats::NowMicros();
+		int readCount = source->ReadData(GetBuffer() + SYNC_REQ_LENGTH, SYNC_DATA_MAX);
+		const long long readEnd = TransferStats::NowMicros();
+		stats.AddDiskTime(readEnd - chunkStart);
 		if (readCount == 0)
 		{
 			// we reached the end of the file
@@ -247,39 +550,56 @@ bool SyncService::DoPushFile(const File& file, const TString remotePath, ISyncPr
 			bError = true;
 			break;
 		}
+		crc.Update(GetBuffer() + SYNC_REQ_LENGTH, readCount);
+
+		// wait for our share of the link
+		if (!flow.Consume(readCount, monitor))
+		{
+			bError = true;
+			break;
+		}
 
 		// now send the data to the device
 		// first write the amount read
 		ArrayHelper::Swap32bitsToArray(readCount, GetBuffer(), 4);
 
 		// now write it
+		const long long writeStart = TransferStats::NowMicros();
 		bRet = AdbHelper::Write(m_pClient, GetBuffer(), readCount + SYNC_REQ_LENGTH, timeOut);
+		const long long writeEnd = TransferStats::NowMicros();
+		stats.AddSocketTime(writeEnd - writeStart);
 		if (!bRet)
 		{
 			// write error
 			bError = true;
 			break;
 		}
+		stats.AddChunk(readCount, writeEnd - chunkStart - (writeStart - readEnd));
 
 		// and advance the monitor
 		monitor->Advance(readCount);
+		if (stats.ShouldReport())
+		{
+			monitor->OnTelemetry(stats);
+		}
 	}
 
-	// close the local file
-	fRead.Close();
-	fRead.Delete();
-
 	if (bError)
 	{
+		if (cancelScope.IsCancelled())
+		{
+			LogIEx(SYNC, _T("Push of %s cancelled during %s"), remotePath,
+				CancellationToken::GetPhaseName(monitor->GetCancellationToken()->GetCancelledPhase()));
+		}
 		return false;
 	}
 
 	// create the DONE message
-	int time = static_cast<int>(file.GetLastModifiedTime() / 1000);
 	len = 0;
-	msg = CreateReq(ID_DONE, time, len);
+	msg = CreateReq(ID_DONE, lastModified, len);
 
 	// and send it.
+	const long long doneStart = TransferStats::NowMicros();
 	bRet = AdbHelper::Write(m_pClient, msg, len, timeOut);
 	delete[] msg;
 	if (!bRet)
@@ -290,6 +610,8 @@ bool SyncService::DoPushFile(const File& file, const TString remotePath, ISyncPr
 	// (id, size)
 	char result[SYNC_REQ_LENGTH] = { 0 };
 	bRet = AdbHelper::Read(m_pClient, result, SYNC_REQ_LENGTH, timeOut);
+	// the device answers only once everything is on disk, so this includes the flush
+	stats.SetRoundTrip(TransferStats::NowMicros() - doneStart);
 
 	if (!bRet || !CheckResult(result, ID_OKAY))
 	{
@@ -298,7 +620,15 @@ bool SyncService::DoPushFile(const File& file, const TString remotePath, ISyncPr
  	return true;
 }
 
-bool SyncService::DoPullFile(const TString remotePath, const TString localPath, ISyncProgressMonitor* monitor)
+bool SyncService::DoPullFile(const TString remotePath, const TString localPath, ISyncProgressMonitor* monitor,
+	TransferStats& stats, Crc32& crc)
+{
+	FileDataSink sink(localPath);
+	return DoPullStream(remotePath, &sink, monitor, stats, crc);
+}
+
+bool SyncService::DoPullStream(const TString remotePath, IDataSink* sink, ISyncProgressMonitor* monitor,
+	TransferStats& stats, Crc32& crc)
 {
 	const int timeOut = DdmPreferences::GetTimeOut();
 
@@ -308,11 +638,14 @@ bool SyncService::DoPullFile(const TString remotePath, const TString localPath,
 		return false;
 	}
 
+	CancellationToken::Scope cancelScope(monitor->GetCancellationToken(), m_pClient, CancellationToken::PHASE_DOWNLOAD);
+
 	// create the full request message
 	int len = 0;
 	char* msg = CreateFileReq(ID_RECV, remotePath, len);
 
 	// and send it.
+	const long long requestStart = TransferStats::NowMicros();
 	bool bRet = AdbHelper::Write(m_pClient, msg, len, timeOut);
 	delete[] msg;
 	if (!bRet)
@@ -328,6 +661,7 @@ bool SyncService::DoPullFile(const TString remotePath, const TString localPath,
 	{
 		return false;
 	}
+	stats.SetRoundTrip(TransferStats::NowMicros() - requestStart);
 
 	// check we have the proper data back
 	if (!CheckResult(pullResult, ID_DATA) &&
@@ -336,17 +670,16 @@ bool SyncService::DoPullFile(const TString remotePath, const TString localPath,
 		return false;
 	}
 
-	// access the destination file
-	File f(localPath);
-
-	// create the stream to write in the file. We use a new try/catch block to differentiate
-	// between file and network io exceptions.
-	FileReadWrite fWrite = f.GetWrite();
-	CharStreamWriter fsw(fWrite, 0);
+	// only touch the destination once the device accepted the request
+	if (!sink->Open())
+	{
+		return false;
+	}
 
 	// the buffer to read the data
 	char data[SYNC_DATA_MAX] = { 0 };
 
+	TransferScheduler::Flow flow(m_pDevice->GetSerialNumber());
 	bool bError = false;
 	// loop to get data until we're done.
 	while (true)
@@ -378,7 +711,15 @@ bool SyncService::DoPullFile(const TString remotePath, const TString localPath,
 			break;
 		}
 
+		// wait for our share of the link
+		if (!flow.Consume(length, monitor))
+		{
+			bError = true;
+			break;
+		}
+
 		// now read the length we received
+		const long long chunkStart = TransferStats::NowMicros();
 		bRet = AdbHelper::Read(m_pClient, data, length, timeOut);
 		if (!bRet)
 		{
@@ -386,8 +727,12 @@ bool SyncService::DoPullFile(const TString remotePath, const TString localPath,
 			break;
 		}
 
+		crc.Update(data, length);
+
 		// get the header for the next packet.
 		bRet = AdbHelper::Read(m_pClient, pullResult, SYNC_REQ_LENGTH, timeOut);
+		const long long readEnd = TransferStats::NowMicros();
+		stats.AddSocketTime(readEnd - chunkStart);
 		if (!bRet)
 		{
 			bError = true;
@@ -395,33 +740,66 @@ bool SyncService::DoPullFile(const TString remotePath, const TString localPath,
 		}
 
 		// write the content in the file
-		long lWrite = fsw.WriteData(data, length);
-		if (lWrite < 0)
+		bRet = sink->WriteData(data, length);
+		const long long writeEnd = TransferStats::NowMicros();
+		stats.AddDiskTime(writeEnd - readEnd);
+		if (!bRet)
 		{
 			bError = true;
 			break;
 		}
+		stats.AddChunk(length, writeEnd - chunkStart);
 
 		monitor->Advance(length);
+		if (stats.ShouldReport())
+		{
+			monitor->OnTelemetry(stats);
+		}
 	}
 
-	long lWrite = fsw.Flush();
-	if (lWrite < 0)
+	if (bError)
 	{
-		bError = true;
+		if (cancelScope.IsCancelled())
+		{
+			LogIEx(SYNC, _T("Pull of %s cancelled during %s"), remotePath,
+				CancellationToken::GetPhaseName(monitor->GetCancellationToken()->GetCancelledPhase()));
+		}
+		return false;
 	}
+	return true;
+}
 
-	// close the local file
-	fWrite.Close();
-	fWrite.Delete();
-
-	if (bError)
+bool SyncService::VerifyChecksum(const TString remotePath, const Crc32& crc)
+{
+	std::tstring quotedPath;
+	StringUtils::QuoteShellArgument(remotePath, quotedPath);
+	std::tostringstream oss;
+	oss << _T("cksum ") << quotedPath << _T(" 2>&1");
+
+	CksumReceiver receiver;
+	int nRet = m_pDevice->ExecuteShellCommand(oss.str().c_str(), &receiver, DdmPreferences::GetTimeOut());
+	UINT32 nCrc = 0;
+	ULONGLONG ullLength = 0;
+	if (nRet != 0 || !receiver.GetResult(nCrc, ullLength))
 	{
+		LogEEx(SYNC, _T("Unable to checksum %s on device"), remotePath);
+		return false;
+	}
+	if (nCrc != crc.GetCksum() || ullLength != crc.GetLength())
+	{
+		LogEEx(SYNC, _T("Checksum mismatch for %s: device %u/%llu, transferred %u/%llu"), remotePath,
+			nCrc, ullLength, crc.GetCksum(), crc.GetLength());
 		return false;
 	}
 	return true;
 }
 
+void SyncService::RecordTransfer(const TransferStats& stats, bool success, ISyncProgressMonitor* monitor)
+{
+	monitor->OnTelemetry(stats);
+	TransferTelemetry::GetInstance().Record(m_pDevice->GetSerialNumber(), stats, success);
+}
+
 char* SyncService::CreateReq(const char* command, int value, int& len)
 {
 	char* array = new char[SYNC_REQ_LENGTH];
@@ -492,6 +870,35 @@ bool SyncService::CheckResult(char* result, char* code)
 		result[3] != code[3]);
 }
 
+bool SyncService::AppendFileReq(const char* command, const TString path, std::vector<char>& request)
+{
+	const size_t offset = request.size();
+#ifdef _UNICODE
+	// converted in place so a batch does not allocate per path; the length includes the null
+	const int converted = ::WideCharToMultiByte(CP_UTF8, 0, path, -1, NULL, 0, NULL, NULL);
+	request.resize(offset + SYNC_REQ_LENGTH + (std::max)(converted, 1));
+	if (converted > 0)
+	{
+		::WideCharToMultiByte(CP_UTF8, 0, path, -1, request.data() + offset + SYNC_REQ_LENGTH, converted, NULL, NULL);
+	}
+	const int pathLength = converted > 0 ? converted - 1 : 0;
+#else
+	const int pathLength = strlen(path);
+	request.resize(offset + SYNC_REQ_LENGTH + pathLength);
+	memcpy(request.data() + offset + SYNC_REQ_LENGTH, path, pathLength);
+#endif
+	if (pathLength > REMOTE_PATH_MAX_LENGTH)
+	{
+		request.resize(offset);
+		return false;
+	}
+	request.resize(offset + SYNC_REQ_LENGTH + pathLength);
+
+	memcpy(request.data() + offset, command, 4);
+	ArrayHelper::Swap32bitsToArray(pathLength, request.data() + offset, 4);
+	return true;
+}
+
 char* SyncService::GetBuffer()
 {
 	if (m_pBuffer == NULL)
@@ -503,6 +910,49 @@ char* SyncService::GetBuffer()
 	return m_pBuffer;
 }
 
+//////////////////////////////////////////////////////////////////////////
+// implements for FileDataSource
+
+SyncService::FileDataSource::FileDataSource(FileReadWrite& fRead) : m_fRead(fRead)
+{
+}
+
+int SyncService::FileDataSource::ReadData(char* buffer, int size)
+{
+	DWORD dwRead = 0;
+	if (!::ReadFile(m_fRead, buffer, size, &dwRead, NULL))
+	{
+		return -1;
+	}
+	return static_cast<int>(dwRead);
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for FileDataSink
+
+SyncService::FileDataSink::FileDataSink(const TString path) : m_file(path)
+{
+}
+
+SyncService::FileDataSink::~FileDataSink()
+{
+	// close the local file
+	m_fWrite.Close();
+	m_fWrite.Delete();
+}
+
+bool SyncService::FileDataSink::Open()
+{
+	m_fWrite = m_file.GetWrite();
+	return m_fWrite.IsValid() != FALSE;
+}
+
+bool SyncService::FileDataSink::WriteData(const char* data, int length)
+{
+	DWORD dwWrite = 0;
+	return ::WriteFile(m_fWrite, data, length, &dwWrite, NULL) && static_cast<int>(dwWrite) == length;
+}
+
 //////////////////////////////////////////////////////////////////////////
 // implements for FileStat
 
@@ -527,3 +977,37 @@ time_t SyncService::FileStat::GetLastModified() const
 {
 	return m_tLastModified;
 }
+
+//////////////////////////////////////////////////////////////////////////
+// implements for CksumReceiver
+
+SyncService::CksumReceiver::CksumReceiver() : m_bParsed(false), m_nCrc(0), m_ullLength(0)
+{
+}
+
+void SyncService::CksumReceiver::ProcessNewLines(const std::vector<std::string>& vecArray)
+{
+	for (const std::string& line : vecArray)
+	{
+		unsigned long long crc = 0;
+		unsigned long long length = 0;
+		if (!m_bParsed && sscanf(line.c_str(), "%llu %llu", &crc, &length) == 2 && crc <= 0xFFFFFFFFULL)
+		{
+			m_nCrc = static_cast<UINT32>(crc);
+			m_ullLength = length;
+			m_bParsed = true;
+		}
+	}
+}
+
+bool SyncService::CksumReceiver::IsCancelled()
+{
+	return false;
+}
+
+bool SyncService::CksumReceiver::GetResult(UINT32& crc, ULONGLONG& length) const
+{
+	crc = m_nCrc;
+	length = m_ullLength;
+	return m_bParsed;
+}
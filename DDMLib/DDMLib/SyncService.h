@@ -20,8 +20,12 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "CommonDefine.h"
 #include "../System/SocketAddress.h"
+#include "../System/Crc32.h"
 #include "../System/File.h"
 #include "Device.h"
+#include "FileListingService.h"
+#include "MultiLineReceiver.h"
+#include "TransferStats.h"
 
 // define class
 class Device;
@@ -36,6 +40,10 @@ public:
 		virtual bool IsCanceled() = 0;
 		virtual void StartSubTask(const TString name) = 0;
 		virtual void Advance(int work) = 0;
+		// called a few times a second and once at the end of a transfer
+		virtual void OnTelemetry(const TransferStats& stats) {}
+		// wakes a transfer blocked on the socket when cancelled
+		virtual CancellationToken* GetCancellationToken() { return NULL; }
 	};
 
 	struct FileStat
@@ -52,6 +60,27 @@ public:
 		time_t GetLastModified() const;
 	};
 
+	// supplies the bytes of a push, ReadData returns 0 at the end and -1 on error
+	interface IDataSource
+	{
+		virtual int ReadData(char* buffer, int size) = 0;
+	};
+
+	// receives the bytes of a pull, Open is called once the device accepted the request
+	interface IDataSink
+	{
+		virtual bool Open() = 0;
+		virtual bool WriteData(const char* data, int length) = 0;
+	};
+
+	// flat result of StatFiles, a mode of 0 means the path does not exist
+	struct StatEntry
+	{
+		int nMode;
+		int nSize;
+		int nLastModified;
+	};
+
 private:
 	class NullSyncProgressMonitor : public ISyncProgressMonitor
 	{
@@ -62,6 +91,41 @@ private:
 		void Stop() override {}
 	};
 
+	class FileDataSource : public IDataSource
+	{
+	private:
+		FileReadWrite& m_fRead;
+	public:
+		explicit FileDataSource(FileReadWrite& fRead);
+		virtual int ReadData(char* buffer, int size) override;
+	};
+
+	class FileDataSink : public IDataSink
+	{
+	private:
+		File m_file;
+		FileReadWrite m_fWrite;
+	public:
+		explicit FileDataSink(const TString path);
+		~FileDataSink();
+		virtual bool Open() override;
+		virtual bool WriteData(const char* data, int length) override;
+	};
+
+	// parses "<crc> <size> <path>" printed by cksum
+	class CksumReceiver : public MultiLineReceiver
+	{
+	private:
+		bool m_bParsed;
+		UINT32 m_nCrc;
+		ULONGLONG m_ullLength;
+	public:
+		CksumReceiver();
+		virtual void ProcessNewLines(const std::vector<std::string>& vecArray) override;
+		virtual bool IsCancelled() override;
+		bool GetResult(UINT32& crc, ULONGLONG& length) const;
+	};
+
 private:
 	static NullSyncProgressMonitor* const s_pNullSyncProgressMonitor;
 
@@ -76,18 +140,35 @@ public:
 
 	bool OpenSync();
 	void Close();
+	bool Ping();
+	void SetDevice(Device* device);
 
 	static ISyncProgressMonitor* GetNullProgressMonitor();
 
 	bool PushFile(const TString local, const TString remote, ISyncProgressMonitor* monitor);
 	bool PullFile(const TString remote, const TString local, ISyncProgressMonitor* monitor);
+	bool PullFileCompressed(const TString remote, const TString local, int level, ISyncProgressMonitor* monitor);
+	bool PushStream(IDataSource* source, int size, int mode, int lastModified, const TString remote,
+		ISyncProgressMonitor* monitor);
+	bool PullStream(const TString remote, int size, IDataSink* sink, ISyncProgressMonitor* monitor);
 	bool StatFile(const TString path, FileStat** fileStat);
+	bool StatFiles(const std::vector<std::tstring>& paths, std::vector<StatEntry>& results);
+	bool ListDirectory(const TString path, FileListingService::FileEntry* entry);
 
 private:
-	bool DoPushFile(const File& file, const TString remotePath, ISyncProgressMonitor* monitor);
-	bool DoPullFile(const TString remotePath, const TString localPath, ISyncProgressMonitor* monitor);
+	bool DoPushFile(const File& file, const TString remotePath, ISyncProgressMonitor* monitor,
+		TransferStats& stats, Crc32& crc);
+	bool DoPushStream(IDataSource* source, int mode, int lastModified, const TString remotePath,
+		ISyncProgressMonitor* monitor, TransferStats& stats, Crc32& crc);
+	bool DoPullFile(const TString remotePath, const TString localPath, ISyncProgressMonitor* monitor,
+		TransferStats& stats, Crc32& crc);
+	bool DoPullStream(const TString remotePath, IDataSink* sink, ISyncProgressMonitor* monitor,
+		TransferStats& stats, Crc32& crc);
+	bool VerifyChecksum(const TString remotePath, const Crc32& crc);
+	void RecordTransfer(const TransferStats& stats, bool success, ISyncProgressMonitor* monitor);
 	static char* CreateReq(const char* command, int value, int& len);
 	static char* CreateFileReq(const char* command, const TString path, int& len);
+	static bool AppendFileReq(const char* command, const TString path, std::vector<char>& request);
 	static char* CreateSendFileReq(const char* command, const TString path, int mode, int& len);
 	static bool CheckResult(char* result, char* code);
 	char* GetBuffer();
@@ -0,0 +1,315 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SyncSessionManager.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include "Device.h"
+#include "AndroidDebugBridge.h"
+#include "DdmPreferences.h"
+#include "Log.h"
+
+#define SESSION						_T("session")
+
+#define SESSION_IDLE_TIMEOUT_MS		30000	// idle sessions are closed after this
+#define SESSION_CHECK_AFTER_MS		2000	// idle sessions are checked before reuse after this
+#define SESSION_REAP_INTERVAL_MS	5000	// the reaper looks for idle sessions this often
+
+SyncSessionManager SyncSessionManager::s_instance;
+
+SyncSessionManager::SyncSessionManager()
+{
+}
+
+SyncSessionManager::~SyncSessionManager()
+{
+	StopReaper();
+}
+
+SyncSessionManager& SyncSessionManager::GetInstance()
+{
+	return s_instance;
+}
+
+SyncSessionManager::Lease SyncSessionManager::Acquire(Device* device)
+{
+	std::shared_ptr<DevicePool> pPool = GetPool(device->GetSerialNumber());
+	const int nLimit = (std::max)(DdmPreferences::GetSyncSessionLimit(), 1);
+
+	while (true)
+	{
+		Session session = { NULL, 0 };
+		{
+			std::unique_lock<std::mutex> lock(pPool->lock);
+			CloseIdle(*pPool, NowMillis() - SESSION_IDLE_TIMEOUT_MS);
+			while (pPool->vecIdle.empty() && pPool->nOpen >= nLimit)
+			{
+				pPool->cvReleased.wait(lock);
+			}
+			if (pPool->vecIdle.empty())
+			{
+				// open a new one outside of the lock
+				pPool->nOpen++;
+			}
+			else
+			{
+				session = pPool->vecIdle.back();
+				pPool->vecIdle.pop_back();
+			}
+		}
+
+		if (session.pService == NULL)
+		{
+			SyncService* pService = new SyncService(AndroidDebugBridge::GetSocketAddress(), device);
+			if (pService->OpenSync())
+			{
+				LogVEx(SESSION, _T("Opened sync session to '%s'"), device->GetSerialNumber());
+				return Lease(pPool, pService);
+			}
+			delete pService;
+			std::unique_lock<std::mutex> lock(pPool->lock);
+			pPool->nOpen--;
+			pPool->cvReleased.notify_one();
+			return Lease();
+		}
+
+		// the device object of the last user may be gone already
+		session.pService->SetDevice(device);
+		if (NowMillis() - session.llLastUsed < SESSION_CHECK_AFTER_MS || session.pService->Ping())
+		{
+			return Lease(pPool, session.pService);
+		}
+
+		// the connection went stale, drop it and try the next one
+		LogVEx(SESSION, _T("Dropping stale sync session to '%s'"), device->GetSerialNumber());
+		delete session.pService;
+		std::unique_lock<std::mutex> lock(pPool->lock);
+		pPool->nOpen--;
+	}
+}
+
+void SyncSessionManager::CloseSessions(const TString serialNumber)
+{
+	std::shared_ptr<DevicePool> pPool;
+	{
+		std::unique_lock<std::mutex> lock(m_lockPools);
+		auto iter = m_mapPools.find(serialNumber);
+		if (iter == m_mapPools.end())
+		{
+			return;
+		}
+		pPool = iter->second;
+	}
+	// leased sessions are dropped as their users finish with them
+	std::unique_lock<std::mutex> lock(pPool->lock);
+	CloseIdle(*pPool, LLONG_MAX);
+}
+
+void SyncSessionManager::CloseAll()
+{
+	StopReaper();
+	std::vector<std::shared_ptr<DevicePool>> vecPools;
+	{
+		std::unique_lock<std::mutex> lock(m_lockPools);
+		for (auto iter = m_mapPools.begin(); iter != m_mapPools.end(); ++iter)
+		{
+			vecPools.push_back(iter->second);
+		}
+	}
+	for (const std::shared_ptr<DevicePool>& pPool : vecPools)
+	{
+		std::unique_lock<std::mutex> lock(pPool->lock);
+		CloseIdle(*pPool, LLONG_MAX);
+	}
+}
+
+std::shared_ptr<SyncSessionManager::DevicePool> SyncSessionManager::GetPool(const TString serialNumber)
+{
+	std::shared_ptr<DevicePool> pPool;
+	{
+		std::unique_lock<std::mutex> lock(m_lockPools);
+		std::shared_ptr<DevicePool>& pEntry = m_mapPools[serialNumber];
+		if (!pEntry)
+		{
+			pEntry = std::make_shared<DevicePool>();
+		}
+		pPool = pEntry;
+	}
+	StartReaper();
+	return pPool;
+}
+
+void SyncSessionManager::StartReaper()
+{
+	std::unique_lock<std::mutex> lock(m_lockReaper);
+	if (m_threadReaper.joinable())
+	{
+		return;
+	}
+	m_threadReaper = std::thread(&SyncSessionManager::ReapLoop, this, m_nReaperRun);
+}
+
+void SyncSessionManager::StopReaper()
+{
+	std::thread thread;
+	{
+		std::unique_lock<std::mutex> lock(m_lockReaper);
+		if (!m_threadReaper.joinable())
+		{
+			return;
+		}
+		m_nReaperRun++;
+		thread = std::move(m_threadReaper);
+		m_cvReaper.notify_all();
+	}
+	thread.join();
+}
+
+void SyncSessionManager::ReapLoop(unsigned int run)
+{
+	std::unique_lock<std::mutex> lock(m_lockReaper);
+	while (true)
+	{
+		m_cvReaper.wait_for(lock, std::chrono::milliseconds(SESSION_REAP_INTERVAL_MS));
+		if (run != m_nReaperRun)
+		{
+			return;
+		}
+		lock.unlock();
+
+		std::vector<std::shared_ptr<DevicePool>> vecPools;
+		{
+			std::unique_lock<std::mutex> lockPools(m_lockPools);
+			for (auto iter = m_mapPools.begin(); iter != m_mapPools.end(); ++iter)
+			{
+				vecPools.push_back(iter->second);
+			}
+		}
+		for (const std::shared_ptr<DevicePool>& pPool : vecPools)
+		{
+			std::unique_lock<std::mutex> lockPool(pPool->lock);
+			CloseIdle(*pPool, NowMillis() - SESSION_IDLE_TIMEOUT_MS);
+		}
+		lock.lock();
+	}
+}
+
+void SyncSessionManager::CloseIdle(DevicePool& pool, long long llIdleBefore)
+{
+	// lock pool outside
+	for (auto iter = pool.vecIdle.begin(); iter != pool.vecIdle.end(); )
+	{
+		if (iter->llLastUsed < llIdleBefore)
+		{
+			delete iter->pService;
+			pool.nOpen--;
+			iter = pool.vecIdle.erase(iter);
+			pool.cvReleased.notify_one();
+		}
+		else
+		{
+			++iter;
+		}
+	}
+}
+
+long long SyncSessionManager::NowMillis()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for Lease
+
+SyncSessionManager::Lease::Lease() : m_pService(NULL), m_bFailed(false)
+{
+}
+
+SyncSessionManager::Lease::Lease(std::shared_ptr<DevicePool> pool, SyncService* service) :
+	m_pPool(pool), m_pService(service), m_bFailed(false)
+{
+}
+
+SyncSessionManager::Lease::Lease(Lease&& other) :
+	m_pPool(std::move(other.m_pPool)), m_pService(other.m_pService), m_bFailed(other.m_bFailed)
+{
+	other.m_pService = NULL;
+}
+
+SyncSessionManager::Lease::~Lease()
+{
+	Release();
+}
+
+SyncSessionManager::Lease& SyncSessionManager::Lease::operator=(Lease&& other)
+{
+	if (this != &other)
+	{
+		Release();
+		m_pPool = std::move(other.m_pPool);
+		m_pService = other.m_pService;
+		m_bFailed = other.m_bFailed;
+		other.m_pService = NULL;
+	}
+	return *this;
+}
+
+SyncService* SyncSessionManager::Lease::operator->() const
+{
+	return m_pService;
+}
+
+SyncService* SyncSessionManager::Lease::Get() const
+{
+	return m_pService;
+}
+
+SyncSessionManager::Lease::operator bool() const
+{
+	return m_pService != NULL;
+}
+
+void SyncSessionManager::Lease::SetFailed()
+{
+	m_bFailed = true;
+}
+
+void SyncSessionManager::Lease::Release()
+{
+	if (m_pService == NULL)
+	{
+		return;
+	}
+	// a failed transfer may leave the sync stream mid-packet, never reuse it
+	std::unique_lock<std::mutex> lock(m_pPool->lock);
+	if (m_bFailed)
+	{
+		delete m_pService;
+		m_pPool->nOpen--;
+	}
+	else
+	{
+		Session session = { m_pService, NowMillis() };
+		m_pPool->vecIdle.push_back(session);
+	}
+	m_pPool->cvReleased.notify_one();
+	m_pService = NULL;
+	m_pPool.reset();
+}
@@ -0,0 +1,112 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonDefine.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "SyncService.h"
+
+// define class
+class Device;
+
+/**
+ * Keeps sync connections open between transfers so each one does not pay
+ * for the connect, transport switch and sync: handshake again. Sessions
+ * are pooled per device serial; callers beyond the per device limit wait
+ * for a session to be released. A reaper thread closes sessions that
+ * stay idle, it runs once a pool exists and stops in CloseAll.
+ */
+class SyncSessionManager
+{
+private:
+	struct Session
+	{
+		SyncService* pService;
+		long long llLastUsed;
+	};
+
+	struct DevicePool
+	{
+		std::mutex lock;
+		std::condition_variable cvReleased;
+		std::vector<Session> vecIdle;	// most recently used last
+		int nOpen = 0;
+	};
+
+public:
+	/**
+	 * Exclusive use of one session, returned to the pool when destroyed.
+	 * Mark it failed after an error so the connection is dropped instead.
+	 */
+	class Lease
+	{
+	private:
+		std::shared_ptr<DevicePool> m_pPool;
+		SyncService* m_pService;
+		bool m_bFailed;
+
+	public:
+		Lease();
+		Lease(std::shared_ptr<DevicePool> pool, SyncService* service);
+		Lease(Lease&& other);
+		~Lease();
+		Lease& operator=(Lease&& other);
+
+		SyncService* operator->() const;
+		SyncService* Get() const;
+		explicit operator bool() const;
+		void SetFailed();
+
+	private:
+		Lease(const Lease&) = delete;
+		Lease& operator=(const Lease&) = delete;
+		void Release();
+	};
+
+private:
+	static SyncSessionManager s_instance;
+
+	std::mutex m_lockPools;
+	std::map<std::tstring, std::shared_ptr<DevicePool>> m_mapPools;
+	std::mutex m_lockReaper;
+	std::condition_variable m_cvReaper;
+	std::thread m_threadReaper;
+	unsigned int m_nReaperRun = 0;	// bumped to stop the running reaper
+
+private:
+	SyncSessionManager();
+
+public:
+	~SyncSessionManager();
+	static SyncSessionManager& GetInstance();
+
+	Lease Acquire(Device* device);
+	void CloseSessions(const TString serialNumber);
+	void CloseAll();
+
+private:
+	std::shared_ptr<DevicePool> GetPool(const TString serialNumber);
+	void StartReaper();
+	void StopReaper();
+	void ReapLoop(unsigned int run);
+	static void CloseIdle(DevicePool& pool, long long llIdleBefore);
+	static long long NowMillis();
+};
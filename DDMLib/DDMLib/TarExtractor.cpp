@@ -0,0 +1,323 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TarExtractor.h"
+#include <algorithm>
+#include "Log.h"
+#include "../System/File.h"
+
+#define TAR							_T("tar")
+
+#define TAR_JOB_SIZE				256*1024	// large files are handed to their worker in pieces of this
+
+TarExtractor::TarExtractor(const TString localDirectory, SyncService::ISyncProgressMonitor* monitor, int workers,
+	size_t maxQueuedBytes) :
+	m_strRoot(localDirectory),
+	m_pMonitor(monitor),
+	m_nMaxQueued(maxQueuedBytes),
+	m_reader(this),
+	m_nQueued(0),
+	m_bStop(false),
+	m_bError(false),
+	m_nWorker(0),
+	m_bSkipEntry(true),
+	m_nFiles(0)
+{
+	m_jobPending.bClose = false;
+	m_jobPending.tModified = 0;
+	if (!EnsureDirectory(m_strRoot))
+	{
+		LogEEx(TAR, _T("Unable to create %s"), m_strRoot.c_str());
+		m_bError = true;
+	}
+	m_vecWorkers.resize((std::max)(workers, 1));
+	for (size_t i = 0; i < m_vecWorkers.size(); i++)
+	{
+		m_vecWorkers[i].thread = std::thread(&TarExtractor::Run, this, static_cast<int>(i));
+	}
+}
+
+TarExtractor::~TarExtractor()
+{
+	Stop();
+}
+
+void TarExtractor::AddOutput(char* pData, int offset, int length)
+{
+	if (IsCancelled())
+	{
+		return;
+	}
+	if (!m_reader.Feed(pData + offset, length))
+	{
+		if (!m_bError)
+		{
+			LogE(TAR, _T("Malformed tar stream"));
+		}
+		m_bError = true;
+		return;
+	}
+	m_pMonitor->Advance(length);
+}
+
+void TarExtractor::Flush()
+{
+}
+
+bool TarExtractor::IsCancelled()
+{
+	return m_bError || m_pMonitor->IsCanceled();
+}
+
+bool TarExtractor::Finish()
+{
+	Stop();
+	return !m_bError && m_reader.IsFinished();
+}
+
+int TarExtractor::GetFileCount() const
+{
+	return m_nFiles;
+}
+
+bool TarExtractor::OnEntry(const TarReader::TarEntry& entry)
+{
+	m_bSkipEntry = true;
+	std::tstring localPath;
+	if (!ToLocalPath(entry.strName, localPath))
+	{
+		// never write outside of the target directory
+		LogWEx(TAR, _T("Skipping unsafe entry in tar stream (%d bytes)"), static_cast<int>(entry.strName.size()));
+		return true;
+	}
+
+	if (entry.chType == TAR_TYPE_DIRECTORY)
+	{
+		return EnsureDirectory(localPath);
+	}
+	if (entry.chType != TAR_TYPE_FILE && entry.chType != TAR_TYPE_OLD_FILE && entry.chType != TAR_TYPE_CONTIGUOUS)
+	{
+		LogWEx(TAR, _T("Skipping %s, only files and directories are extracted"), localPath.c_str());
+		return true;
+	}
+
+	const size_t pos = localPath.find_last_of(_T('\\'));
+	if (pos != std::tstring::npos && !EnsureDirectory(localPath.substr(0, pos)))
+	{
+		return false;
+	}
+	m_jobPending.strPath = localPath;
+	m_jobPending.vecData.clear();
+	m_jobPending.bClose = false;
+	m_jobPending.tModified = entry.tModified;
+	m_nWorker = m_nFiles++ % static_cast<int>(m_vecWorkers.size());
+	m_bSkipEntry = false;
+	return true;
+}
+
+bool TarExtractor::OnData(const char* data, int length)
+{
+	if (m_bSkipEntry)
+	{
+		return true;
+	}
+	m_jobPending.vecData.insert(m_jobPending.vecData.end(), data, data + length);
+	if (m_jobPending.vecData.size() >= TAR_JOB_SIZE)
+	{
+		Submit();
+	}
+	return !m_bError;
+}
+
+bool TarExtractor::OnEntryEnd()
+{
+	if (m_bSkipEntry)
+	{
+		return true;
+	}
+	m_jobPending.bClose = true;
+	Submit();
+	m_bSkipEntry = true;
+	return !m_bError;
+}
+
+bool TarExtractor::ToLocalPath(const std::string& name, std::tstring& localPath)
+{
+	localPath = m_strRoot;
+	size_t start = 0;
+	while (start <= name.size())
+	{
+		size_t end = name.find('/', start);
+		if (end == std::string::npos)
+		{
+			end = name.size();
+		}
+		const std::string segment = name.substr(start, end - start);
+		start = end + 1;
+		if (segment.empty() || segment == ".")
+		{
+			continue;
+		}
+		if (segment == ".." || segment.find_first_of(":\\") != std::string::npos)
+		{
+			return false;
+		}
+#ifdef _UNICODE
+		const int length = ::MultiByteToWideChar(CP_UTF8, 0, segment.c_str(), static_cast<int>(segment.size()), NULL, 0);
+		if (length <= 0)
+		{
+			return false;
+		}
+		std::wstring wide(length, L'\0');
+		::MultiByteToWideChar(CP_UTF8, 0, segment.c_str(), static_cast<int>(segment.size()), &wide[0], length);
+		localPath.append(_T("\\")).append(wide);
+#else
+		localPath.append(_T("\\")).append(segment);
+#endif
+	}
+	return true;
+}
+
+bool TarExtractor::EnsureDirectory(const std::tstring& path)
+{
+	if (m_setDirectories.find(path) != m_setDirectories.end())
+	{
+		return true;
+	}
+	if (!File(path.c_str()).MakeDirectories())
+	{
+		LogEEx(TAR, _T("Unable to create %s"), path.c_str());
+		m_bError = true;
+		return false;
+	}
+	m_setDirectories.insert(path);
+	return true;
+}
+
+void TarExtractor::Submit()
+{
+	Job job = std::move(m_jobPending);
+	m_jobPending.strPath.clear();
+	m_jobPending.vecData.clear();
+	m_jobPending.bClose = false;
+	m_jobPending.tModified = job.tModified;
+
+	// wait for the workers to catch up before queueing more
+	const size_t size = job.vecData.size();
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_cvSpace.wait(lock, [&]()
+	{
+		return m_bError || m_nQueued == 0 || m_nQueued + size <= m_nMaxQueued;
+	});
+	if (m_bError)
+	{
+		return;
+	}
+	m_nQueued += size;
+	m_vecWorkers[m_nWorker].deqJobs.push_back(std::move(job));
+	m_cvJobs.notify_all();
+}
+
+void TarExtractor::Stop()
+{
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_bStop = true;
+		m_cvJobs.notify_all();
+	}
+	for (Worker& worker : m_vecWorkers)
+	{
+		if (worker.thread.joinable())
+		{
+			worker.thread.join();
+		}
+	}
+}
+
+void TarExtractor::Run(int index)
+{
+	Worker& worker = m_vecWorkers[index];
+	FileReadWrite fWrite;
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_cvJobs.wait(lock, [&]()
+			{
+				return m_bStop || !worker.deqJobs.empty();
+			});
+			if (worker.deqJobs.empty())
+			{
+				break;
+			}
+			job = std::move(worker.deqJobs.front());
+			worker.deqJobs.pop_front();
+		}
+
+		const size_t size = job.vecData.size();
+		if (!m_bError && !Process(job, fWrite))
+		{
+			m_bError = true;
+		}
+
+		std::unique_lock<std::mutex> lock(m_lock);
+		m_nQueued -= size;
+		m_cvSpace.notify_all();
+	}
+
+	// the stream ended in the middle of a file
+	fWrite.Close();
+	fWrite.Delete();
+}
+
+bool TarExtractor::Process(Job& job, FileReadWrite& fWrite)
+{
+	if (!job.strPath.empty())
+	{
+		fWrite.Close();
+		fWrite.Delete();
+		fWrite = File(job.strPath.c_str()).GetWrite();
+		if (!fWrite.IsValid())
+		{
+			LogEEx(TAR, _T("Unable to write %s"), job.strPath.c_str());
+			return false;
+		}
+	}
+
+	size_t offset = 0;
+	while (offset < job.vecData.size())
+	{
+		DWORD dwWrite = 0;
+		if (!::WriteFile(fWrite, job.vecData.data() + offset, static_cast<DWORD>(job.vecData.size() - offset),
+			&dwWrite, NULL))
+		{
+			LogE(TAR, _T("Write failed while extracting"));
+			return false;
+		}
+		offset += dwWrite;
+	}
+
+	if (job.bClose)
+	{
+		File::SetLastModifiedTime(fWrite, job.tModified);
+		fWrite.Close();
+		fWrite.Delete();
+	}
+	return true;
+}
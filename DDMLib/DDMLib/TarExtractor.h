@@ -0,0 +1,100 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonDefine.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include "IShellOutputReceiver.h"
+#include "SyncService.h"
+#include "TarReader.h"
+
+/**
+ * Receives a tar stream and extracts it below a local directory while it
+ * arrives. Directories are created in stream order; file contents are
+ * written by a small pool of workers, every file sticking to one worker
+ * so its chunks stay in order. Queued data is capped, the stream stalls
+ * when the disk cannot keep up.
+ */
+class TarExtractor : public IShellOutputReceiver, private TarReader::ITarHandler
+{
+private:
+	struct Job
+	{
+		std::tstring strPath;	// set on the first job of a file
+		std::vector<char> vecData;
+		bool bClose;
+		time_t tModified;
+	};
+
+	struct Worker
+	{
+		std::thread thread;
+		std::deque<Job> deqJobs;
+	};
+
+private:
+	const std::tstring m_strRoot;
+	SyncService::ISyncProgressMonitor* m_pMonitor;
+	const size_t m_nMaxQueued;
+	TarReader m_reader;
+
+	std::mutex m_lock;
+	std::condition_variable m_cvJobs;
+	std::condition_variable m_cvSpace;
+	std::vector<Worker> m_vecWorkers;
+	size_t m_nQueued;
+	bool m_bStop;
+	std::atomic<bool> m_bError;
+
+	// state of the entry being parsed, producer side only
+	std::set<std::tstring> m_setDirectories;
+	Job m_jobPending;
+	int m_nWorker;
+	bool m_bSkipEntry;
+	int m_nFiles;
+
+public:
+	TarExtractor(const TString localDirectory, SyncService::ISyncProgressMonitor* monitor, int workers,
+		size_t maxQueuedBytes);
+	~TarExtractor();
+
+	virtual void AddOutput(char* pData, int offset, int length) override;
+	virtual void Flush() override;
+	virtual bool IsCancelled() override;
+
+	bool Finish();
+	int GetFileCount() const;
+
+private:
+	virtual bool OnEntry(const TarReader::TarEntry& entry) override;
+	virtual bool OnData(const char* data, int length) override;
+	virtual bool OnEntryEnd() override;
+
+	bool ToLocalPath(const std::string& name, std::tstring& localPath);
+	bool EnsureDirectory(const std::tstring& path);
+	void Submit();
+	void Stop();
+	void Run(int index);
+	bool Process(Job& job, FileReadWrite& fWrite);
+};
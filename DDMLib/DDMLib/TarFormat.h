@@ -0,0 +1,48 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// POSIX ustar layout shared by TarWriter and TarReader
+#define TAR_BLOCK_SIZE				512
+#define TAR_NAME_LENGTH			100
+#define TAR_PREFIX_LENGTH			155
+#define TAR_LONG_NAME				"././@LongLink"
+#define TAR_MAGIC					"ustar"
+
+#define TAR_TYPE_FILE				'0'
+#define TAR_TYPE_OLD_FILE			'\0'
+#define TAR_TYPE_LINK				'1'
+#define TAR_TYPE_SYMLINK			'2'
+#define TAR_TYPE_DIRECTORY			'5'
+#define TAR_TYPE_CONTIGUOUS		'7'
+#define TAR_TYPE_LONG_NAME			'L'
+#define TAR_TYPE_PAX				'x'
+#define TAR_TYPE_PAX_GLOBAL		'g'
+
+// header field offsets
+#define TAR_MODE_OFFSET			100
+#define TAR_UID_OFFSET				108
+#define TAR_GID_OFFSET				116
+#define TAR_SIZE_OFFSET			124
+#define TAR_MTIME_OFFSET			136
+#define TAR_CHKSUM_OFFSET			148
+#define TAR_TYPE_OFFSET			156
+#define TAR_MAGIC_OFFSET			257
+#define TAR_VERSION_OFFSET			263
+#define TAR_PREFIX_OFFSET			345
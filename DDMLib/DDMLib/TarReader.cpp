@@ -0,0 +1,304 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TarReader.h"
+#include <algorithm>
+
+TarReader::TarReader(ITarHandler* handler) : m_pHandler(handler)
+{
+	m_emState = HEADER;
+	m_nHeaderLength = 0;
+	m_llRemain = 0;
+	m_llPadding = 0;
+	m_llPaxSize = -1;
+}
+
+bool TarReader::Feed(const char* data, int length)
+{
+	while (length > 0)
+	{
+		switch (m_emState)
+		{
+		case HEADER:
+		{
+			const int count = (std::min)(length, TAR_BLOCK_SIZE - m_nHeaderLength);
+			memcpy(m_szHeader + m_nHeaderLength, data, count);
+			m_nHeaderLength += count;
+			data += count;
+			length -= count;
+			if (m_nHeaderLength == TAR_BLOCK_SIZE)
+			{
+				m_nHeaderLength = 0;
+				if (!ParseHeader())
+				{
+					m_emState = FAILED;
+				}
+			}
+			break;
+		}
+		case DATA:
+		case LONG_NAME:
+		case PAX:
+		case SKIP:
+		{
+			if (m_llRemain > 0)
+			{
+				const int count = static_cast<int>((std::min)(static_cast<long long>(length), m_llRemain));
+				if (m_emState == DATA)
+				{
+					if (!m_pHandler->OnData(data, count))
+					{
+						m_emState = FAILED;
+						break;
+					}
+				}
+				else if (m_emState != SKIP)
+				{
+					m_strMeta.append(data, count);
+				}
+				data += count;
+				length -= count;
+				m_llRemain -= count;
+				if (m_llRemain > 0)
+				{
+					break;
+				}
+				if (m_emState == DATA && !m_pHandler->OnEntryEnd())
+				{
+					m_emState = FAILED;
+					break;
+				}
+				if (m_emState == LONG_NAME)
+				{
+					// stored with its terminating NUL
+					m_strLongName.assign(m_strMeta.c_str());
+				}
+				else if (m_emState == PAX)
+				{
+					ParsePax();
+				}
+			}
+			const int skip = static_cast<int>((std::min)(static_cast<long long>(length), m_llPadding));
+			data += skip;
+			length -= skip;
+			m_llPadding -= skip;
+			if (m_llPadding == 0)
+			{
+				m_emState = HEADER;
+			}
+			break;
+		}
+		case FINISHED:
+			// anything after the end of archive is record padding
+			return true;
+		case FAILED:
+		default:
+			return false;
+		}
+	}
+	return m_emState != FAILED;
+}
+
+bool TarReader::IsFinished() const
+{
+	return m_emState == FINISHED;
+}
+
+bool TarReader::IsFailed() const
+{
+	return m_emState == FAILED;
+}
+
+bool TarReader::ParseHeader()
+{
+	if (IsZeroBlock(m_szHeader))
+	{
+		m_emState = FINISHED;
+		return true;
+	}
+
+	// the checksum is computed with its own field filled with spaces
+	unsigned int checksum = 0;
+	for (int i = 0; i < TAR_BLOCK_SIZE; i++)
+	{
+		const bool inField = i >= TAR_CHKSUM_OFFSET && i < TAR_CHKSUM_OFFSET + 8;
+		checksum += inField ? ' ' : static_cast<unsigned char>(m_szHeader[i]);
+	}
+	if (static_cast<long long>(checksum) != ParseNumber(m_szHeader + TAR_CHKSUM_OFFSET, 8))
+	{
+		return false;
+	}
+
+	const char type = m_szHeader[TAR_TYPE_OFFSET];
+	long long size = ParseNumber(m_szHeader + TAR_SIZE_OFFSET, 12);
+	if (size < 0)
+	{
+		return false;
+	}
+	switch (type)
+	{
+	case TAR_TYPE_LONG_NAME:
+		m_strMeta.clear();
+		BeginPayload(LONG_NAME, size);
+		return true;
+	case TAR_TYPE_PAX:
+		m_strMeta.clear();
+		BeginPayload(PAX, size);
+		return true;
+	case TAR_TYPE_PAX_GLOBAL:
+		BeginPayload(SKIP, size);
+		return true;
+	default:
+		break;
+	}
+
+	TarEntry& entry = m_entry;
+	if (!m_strLongName.empty())
+	{
+		entry.strName = m_strLongName;
+	}
+	else
+	{
+		entry.strName.clear();
+		const size_t nameLength = strnlen(m_szHeader, TAR_NAME_LENGTH);
+		if (memcmp(m_szHeader + TAR_MAGIC_OFFSET, TAR_MAGIC, 5) == 0 && m_szHeader[TAR_PREFIX_OFFSET] != '\0')
+		{
+			entry.strName.assign(m_szHeader + TAR_PREFIX_OFFSET,
+				strnlen(m_szHeader + TAR_PREFIX_OFFSET, TAR_PREFIX_LENGTH));
+			entry.strName.push_back('/');
+		}
+		entry.strName.append(m_szHeader, nameLength);
+	}
+	m_strLongName.clear();
+	if (m_llPaxSize >= 0)
+	{
+		size = m_llPaxSize;
+		m_llPaxSize = -1;
+	}
+	while (entry.strName.compare(0, 2, "./") == 0)
+	{
+		entry.strName.erase(0, 2);
+	}
+	entry.chType = type;
+	entry.nMode = static_cast<int>(ParseNumber(m_szHeader + TAR_MODE_OFFSET, 8));
+	entry.llSize = size;
+	entry.tModified = static_cast<time_t>(ParseNumber(m_szHeader + TAR_MTIME_OFFSET, 12));
+
+	// only regular files carry data, links and directories record a size of 0
+	const bool isFile = type == TAR_TYPE_FILE || type == TAR_TYPE_OLD_FILE || type == TAR_TYPE_CONTIGUOUS;
+	if (!isFile)
+	{
+		entry.llSize = 0;
+		if (!m_pHandler->OnEntry(entry))
+		{
+			return false;
+		}
+		BeginPayload(SKIP, type == TAR_TYPE_DIRECTORY || type == TAR_TYPE_LINK || type == TAR_TYPE_SYMLINK ? 0 : size);
+		return true;
+	}
+	if (!m_pHandler->OnEntry(entry))
+	{
+		return false;
+	}
+	if (size == 0)
+	{
+		return m_pHandler->OnEntryEnd();
+	}
+	BeginPayload(DATA, size);
+	return true;
+}
+
+void TarReader::ParsePax()
+{
+	// records are "<length> <key>=<value>\n"
+	size_t pos = 0;
+	while (pos < m_strMeta.size())
+	{
+		char* end = NULL;
+		const long length = strtol(m_strMeta.c_str() + pos, &end, 10);
+		if (length <= 0 || pos + length > m_strMeta.size() || *end != ' ')
+		{
+			break;
+		}
+		const size_t keyStart = end + 1 - m_strMeta.c_str();
+		const size_t recordEnd = pos + length - 1;	// the newline
+		const size_t equals = m_strMeta.find('=', keyStart);
+		if (equals != std::string::npos && equals < recordEnd)
+		{
+			const std::string key = m_strMeta.substr(keyStart, equals - keyStart);
+			const std::string value = m_strMeta.substr(equals + 1, recordEnd - equals - 1);
+			if (key == "path")
+			{
+				m_strLongName = value;
+			}
+			else if (key == "size")
+			{
+				m_llPaxSize = strtoll(value.c_str(), NULL, 10);
+			}
+		}
+		pos += length;
+	}
+}
+
+void TarReader::BeginPayload(State state, long long size)
+{
+	m_emState = state;
+	m_llRemain = size;
+	m_llPadding = (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE - size;
+	if (m_llRemain == 0 && m_llPadding == 0)
+	{
+		m_emState = HEADER;
+	}
+}
+
+bool TarReader::IsZeroBlock(const char* block)
+{
+	for (int i = 0; i < TAR_BLOCK_SIZE; i++)
+	{
+		if (block[i] != '\0')
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+long long TarReader::ParseNumber(const char* field, int length)
+{
+	// GNU base-256 for values too large for octal
+	if (static_cast<unsigned char>(field[0]) & 0x80)
+	{
+		long long value = field[0] & 0x7F;
+		for (int i = 1; i < length; i++)
+		{
+			value = (value << 8) | static_cast<unsigned char>(field[i]);
+		}
+		return value;
+	}
+	long long value = 0;
+	int i = 0;
+	while (i < length && (field[i] == ' ' || field[i] == '\0'))
+	{
+		i++;
+	}
+	for (; i < length && field[i] >= '0' && field[i] <= '7'; i++)
+	{
+		value = (value << 3) | (field[i] - '0');
+	}
+	return value;
+}
@@ -0,0 +1,86 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonDefine.h"
+#include "TarFormat.h"
+
+/**
+ * Incremental ustar parser. Bytes are fed as they arrive off the wire in
+ * chunks of any size; entries and their contents are handed to a handler
+ * without buffering whole files. GNU long names and pax path/size
+ * records are understood.
+ */
+class TarReader
+{
+public:
+	struct TarEntry
+	{
+		std::string strName;	// utf-8, '/' separated, leading "./" removed
+		char chType;
+		int nMode;
+		long long llSize;
+		time_t tModified;
+	};
+
+	interface ITarHandler
+	{
+		virtual bool OnEntry(const TarEntry& entry) = 0;
+		virtual bool OnData(const char* data, int length) = 0;
+		virtual bool OnEntryEnd() = 0;
+	};
+
+private:
+	enum State
+	{
+		HEADER,
+		DATA,
+		LONG_NAME,
+		PAX,
+		SKIP,
+		FINISHED,
+		FAILED
+	};
+
+private:
+	ITarHandler* m_pHandler;
+	State m_emState;
+	char m_szHeader[TAR_BLOCK_SIZE];
+	int m_nHeaderLength;
+	long long m_llRemain;		// bytes of the current payload still to come
+	long long m_llPadding;		// bytes of block padding after it
+	std::string m_strMeta;		// long name or pax records being collected
+	std::string m_strLongName;
+	long long m_llPaxSize;
+	TarEntry m_entry;
+
+public:
+	explicit TarReader(ITarHandler* handler);
+
+	bool Feed(const char* data, int length);
+	bool IsFinished() const;
+	bool IsFailed() const;
+
+private:
+	bool ParseHeader();
+	void ParsePax();
+	void BeginPayload(State state, long long size);
+	static bool IsZeroBlock(const char* block);
+	static long long ParseNumber(const char* field, int length);
+};
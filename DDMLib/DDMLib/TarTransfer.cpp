@@ -0,0 +1,349 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TarTransfer.h"
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <thread>
+#include "Device.h"
+#include "AndroidDebugBridge.h"
+#include "AdbHelper.h"
+#include "DdmPreferences.h"
+#include "Log.h"
+#include "StringUtils.h"
+#include "SyncSessionManager.h"
+#include "TarExtractor.h"
+#include "TarWriter.h"
+#include "../System/File.h"
+#include "../System/Pipe.h"
+#include "../System/StreamReader.h"
+
+#define TAR_TRANSFER				_T("tar")
+
+#define TAR_PIPE_SIZE				1024*1024	// lets packing run ahead of the socket
+#define TAR_READ_SIZE				64*1024
+#define TAR_TIMEOUT_MS				60000
+#define TAR_STATUS_TAG				"tar-status:"
+#define TAR_STATUS_COMMAND			_T("; echo tar-status:$?")
+#define TAR_STATUS_FILE			_T("/data/local/tmp/.tar-status-")
+#define TAR_CHECK_COMMAND			_T("command -v tar >/dev/null 2>&1; echo tar-status:$?")
+#define TAR_MAX_WORKERS			4
+#define TAR_MAX_QUEUED				16*1024*1024	// extracted data waiting for the disk
+
+TarTransfer::TarTransfer(Device* device) : m_pDevice(device)
+{
+}
+
+bool TarTransfer::PushDirectory(const TString localDirectory, const TString remoteDirectory,
+	SyncService::ISyncProgressMonitor* monitor)
+{
+	TarWriter writer;
+	if (!writer.AddDirectory(localDirectory))
+	{
+		LogEEx(TAR_TRANSFER, _T("Unable to scan %s"), localDirectory);
+		return false;
+	}
+	const long long size = writer.GetArchiveSize();
+	LogDEx(TAR_TRANSFER, _T("Packing %d entries (%lld bytes) from %s onto device '%s'"),
+		writer.GetFileCount(), size, localDirectory, m_pDevice->GetSerialNumber());
+
+	Pipe pipe;
+	if (!pipe.Open(TAR_PIPE_SIZE))
+	{
+		return false;
+	}
+
+	// pack on a thread while this one feeds the pipe into the socket
+	std::atomic<bool> cancelled(false);
+	bool bPacked = false;
+	std::thread packer([&]()
+	{
+		bPacked = writer.Write(pipe.GetWrite(), cancelled);
+		pipe.CloseWrite();
+	});
+
+	// head stops reading at the end of the archive, so tar exits without
+	// waiting for an end of input the exec channel cannot signal
+	std::tstring quotedRemote;
+	StringUtils::QuoteShellArgument(remoteDirectory, quotedRemote);
+	std::tostringstream oss;
+	oss << _T("mkdir -p ") << quotedRemote << _T(" 2>&1; head -c ") << size
+		<< _T(" | tar -xf - -C ") << quotedRemote << _T(" 2>&1") << TAR_STATUS_COMMAND;
+
+	monitor->Start(static_cast<int>((std::min)(size, static_cast<long long>(INT_MAX))));
+	StatusReceiver receiver(monitor);
+	CharStreamReader reader(pipe.GetRead(), TAR_READ_SIZE);
+	int nRet = AdbHelper::ExecuteRemoteCommand(AndroidDebugBridge::GetSocketAddress(), AdbHelper::EXEC,
+		oss.str().c_str(), m_pDevice, &receiver, TAR_TIMEOUT_MS, &reader, monitor);
+
+	// unblock the packer if the channel gave up early
+	cancelled = true;
+	pipe.CloseRead();
+	packer.join();
+	monitor->Stop();
+
+	if (nRet != 0 || !bPacked || receiver.GetStatus() != 0)
+	{
+		LogEEx(TAR_TRANSFER, _T("Unable to push %s to %s"), localDirectory, remoteDirectory);
+		LogOutput(receiver);
+		return false;
+	}
+	return true;
+}
+
+bool TarTransfer::PullDirectory(const TString remoteDirectory, const TString localDirectory,
+	SyncService::ISyncProgressMonitor* monitor)
+{
+	if (!HasTar())
+	{
+		LogDEx(TAR_TRANSFER, _T("No tar on device '%s', pulling file by file"), m_pDevice->GetSerialNumber());
+		return PullDirectoryBySync(remoteDirectory, localDirectory, monitor);
+	}
+
+	// stderr shares the raw exec stream, keep it out of the archive; so does the exit
+	// status, tar still writes a valid archive when it skips a file it cannot read
+	static std::atomic<int> s_nPulls(0);
+	std::tostringstream ossStatus;
+	ossStatus << TAR_STATUS_FILE << ::GetCurrentProcessId() << _T("-") << ++s_nPulls;
+	const std::tstring statusFile = ossStatus.str();
+	std::tstring quotedRemote;
+	StringUtils::QuoteShellArgument(remoteDirectory, quotedRemote);
+	std::tostringstream oss;
+	oss << _T("tar -cf - -C ") << quotedRemote << _T(" . 2>/dev/null; echo $? >") << statusFile;
+
+	const unsigned int cores = std::thread::hardware_concurrency();
+	const int workers = static_cast<int>((std::max)(1u, (std::min)(cores, static_cast<unsigned int>(TAR_MAX_WORKERS))));
+	monitor->Start(0);
+	TarExtractor extractor(localDirectory, monitor, workers, TAR_MAX_QUEUED);
+	int nRet = AdbHelper::ExecuteRemoteCommand(AndroidDebugBridge::GetSocketAddress(), AdbHelper::EXEC,
+		oss.str().c_str(), m_pDevice, &extractor, TAR_TIMEOUT_MS, NULL);
+	bool bRet = extractor.Finish() && nRet == 0;
+	monitor->Stop();
+
+	// a missing status file counts as a failure too
+	std::tostringstream ossRead;
+	ossRead << _T("echo tar-status:$(cat ") << statusFile << _T(" 2>/dev/null || echo 255); rm -f ") << statusFile;
+	StatusReceiver statusReceiver(SyncService::GetNullProgressMonitor());
+	m_pDevice->ExecuteShellCommand(ossRead.str().c_str(), &statusReceiver, DdmPreferences::GetTimeOut());
+
+	if (!bRet)
+	{
+		LogEEx(TAR_TRANSFER, _T("Unable to pull %s to %s"), remoteDirectory, localDirectory);
+		return false;
+	}
+	if (statusReceiver.GetStatus() != 0)
+	{
+		LogWEx(TAR_TRANSFER, _T("tar on device '%s' exited with %d, pulling file by file"),
+			m_pDevice->GetSerialNumber(), statusReceiver.GetStatus());
+		return PullDirectoryBySync(remoteDirectory, localDirectory, monitor);
+	}
+	LogDEx(TAR_TRANSFER, _T("Extracted %d files from device '%s'"), extractor.GetFileCount(),
+		m_pDevice->GetSerialNumber());
+	return true;
+}
+
+bool TarTransfer::HasTar()
+{
+	StatusReceiver receiver(SyncService::GetNullProgressMonitor());
+	int nRet = m_pDevice->ExecuteShellCommand(TAR_CHECK_COMMAND, &receiver, DdmPreferences::GetTimeOut());
+	return nRet == 0 && receiver.GetStatus() == 0;
+}
+
+bool TarTransfer::PullDirectoryBySync(const TString remoteDirectory, const TString localDirectory,
+	SyncService::ISyncProgressMonitor* monitor)
+{
+	// walk down to the directory, then collect every file below it
+	FileListingService listing(m_pDevice);
+	FileListingService::FileEntry* entry = listing.GetRoot();
+	std::string path;
+#ifdef _UNICODE
+	ConvertUtils::WstringToString(remoteDirectory, path);
+#else
+	path = remoteDirectory;
+#endif
+	std::istringstream iss(path);
+	std::string segment;
+	while (entry != NULL && std::getline(iss, segment, '/'))
+	{
+		if (segment.empty())
+		{
+			continue;
+		}
+		std::vector<FileListingService::FileEntry*> vecChildren;
+		if (!listing.GetChildren(entry, true, vecChildren))
+		{
+			return false;
+		}
+		entry = entry->FindChild(segment.c_str());
+	}
+	if (entry == NULL || !entry->IsDirectory())
+	{
+		LogEEx(TAR_TRANSFER, _T("Unable to pull %s: not a directory"), remoteDirectory);
+		return false;
+	}
+
+	std::vector<std::pair<std::tstring, std::tstring>> vecFiles;
+	if (!File(localDirectory).MakeDirectories() || !CollectFiles(listing, entry, localDirectory, vecFiles))
+	{
+		return false;
+	}
+
+	// listing is done before taking a session, it borrows its own
+	SyncSessionManager::Lease sync = SyncSessionManager::GetInstance().Acquire(m_pDevice);
+	if (!sync)
+	{
+		return false;
+	}
+	monitor->Start(0);
+	EntryMonitor entryMonitor(monitor);
+	bool bRet = true;
+	for (const auto& file : vecFiles)
+	{
+		if (monitor->IsCanceled() || !sync->PullFile(file.first.c_str(), file.second.c_str(), &entryMonitor))
+		{
+			sync.SetFailed();
+			bRet = false;
+			break;
+		}
+	}
+	monitor->Stop();
+	return bRet;
+}
+
+bool TarTransfer::CollectFiles(FileListingService& listing, FileListingService::FileEntry* entry,
+	const std::tstring& localDirectory, std::vector<std::pair<std::tstring, std::tstring>>& vecFiles)
+{
+	std::vector<FileListingService::FileEntry*> vecChildren;
+	if (!listing.GetChildren(entry, true, vecChildren))
+	{
+		return false;
+	}
+	for (FileListingService::FileEntry* child : vecChildren)
+	{
+		std::string fullPath;
+		child->GetFullPath(fullPath);
+		std::tstring remotePath;
+		std::tstring name;
+#ifdef _UNICODE
+		ConvertUtils::StringToWstring(fullPath, remotePath);
+		ConvertUtils::StringToWstring(child->GetName(), name);
+#else
+		remotePath = fullPath;
+		name = child->GetName();
+#endif
+		std::tstring localPath(localDirectory);
+		localPath.append(_T("\\")).append(name);
+
+		// directory links are not followed, they may loop
+		if (child->GetType() == TYPE_DIRECTORY)
+		{
+			if (!File(localPath.c_str()).MakeDirectories() || !CollectFiles(listing, child, localPath, vecFiles))
+			{
+				return false;
+			}
+		}
+		else if (child->GetType() == TYPE_FILE)
+		{
+			vecFiles.push_back(std::make_pair(remotePath, localPath));
+		}
+	}
+	return true;
+}
+
+void TarTransfer::LogOutput(const StatusReceiver& receiver)
+{
+	for (const std::string& line : receiver.GetOutput())
+	{
+		std::tstring message;
+#ifdef _UNICODE
+		ConvertUtils::StringToWstring(line, message);
+#else
+		message = line;
+#endif
+		LogEEx(TAR_TRANSFER, _T("%s"), message.c_str());
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for StatusReceiver
+
+TarTransfer::StatusReceiver::StatusReceiver(SyncService::ISyncProgressMonitor* monitor) :
+	m_pMonitor(monitor), m_nStatus(-1)
+{
+}
+
+void TarTransfer::StatusReceiver::ProcessNewLines(const std::vector<std::string>& vecArray)
+{
+	const size_t tagLength = strlen(TAR_STATUS_TAG);
+	for (const std::string& line : vecArray)
+	{
+		if (line.compare(0, tagLength, TAR_STATUS_TAG) == 0)
+		{
+			m_nStatus = atoi(line.c_str() + tagLength);
+		}
+		else if (!line.empty())
+		{
+			m_vecOutput.push_back(line);
+		}
+	}
+}
+
+bool TarTransfer::StatusReceiver::IsCancelled()
+{
+	return m_pMonitor->IsCanceled();
+}
+
+int TarTransfer::StatusReceiver::GetStatus() const
+{
+	return m_nStatus;
+}
+
+const std::vector<std::string>& TarTransfer::StatusReceiver::GetOutput() const
+{
+	return m_vecOutput;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for EntryMonitor
+
+TarTransfer::EntryMonitor::EntryMonitor(SyncService::ISyncProgressMonitor* monitor) : m_pMonitor(monitor)
+{
+}
+
+void TarTransfer::EntryMonitor::Start(int totalWork)
+{
+}
+
+void TarTransfer::EntryMonitor::Stop()
+{
+}
+
+bool TarTransfer::EntryMonitor::IsCanceled()
+{
+	return m_pMonitor->IsCanceled();
+}
+
+void TarTransfer::EntryMonitor::StartSubTask(const TString name)
+{
+}
+
+void TarTransfer::EntryMonitor::Advance(int work)
+{
+	m_pMonitor->Advance(work);
+}
@@ -0,0 +1,83 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonDefine.h"
+#include "SyncService.h"
+#include "MultiLineReceiver.h"
+#include "FileListingService.h"
+
+// define class
+class Device;
+
+/**
+ * Moves whole directory trees through a single exec: channel running tar
+ * on the device, instead of one sync round trip per file.
+ */
+class TarTransfer
+{
+private:
+	class StatusReceiver : public MultiLineReceiver
+	{
+	private:
+		SyncService::ISyncProgressMonitor* m_pMonitor;
+		std::vector<std::string> m_vecOutput;
+		int m_nStatus;
+	public:
+		explicit StatusReceiver(SyncService::ISyncProgressMonitor* monitor);
+		virtual void ProcessNewLines(const std::vector<std::string>& vecArray) override;
+		virtual bool IsCancelled() override;
+		int GetStatus() const;
+		const std::vector<std::string>& GetOutput() const;
+	};
+
+	// forwards per file progress of the sync fallback into the overall monitor
+	class EntryMonitor : public SyncService::ISyncProgressMonitor
+	{
+	private:
+		SyncService::ISyncProgressMonitor* m_pMonitor;
+	public:
+		explicit EntryMonitor(SyncService::ISyncProgressMonitor* monitor);
+		virtual void Start(int totalWork) override;
+		virtual void Stop() override;
+		virtual bool IsCanceled() override;
+		virtual void StartSubTask(const TString name) override;
+		virtual void Advance(int work) override;
+	};
+
+private:
+	Device* m_pDevice;
+
+public:
+	explicit TarTransfer(Device* device);
+
+	bool PushDirectory(const TString localDirectory, const TString remoteDirectory,
+		SyncService::ISyncProgressMonitor* monitor);
+
+	bool PullDirectory(const TString remoteDirectory, const TString localDirectory,
+		SyncService::ISyncProgressMonitor* monitor);
+
+private:
+	bool HasTar();
+	bool PullDirectoryBySync(const TString remoteDirectory, const TString localDirectory,
+		SyncService::ISyncProgressMonitor* monitor);
+	bool CollectFiles(FileListingService& listing, FileListingService::FileEntry* entry,
+		const std::tstring& localDirectory, std::vector<std::pair<std::tstring, std::tstring>>& vecFiles);
+	static void LogOutput(const StatusReceiver& receiver);
+};
@@ -0,0 +1,349 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TarWriter.h"
+#include <algorithm>
+#include "Log.h"
+#include "../System/File.h"
+
+#define TAR							_T("tar")
+
+#define TAR_BUFFER_SIZE			256*1024
+#define TAR_FILE_MODE				0644
+#define TAR_DIRECTORY_MODE			0755
+
+static void ToUtf8(const TString value, std::string& utf8)
+{
+#ifdef _UNICODE
+	int length = ::WideCharToMultiByte(CP_UTF8, 0, value, -1, NULL, 0, NULL, NULL);
+	utf8.resize(length > 0 ? length : 1);
+	::WideCharToMultiByte(CP_UTF8, 0, value, -1, &utf8[0], length, NULL, NULL);
+	utf8.resize(utf8.size() - 1);
+#else
+	utf8 = value;
+#endif
+}
+
+TarWriter::TarWriter() : m_llArchiveSize(0), m_llTotalBytes(0)
+{
+}
+
+bool TarWriter::AddDirectory(const TString localDirectory)
+{
+	m_vecEntries.clear();
+	m_llArchiveSize = 0;
+	m_llTotalBytes = 0;
+
+	std::tstring root(localDirectory);
+	while (root.size() > 1 && (root.back() == _T('\\') || root.back() == _T('/')))
+	{
+		root.pop_back();
+	}
+	if (!File(root.c_str()).IsDirectory())
+	{
+		return false;
+	}
+	if (!AddChildren(root, ""))
+	{
+		return false;
+	}
+	// end of archive
+	m_llArchiveSize += 2 * TAR_BLOCK_SIZE;
+	return true;
+}
+
+long long TarWriter::GetArchiveSize() const
+{
+	return m_llArchiveSize;
+}
+
+int TarWriter::GetFileCount() const
+{
+	return static_cast<int>(m_vecEntries.size());
+}
+
+bool TarWriter::Write(FileReadWrite fOutput, const std::atomic<bool>& cancelled)
+{
+	m_fOutput = fOutput;
+	m_vecBuffer.clear();
+	m_vecBuffer.reserve(TAR_BUFFER_SIZE);
+	for (const Entry& entry : m_vecEntries)
+	{
+		if (cancelled || !WriteEntry(entry, cancelled))
+		{
+			return false;
+		}
+	}
+	return AppendZeros(2 * TAR_BLOCK_SIZE) && Flush();
+}
+
+long long TarWriter::GetPaddedSize(long long size)
+{
+	return (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+}
+
+bool TarWriter::AddChildren(const std::tstring& localPath, const std::string& name)
+{
+	std::vector<std::tstring> vecNames;
+	if (!File(localPath.c_str()).ListFiles(vecNames))
+	{
+		LogEEx(TAR, _T("Unable to list %s"), localPath.c_str());
+		return false;
+	}
+	std::sort(vecNames.begin(), vecNames.end());
+
+	for (const std::tstring& child : vecNames)
+	{
+		std::tstring childPath(localPath);
+		childPath.append(_T("\\")).append(child);
+		File file(childPath.c_str());
+
+		Entry entry;
+		entry.strLocalPath = childPath;
+		ToUtf8(child.c_str(), entry.strName);
+		entry.strName.insert(0, name);
+		entry.bDirectory = file.IsDirectory() != FALSE;
+		if (entry.bDirectory)
+		{
+			entry.strName.push_back('/');
+			entry.llSize = 0;
+			// directory times cannot be read without backup semantics, use now
+			entry.tModified = time(NULL);
+		}
+		else
+		{
+			entry.llSize = file.GetLength64();
+			entry.tModified = file.GetLastModifiedTime();
+			m_llTotalBytes += entry.llSize;
+		}
+		m_llArchiveSize += GetEntrySize(entry.strName, entry.llSize);
+		m_vecEntries.push_back(entry);
+
+		if (entry.bDirectory && !AddChildren(childPath, entry.strName))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool TarWriter::WriteEntry(const Entry& entry, const std::atomic<bool>& cancelled)
+{
+	if (entry.bDirectory)
+	{
+		return WriteHeader(entry.strName, TAR_TYPE_DIRECTORY, 0, entry.tModified, TAR_DIRECTORY_MODE);
+	}
+	if (!WriteHeader(entry.strName, TAR_TYPE_FILE, entry.llSize, entry.tModified, TAR_FILE_MODE))
+	{
+		return false;
+	}
+
+	FileReadWrite fRead = File(entry.strLocalPath.c_str()).GetRead();
+	if (!fRead.IsValid())
+	{
+		LogEEx(TAR, _T("Unable to read %s"), entry.strLocalPath.c_str());
+		return false;
+	}
+	// the header already promised llSize bytes, so exactly that many follow
+	bool bRet = true;
+	long long remain = entry.llSize;
+	while (remain > 0)
+	{
+		if (cancelled || (m_vecBuffer.size() == m_vecBuffer.capacity() && !Flush()))
+		{
+			bRet = false;
+			break;
+		}
+		const size_t used = m_vecBuffer.size();
+		const DWORD dwWant = static_cast<DWORD>((std::min)(static_cast<long long>(m_vecBuffer.capacity() - used), remain));
+		m_vecBuffer.resize(used + dwWant);
+		DWORD dwRead = 0;
+		if (!::ReadFile(fRead, m_vecBuffer.data() + used, dwWant, &dwRead, NULL) || dwRead == 0)
+		{
+			// the file shrank since it was scanned, keep the archive consistent
+			LogWEx(TAR, _T("%s changed while packing it"), entry.strLocalPath.c_str());
+			m_vecBuffer.resize(used);
+			bRet = AppendZeros(static_cast<int>(remain));
+			break;
+		}
+		m_vecBuffer.resize(used + dwRead);
+		remain -= dwRead;
+	}
+	fRead.Close();
+	fRead.Delete();
+
+	return bRet && AppendZeros(static_cast<int>(GetPaddedSize(entry.llSize) - entry.llSize));
+}
+
+bool TarWriter::WriteHeader(const std::string& name, char type, long long size, time_t modified, int mode)
+{
+	char header[TAR_BLOCK_SIZE];
+	std::string prefix;
+	std::string base;
+	if (!SplitName(name, prefix, base))
+	{
+		// a GNU long name entry carries the full name, the header keeps a truncated one
+		const long long nameSize = name.size() + 1;
+		FillHeader(header, "", TAR_LONG_NAME, TAR_TYPE_LONG_NAME, nameSize, 0, 0);
+		if (!Append(header, TAR_BLOCK_SIZE) || !Append(name.c_str(), static_cast<int>(nameSize)) ||
+			!AppendZeros(static_cast<int>(GetPaddedSize(nameSize) - nameSize)))
+		{
+			return false;
+		}
+		prefix.clear();
+		base = name.substr(0, TAR_NAME_LENGTH);
+	}
+	FillHeader(header, prefix, base, type, size, modified, mode);
+	return Append(header, TAR_BLOCK_SIZE);
+}
+
+void TarWriter::FillHeader(char* header, const std::string& prefix, const std::string& name, char type,
+	long long size, time_t modified, int mode)
+{
+	memset(header, 0, TAR_BLOCK_SIZE);
+	memcpy(header, name.c_str(), (std::min)(name.size(), static_cast<size_t>(TAR_NAME_LENGTH)));
+	WriteOctal(header + TAR_MODE_OFFSET, 8, mode);
+	WriteOctal(header + TAR_UID_OFFSET, 8, 0);
+	WriteOctal(header + TAR_GID_OFFSET, 8, 0);
+	WriteOctal(header + TAR_SIZE_OFFSET, 12, size);
+	WriteOctal(header + TAR_MTIME_OFFSET, 12, modified);
+	header[TAR_TYPE_OFFSET] = type;
+	memcpy(header + TAR_MAGIC_OFFSET, TAR_MAGIC, 6);
+	memcpy(header + TAR_VERSION_OFFSET, "00", 2);
+	memcpy(header + TAR_PREFIX_OFFSET, prefix.c_str(), (std::min)(prefix.size(), static_cast<size_t>(TAR_PREFIX_LENGTH)));
+
+	// the checksum is computed with its own field filled with spaces
+	memset(header + TAR_CHKSUM_OFFSET, ' ', 8);
+	unsigned int checksum = 0;
+	for (int i = 0; i < TAR_BLOCK_SIZE; i++)
+	{
+		checksum += static_cast<unsigned char>(header[i]);
+	}
+	WriteOctal(header + TAR_CHKSUM_OFFSET, 7, checksum);
+}
+
+bool TarWriter::SplitName(const std::string& name, std::string& prefix, std::string& base)
+{
+	if (name.size() <= TAR_NAME_LENGTH)
+	{
+		prefix.clear();
+		base = name;
+		return true;
+	}
+	// ustar joins prefix and name with a '/', so split at one
+	size_t pos = (std::min)(name.size() - 2, static_cast<size_t>(TAR_PREFIX_LENGTH));
+	for (; pos > 0; pos--)
+	{
+		if (name[pos] != '/')
+		{
+			continue;
+		}
+		if (name.size() - pos - 1 > TAR_NAME_LENGTH)
+		{
+			break;
+		}
+		prefix = name.substr(0, pos);
+		base = name.substr(pos + 1);
+		return true;
+	}
+	return false;
+}
+
+long long TarWriter::GetEntrySize(const std::string& name, long long size)
+{
+	long long entrySize = TAR_BLOCK_SIZE + GetPaddedSize(size);
+	std::string prefix;
+	std::string base;
+	if (!SplitName(name, prefix, base))
+	{
+		entrySize += TAR_BLOCK_SIZE + GetPaddedSize(name.size() + 1);
+	}
+	return entrySize;
+}
+
+void TarWriter::WriteOctal(char* field, int length, long long value)
+{
+	// octal digits and a NUL while they fit, GNU base-256 beyond that
+	if (value >= 0 && value < (1LL << (3 * (length - 1))))
+	{
+		for (int i = length - 2; i >= 0; i--)
+		{
+			field[i] = static_cast<char>('0' + (value & 7));
+			value >>= 3;
+		}
+		field[length - 1] = '\0';
+		return;
+	}
+	for (int i = length - 1; i > 0; i--)
+	{
+		field[i] = static_cast<char>(value & 0xFF);
+		value >>= 8;
+	}
+	field[0] = static_cast<char>(0x80);
+}
+
+bool TarWriter::Append(const char* data, int length)
+{
+	while (length > 0)
+	{
+		if (m_vecBuffer.size() == m_vecBuffer.capacity() && !Flush())
+		{
+			return false;
+		}
+		const size_t used = m_vecBuffer.size();
+		const int count = (std::min)(length, static_cast<int>(m_vecBuffer.capacity() - used));
+		m_vecBuffer.insert(m_vecBuffer.end(), data, data + count);
+		data += count;
+		length -= count;
+	}
+	return true;
+}
+
+bool TarWriter::AppendZeros(int length)
+{
+	while (length > 0)
+	{
+		if (m_vecBuffer.size() == m_vecBuffer.capacity() && !Flush())
+		{
+			return false;
+		}
+		const size_t used = m_vecBuffer.size();
+		const int count = (std::min)(length, static_cast<int>(m_vecBuffer.capacity() - used));
+		m_vecBuffer.resize(used + count, 0);
+		length -= count;
+	}
+	return true;
+}
+
+bool TarWriter::Flush()
+{
+	size_t offset = 0;
+	while (offset < m_vecBuffer.size())
+	{
+		DWORD dwWrite = 0;
+		if (!::WriteFile(m_fOutput, m_vecBuffer.data() + offset, static_cast<DWORD>(m_vecBuffer.size() - offset),
+			&dwWrite, NULL))
+		{
+			// the reading side went away
+			return false;
+		}
+		offset += dwWrite;
+	}
+	m_vecBuffer.clear();
+	return true;
+}
@@ -0,0 +1,72 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonDefine.h"
+#include <atomic>
+#include "../System/FileReadWrite.h"
+#include "TarFormat.h"
+
+/**
+ * Packs a local directory tree into a ustar stream. The tree is scanned
+ * up front so the exact archive size is known before the first byte is
+ * written, which lets the device side stop reading at the right place.
+ */
+class TarWriter
+{
+private:
+	struct Entry
+	{
+		std::tstring strLocalPath;
+		std::string strName;	// utf-8, relative to the root, '/' separated
+		bool bDirectory;
+		long long llSize;
+		time_t tModified;
+	};
+
+private:
+	std::vector<Entry> m_vecEntries;
+	long long m_llArchiveSize;
+	long long m_llTotalBytes;
+	std::vector<char> m_vecBuffer;
+	FileReadWrite m_fOutput;
+
+public:
+	TarWriter();
+
+	bool AddDirectory(const TString localDirectory);
+	long long GetArchiveSize() const;
+	int GetFileCount() const;
+	bool Write(FileReadWrite fOutput, const std::atomic<bool>& cancelled);
+
+	static long long GetPaddedSize(long long size);
+
+private:
+	bool AddChildren(const std::tstring& localPath, const std::string& name);
+	bool WriteEntry(const Entry& entry, const std::atomic<bool>& cancelled);
+	bool WriteHeader(const std::string& name, char type, long long size, time_t modified, int mode);
+	static void FillHeader(char* header, const std::string& prefix, const std::string& name, char type,
+		long long size, time_t modified, int mode);
+	static bool SplitName(const std::string& name, std::string& prefix, std::string& base);
+	static long long GetEntrySize(const std::string& name, long long size);
+	static void WriteOctal(char* field, int length, long long value);
+	bool Append(const char* data, int length);
+	bool AppendZeros(int length);
+	bool Flush();
+};
@@ -0,0 +1,276 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "TransferScheduler.h"
+#include <algorithm>
+#include <chrono>
+#include "TransferStats.h"
+
+#define LINK_BURST_MIN				64*1024		// one sync chunk
+#define LINK_MAX_SLEEP_US			50000		// waiters look at cancel and limit changes this often
+#define RATE_WINDOW_US				1000000
+
+TransferScheduler TransferScheduler::s_instance;
+
+TransferScheduler::TransferScheduler()
+{
+}
+
+TransferScheduler& TransferScheduler::GetInstance()
+{
+	return s_instance;
+}
+
+void TransferScheduler::SetGroupLimit(const TString groupName, long long bytesPerSecond)
+{
+	std::shared_ptr<LinkGroup> pGroup;
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		pGroup = GetGroup(groupName);
+	}
+	std::unique_lock<std::mutex> lock(pGroup->lock);
+	pGroup->llLimit = (std::max)(bytesPerSecond, 0LL);
+	pGroup->dTokens = 0;
+	pGroup->llLastRefill = TransferStats::NowMicros();
+	pGroup->cvChanged.notify_all();
+}
+
+void TransferScheduler::AssignDevice(const TString serialNumber, const TString groupName)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_mapDeviceGroups[serialNumber] = groupName;
+	GetGroup(groupName);
+}
+
+void TransferScheduler::Charge(const TString serialNumber, int bytes)
+{
+	std::shared_ptr<LinkGroup> pGroup = GetDeviceGroup(serialNumber);
+	std::unique_lock<std::mutex> lock(pGroup->lock);
+	const long long llNow = TransferStats::NowMicros();
+	if (pGroup->llLimit > 0)
+	{
+		Refill(*pGroup, llNow);
+		// bounded debt, a burst of output delays bulk transfers but does not stall them
+		const double dBurst = static_cast<double>((std::max)(pGroup->llLimit / 4, static_cast<long long>(LINK_BURST_MIN)));
+		pGroup->dTokens = (std::max)(pGroup->dTokens - bytes, -dBurst);
+	}
+	Account(*pGroup, bytes, llNow);
+}
+
+void TransferScheduler::GetGroupStats(std::vector<GroupStats>& vecStats)
+{
+	std::vector<std::shared_ptr<LinkGroup>> vecGroups;
+	{
+		std::unique_lock<std::mutex> lock(m_lock);
+		for (auto iter = m_mapGroups.begin(); iter != m_mapGroups.end(); ++iter)
+		{
+			vecGroups.push_back(iter->second);
+		}
+	}
+
+	vecStats.clear();
+	const long long llNow = TransferStats::NowMicros();
+	for (const std::shared_ptr<LinkGroup>& pGroup : vecGroups)
+	{
+		std::unique_lock<std::mutex> lock(pGroup->lock);
+		GroupStats stats;
+		stats.strName = pGroup->strName;
+		stats.llLimit = pGroup->llLimit;
+		stats.llBytes = pGroup->llBytes;
+		// a window that has not been closed for a while means the link went quiet
+		stats.dRate = llNow - pGroup->llWindowStart > 2 * RATE_WINDOW_US ? 0 : pGroup->dRate;
+		stats.dUtilization = pGroup->llLimit > 0 ? stats.dRate / pGroup->llLimit : 0;
+		stats.nWaiting = static_cast<int>(pGroup->deqInteractive.size());
+		for (auto iter = pGroup->mapBulk.begin(); iter != pGroup->mapBulk.end(); ++iter)
+		{
+			stats.nWaiting += static_cast<int>(iter->second.size());
+		}
+		stats.llWaitMicros = pGroup->llWaitMicros;
+		vecStats.push_back(stats);
+	}
+}
+
+void TransferScheduler::Export(std::tstring& report)
+{
+	std::vector<GroupStats> vecStats;
+	GetGroupStats(vecStats);
+
+	std::tostringstream oss;
+	// one line per link group: limit and rates in B/s, utilization in percent
+	for (const GroupStats& stats : vecStats)
+	{
+		oss << stats.strName
+			<< _T(" limit=") << stats.llLimit
+			<< _T(" bytes=") << stats.llBytes
+			<< _T(" rate=") << static_cast<long long>(stats.dRate)
+			<< _T(" utilization=") << static_cast<int>(stats.dUtilization * 100)
+			<< _T(" waiting=") << stats.nWaiting
+			<< _T(" wait_us=") << stats.llWaitMicros
+			<< _T("\n");
+	}
+	report = oss.str();
+}
+
+// m_lock must be held
+std::shared_ptr<TransferScheduler::LinkGroup> TransferScheduler::GetGroup(const TString groupName)
+{
+	std::shared_ptr<LinkGroup>& pGroup = m_mapGroups[groupName];
+	if (!pGroup)
+	{
+		pGroup = std::make_shared<LinkGroup>();
+		pGroup->strName = groupName;
+		pGroup->llLastRefill = TransferStats::NowMicros();
+		pGroup->llWindowStart = pGroup->llLastRefill;
+	}
+	return pGroup;
+}
+
+std::shared_ptr<TransferScheduler::LinkGroup> TransferScheduler::GetDeviceGroup(const TString serialNumber)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	auto iter = m_mapDeviceGroups.find(serialNumber);
+	return GetGroup(iter == m_mapDeviceGroups.end() ? DEFAULT_LINK_GROUP : iter->second.c_str());
+}
+
+TransferScheduler::Waiter* TransferScheduler::GetHead(LinkGroup& group)
+{
+	if (!group.deqInteractive.empty())
+	{
+		return group.deqInteractive.front();
+	}
+	if (group.mapBulk.empty())
+	{
+		return NULL;
+	}
+	// round robin: the first device after the one served last
+	auto iter = group.mapBulk.upper_bound(group.strLastServed);
+	if (iter == group.mapBulk.end())
+	{
+		iter = group.mapBulk.begin();
+	}
+	return iter->second.front();
+}
+
+void TransferScheduler::Remove(LinkGroup& group, Waiter* waiter)
+{
+	if (waiter->bInteractive)
+	{
+		group.deqInteractive.erase(std::find(group.deqInteractive.begin(), group.deqInteractive.end(), waiter));
+		return;
+	}
+	auto iter = group.mapBulk.find(waiter->strSerial);
+	std::deque<Waiter*>& deqWaiters = iter->second;
+	deqWaiters.erase(std::find(deqWaiters.begin(), deqWaiters.end(), waiter));
+	if (deqWaiters.empty())
+	{
+		group.mapBulk.erase(iter);
+	}
+}
+
+void TransferScheduler::Refill(LinkGroup& group, long long llNow)
+{
+	const double dBurst = static_cast<double>((std::max)(group.llLimit / 4, static_cast<long long>(LINK_BURST_MIN)));
+	group.dTokens += static_cast<double>(group.llLimit) * (llNow - group.llLastRefill) / 1000000;
+	group.dTokens = (std::min)(group.dTokens, dBurst);
+	group.llLastRefill = llNow;
+}
+
+void TransferScheduler::Account(LinkGroup& group, int bytes, long long llNow)
+{
+	group.llBytes += bytes;
+	if (llNow - group.llWindowStart >= RATE_WINDOW_US)
+	{
+		group.dRate = static_cast<double>(group.llWindowBytes) * 1000000 / (llNow - group.llWindowStart);
+		group.llWindowStart = llNow;
+		group.llWindowBytes = 0;
+	}
+	group.llWindowBytes += bytes;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for Flow
+
+TransferScheduler::Flow::Flow(const TString serialNumber) :
+	m_pGroup(TransferScheduler::GetInstance().GetDeviceGroup(serialNumber)), m_strSerial(serialNumber), m_llBytes(0)
+{
+}
+
+bool TransferScheduler::Flow::Consume(int bytes, SyncService::ISyncProgressMonitor* monitor)
+{
+	LinkGroup& group = *m_pGroup;
+	Waiter waiter = { m_strSerial, m_llBytes < SMALL_TRANSFER_BYTES };
+	m_llBytes += bytes;
+
+	std::unique_lock<std::mutex> lock(group.lock);
+	const long long llWaitStart = TransferStats::NowMicros();
+	if (group.llLimit <= 0)
+	{
+		Account(group, bytes, llWaitStart);
+		return true;
+	}
+
+	if (waiter.bInteractive)
+	{
+		group.deqInteractive.push_back(&waiter);
+	}
+	else
+	{
+		group.mapBulk[m_strSerial].push_back(&waiter);
+	}
+
+	while (true)
+	{
+		if (monitor->IsCanceled())
+		{
+			Remove(group, &waiter);
+			group.cvChanged.notify_all();
+			return false;
+		}
+		if (group.llLimit <= 0)
+		{
+			break;
+		}
+		Refill(group, TransferStats::NowMicros());
+		const bool bHead = GetHead(group) == &waiter;
+		if (bHead && group.dTokens > 0)
+		{
+			break;
+		}
+
+		// the head sleeps until the bucket is refilled, the others until the head moves on
+		long long llSleep = LINK_MAX_SLEEP_US;
+		if (bHead)
+		{
+			llSleep = static_cast<long long>(-group.dTokens * 1000000 / group.llLimit) + 1;
+			llSleep = (std::min)(llSleep, static_cast<long long>(LINK_MAX_SLEEP_US));
+		}
+		group.cvChanged.wait_for(lock, std::chrono::microseconds(llSleep));
+	}
+
+	// a chunk larger than the bucket leaves it in debt, the next one waits longer
+	group.dTokens -= bytes;
+	if (!waiter.bInteractive)
+	{
+		group.strLastServed = m_strSerial;
+	}
+	Remove(group, &waiter);
+	const long long llNow = TransferStats::NowMicros();
+	group.llWaitMicros += llNow - llWaitStart;
+	Account(group, bytes, llNow);
+	group.cvChanged.notify_all();
+	return true;
+}
@@ -0,0 +1,130 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "CommonDefine.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "SyncService.h"
+
+#define DEFAULT_LINK_GROUP			_T("default")
+
+/**
+ * Paces sync transfers of devices sharing a link, a USB controller or the
+ * uplink of a remote host. Each link group has a token bucket; a group
+ * without a limit only counts. Waiting transfers of a limited group are
+ * served one chunk at a time, interactive ones first, bulk ones round
+ * robin across devices so one busy device cannot take the whole link.
+ *
+ * A transfer starts in the interactive lane and moves to the bulk lane
+ * once it has moved SMALL_TRANSFER_BYTES, so small pushes and pulls get
+ * ahead of large ones without knowing their size up front. Shell and exec
+ * traffic is charged to the group but never held back.
+ */
+class TransferScheduler
+{
+public:
+	static const int SMALL_TRANSFER_BYTES = 256 * 1024;
+
+	struct GroupStats
+	{
+		std::tstring strName;
+		long long llLimit;			// bytes per second, 0 if unlimited
+		long long llBytes;			// since the group was created
+		double dRate;				// bytes per second over the last second
+		double dUtilization;		// dRate / llLimit, 0 if unlimited
+		int nWaiting;
+		long long llWaitMicros;		// total time transfers were held back
+	};
+
+private:
+	struct Waiter
+	{
+		std::tstring strSerial;
+		bool bInteractive;
+	};
+
+	struct LinkGroup
+	{
+		std::tstring strName;
+		std::mutex lock;
+		std::condition_variable cvChanged;
+		long long llLimit = 0;
+		double dTokens = 0;
+		long long llLastRefill = 0;
+		std::deque<Waiter*> deqInteractive;
+		std::map<std::tstring, std::deque<Waiter*>> mapBulk;
+		std::tstring strLastServed;
+		// metrics
+		long long llBytes = 0;
+		long long llWaitMicros = 0;
+		long long llWindowStart = 0;
+		long long llWindowBytes = 0;
+		double dRate = 0;
+	};
+
+public:
+	/**
+	 * One transfer of one device, hands out permission to move each chunk.
+	 */
+	class Flow
+	{
+	private:
+		std::shared_ptr<LinkGroup> m_pGroup;
+		std::tstring m_strSerial;
+		long long m_llBytes;
+
+	public:
+		explicit Flow(const TString serialNumber);
+
+		/**
+		 * Waits until the link group lets the chunk through.
+		 * @return false if the monitor was cancelled while waiting
+		 */
+		bool Consume(int bytes, SyncService::ISyncProgressMonitor* monitor);
+	};
+
+private:
+	static TransferScheduler s_instance;
+
+	std::mutex m_lock;
+	std::map<std::tstring, std::shared_ptr<LinkGroup>> m_mapGroups;
+	std::map<std::tstring, std::tstring> m_mapDeviceGroups;
+
+private:
+	TransferScheduler();
+
+public:
+	static TransferScheduler& GetInstance();
+
+	void SetGroupLimit(const TString groupName, long long bytesPerSecond);
+	void AssignDevice(const TString serialNumber, const TString groupName);
+	void Charge(const TString serialNumber, int bytes);
+	void GetGroupStats(std::vector<GroupStats>& vecStats);
+	void Export(std::tstring& report);
+
+private:
+	std::shared_ptr<LinkGroup> GetGroup(const TString groupName);
+	std::shared_ptr<LinkGroup> GetDeviceGroup(const TString serialNumber);
+	static Waiter* GetHead(LinkGroup& group);
+	static void Remove(LinkGroup& group, Waiter* waiter);
+	static void Refill(LinkGroup& group, long long llNow);
+	static void Account(LinkGroup& group, int bytes, long long llNow);
+};
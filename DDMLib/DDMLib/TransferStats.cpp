@@ -0,0 +1,182 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TransferStats.h"
+#include <chrono>
+
+#define RATE_WINDOW_MICROS			2000000LL
+#define REPORT_INTERVAL_MICROS		250000LL
+
+TransferStats::TransferStats(Direction direction) : m_emDirection(direction)
+{
+	m_llStart = 0;
+	m_llEnd = 0;
+	m_llLastReport = 0;
+	m_llBytes = 0;
+	m_llSocketMicros = 0;
+	m_llDiskMicros = 0;
+	m_llRoundTripMicros = -1;
+	m_nChunks = 0;
+	m_llWindowBytes = 0;
+	ZeroMemory(m_arrHistogram, sizeof(m_arrHistogram));
+}
+
+long long TransferStats::NowMicros()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int TransferStats::GetBucket(long long micros)
+{
+	int bucket = 0;
+	while (micros > 1 && bucket < HISTOGRAM_BUCKETS - 1)
+	{
+		micros >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+
+void TransferStats::Begin()
+{
+	m_llStart = NowMicros();
+	m_llEnd = 0;
+	m_llLastReport = m_llStart;
+}
+
+void TransferStats::End()
+{
+	m_llEnd = NowMicros();
+}
+
+void TransferStats::AddSocketTime(long long micros)
+{
+	m_llSocketMicros += micros;
+}
+
+void TransferStats::AddDiskTime(long long micros)
+{
+	m_llDiskMicros += micros;
+}
+
+void TransferStats::AddChunk(int bytes, long long latencyMicros)
+{
+	m_llBytes += bytes;
+	m_nChunks++;
+	m_arrHistogram[GetBucket(latencyMicros)]++;
+
+	const long long now = NowMicros();
+	m_deqWindow.push_back(std::make_pair(now, bytes));
+	m_llWindowBytes += bytes;
+	while (!m_deqWindow.empty() && m_deqWindow.front().first < now - RATE_WINDOW_MICROS)
+	{
+		m_llWindowBytes -= m_deqWindow.front().second;
+		m_deqWindow.pop_front();
+	}
+}
+
+void TransferStats::SetRoundTrip(long long micros)
+{
+	m_llRoundTripMicros = micros;
+}
+
+bool TransferStats::ShouldReport()
+{
+	const long long now = NowMicros();
+	if (now - m_llLastReport < REPORT_INTERVAL_MICROS)
+	{
+		return false;
+	}
+	m_llLastReport = now;
+	return true;
+}
+
+TransferStats::Direction TransferStats::GetDirection() const
+{
+	return m_emDirection;
+}
+
+long long TransferStats::GetBytes() const
+{
+	return m_llBytes;
+}
+
+long long TransferStats::GetElapsedMicros() const
+{
+	return (m_llEnd != 0 ? m_llEnd : NowMicros()) - m_llStart;
+}
+
+long long TransferStats::GetSocketMicros() const
+{
+	return m_llSocketMicros;
+}
+
+long long TransferStats::GetDiskMicros() const
+{
+	return m_llDiskMicros;
+}
+
+long long TransferStats::GetRoundTripMicros() const
+{
+	return m_llRoundTripMicros;
+}
+
+int TransferStats::GetChunkCount() const
+{
+	return m_nChunks;
+}
+
+unsigned int TransferStats::GetHistogram(int bucket) const
+{
+	if (bucket < 0 || bucket >= HISTOGRAM_BUCKETS)
+	{
+		return 0;
+	}
+	return m_arrHistogram[bucket];
+}
+
+double TransferStats::GetAverageRate() const
+{
+	const long long elapsed = GetElapsedMicros();
+	if (elapsed <= 0)
+	{
+		return 0;
+	}
+	return m_llBytes * 1000000.0 / elapsed;
+}
+
+double TransferStats::GetCurrentRate() const
+{
+	if (m_deqWindow.empty())
+	{
+		return 0;
+	}
+	// a young transfer has not filled the window yet
+	const long long now = m_llEnd != 0 ? m_llEnd : NowMicros();
+	long long span = now - m_llStart;
+	if (span > RATE_WINDOW_MICROS)
+	{
+		span = RATE_WINDOW_MICROS;
+	}
+	if (span <= 0)
+	{
+		return 0;
+	}
+	return m_llWindowBytes * 1000000.0 / span;
+}
@@ -0,0 +1,79 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonDefine.h"
+#include <deque>
+
+/**
+ * Timing of one sync transfer: where the time went (socket or disk),
+ * chunk latencies as a log2 histogram, the sync round trip and the
+ * throughput over a sliding window.
+ */
+class TransferStats
+{
+public:
+	enum Direction
+	{
+		PUSH,
+		PULL
+	};
+
+	// bucket i counts chunks that took [2^i, 2^(i+1)) microseconds
+	static const int HISTOGRAM_BUCKETS = 24;
+
+private:
+	const Direction m_emDirection;
+	long long m_llStart;
+	long long m_llEnd;
+	long long m_llLastReport;
+	long long m_llBytes;
+	long long m_llSocketMicros;
+	long long m_llDiskMicros;
+	long long m_llRoundTripMicros;
+	int m_nChunks;
+	unsigned int m_arrHistogram[HISTOGRAM_BUCKETS];
+	std::deque<std::pair<long long, int>> m_deqWindow;	// (time, bytes) of recent chunks
+	long long m_llWindowBytes;
+
+public:
+	explicit TransferStats(Direction direction);
+
+	static long long NowMicros();
+	static int GetBucket(long long micros);
+
+	void Begin();
+	void End();
+	void AddSocketTime(long long micros);
+	void AddDiskTime(long long micros);
+	void AddChunk(int bytes, long long latencyMicros);
+	void SetRoundTrip(long long micros);
+	bool ShouldReport();
+
+	Direction GetDirection() const;
+	long long GetBytes() const;
+	long long GetElapsedMicros() const;
+	long long GetSocketMicros() const;
+	long long GetDiskMicros() const;
+	long long GetRoundTripMicros() const;	// -1 if not measured
+	int GetChunkCount() const;
+	unsigned int GetHistogram(int bucket) const;
+	double GetAverageRate() const;	// bytes per second
+	double GetCurrentRate() const;	// bytes per second over the sliding window
+};
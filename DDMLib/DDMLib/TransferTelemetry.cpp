@@ -0,0 +1,154 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TransferTelemetry.h"
+#include "Log.h"
+
+#define TELEMETRY					_T("telemetry")
+
+TransferTelemetry TransferTelemetry::s_instance;
+
+TransferTelemetry::TransferTelemetry()
+{
+}
+
+TransferTelemetry& TransferTelemetry::GetInstance()
+{
+	return s_instance;
+}
+
+void TransferTelemetry::Record(const TString serialNumber, const TransferStats& stats, bool success)
+{
+	LogVEx(TELEMETRY, _T("%s %lld bytes on '%s' in %lld us: socket %lld us, disk %lld us, round trip %lld us"),
+		stats.GetDirection() == TransferStats::PUSH ? _T("push") : _T("pull"), stats.GetBytes(),
+		serialNumber, stats.GetElapsedMicros(), stats.GetSocketMicros(), stats.GetDiskMicros(),
+		stats.GetRoundTripMicros());
+
+	std::unique_lock<std::mutex> lock(m_lock);
+	auto iter = m_mapDevices.find(serialNumber);
+	if (iter == m_mapDevices.end())
+	{
+		DeviceTelemetry telemetry;
+		ZeroMemory(&telemetry, sizeof(telemetry));
+		iter = m_mapDevices.insert(std::make_pair(std::tstring(serialNumber), telemetry)).first;
+	}
+	DeviceTelemetry& telemetry = iter->second;
+	telemetry.nTransfers++;
+	if (!success)
+	{
+		telemetry.nFailures++;
+	}
+	telemetry.llBytes += stats.GetBytes();
+	telemetry.llElapsedMicros += stats.GetElapsedMicros();
+	telemetry.llSocketMicros += stats.GetSocketMicros();
+	telemetry.llDiskMicros += stats.GetDiskMicros();
+	const long long rtt = stats.GetRoundTripMicros();
+	if (rtt >= 0)
+	{
+		if (telemetry.nRoundTrips == 0 || rtt < telemetry.llMinRoundTripMicros)
+		{
+			telemetry.llMinRoundTripMicros = rtt;
+		}
+		if (rtt > telemetry.llMaxRoundTripMicros)
+		{
+			telemetry.llMaxRoundTripMicros = rtt;
+		}
+		telemetry.llRoundTripMicros += rtt;
+		telemetry.nRoundTrips++;
+	}
+	if (success)
+	{
+		telemetry.dLastRate = stats.GetAverageRate();
+	}
+	for (int i = 0; i < TransferStats::HISTOGRAM_BUCKETS; i++)
+	{
+		telemetry.arrHistogram[i] += stats.GetHistogram(i);
+	}
+}
+
+bool TransferTelemetry::GetDeviceTelemetry(const TString serialNumber, DeviceTelemetry& telemetry)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	auto iter = m_mapDevices.find(serialNumber);
+	if (iter == m_mapDevices.end())
+	{
+		return false;
+	}
+	telemetry = iter->second;
+	return true;
+}
+
+void TransferTelemetry::Export(std::tstring& report)
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	std::tostringstream oss;
+	// one line per device: serial, counts, mean throughput in B/s, time split and latencies in us
+	for (auto iter = m_mapDevices.begin(); iter != m_mapDevices.end(); ++iter)
+	{
+		const DeviceTelemetry& telemetry = iter->second;
+		const long long rate = telemetry.llElapsedMicros > 0 ?
+			telemetry.llBytes * 1000000 / telemetry.llElapsedMicros : 0;
+		const long long rtt = telemetry.nRoundTrips > 0 ?
+			telemetry.llRoundTripMicros / telemetry.nRoundTrips : -1;
+		oss << iter->first
+			<< _T(" transfers=") << telemetry.nTransfers
+			<< _T(" failures=") << telemetry.nFailures
+			<< _T(" bytes=") << telemetry.llBytes
+			<< _T(" rate=") << rate
+			<< _T(" last_rate=") << static_cast<long long>(telemetry.dLastRate)
+			<< _T(" socket_us=") << telemetry.llSocketMicros
+			<< _T(" disk_us=") << telemetry.llDiskMicros
+			<< _T(" rtt_us=") << telemetry.llMinRoundTripMicros << _T("/") << rtt
+			<< _T("/") << telemetry.llMaxRoundTripMicros
+			<< _T(" chunk_p50_us=") << GetPercentileMicros(telemetry.arrHistogram, 50)
+			<< _T(" chunk_p99_us=") << GetPercentileMicros(telemetry.arrHistogram, 99)
+			<< _T("\n");
+	}
+	report = oss.str();
+}
+
+void TransferTelemetry::Reset()
+{
+	std::unique_lock<std::mutex> lock(m_lock);
+	m_mapDevices.clear();
+}
+
+long long TransferTelemetry::GetPercentileMicros(const unsigned int histogram[], int percent)
+{
+	unsigned long long total = 0;
+	for (int i = 0; i < TransferStats::HISTOGRAM_BUCKETS; i++)
+	{
+		total += histogram[i];
+	}
+	if (total == 0)
+	{
+		return 0;
+	}
+	// upper bound of the bucket holding the requested rank
+	const unsigned long long rank = (total * percent + 99) / 100;
+	unsigned long long seen = 0;
+	for (int i = 0; i < TransferStats::HISTOGRAM_BUCKETS; i++)
+	{
+		seen += histogram[i];
+		if (seen >= rank)
+		{
+			return 1LL << (i + 1);
+		}
+	}
+	return 1LL << TransferStats::HISTOGRAM_BUCKETS;
+}
@@ -0,0 +1,66 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CommonDefine.h"
+#include <mutex>
+#include "TransferStats.h"
+
+/**
+ * Per device totals of every sync transfer, so a slow hub or cable shows
+ * up as a device whose throughput or round trip stands out from the rest.
+ */
+class TransferTelemetry
+{
+public:
+	struct DeviceTelemetry
+	{
+		int nTransfers;
+		int nFailures;
+		long long llBytes;
+		long long llElapsedMicros;
+		long long llSocketMicros;
+		long long llDiskMicros;
+		int nRoundTrips;
+		long long llRoundTripMicros;
+		long long llMinRoundTripMicros;
+		long long llMaxRoundTripMicros;
+		double dLastRate;
+		unsigned int arrHistogram[TransferStats::HISTOGRAM_BUCKETS];
+	};
+
+private:
+	static TransferTelemetry s_instance;
+
+	std::mutex m_lock;
+	std::map<std::tstring, DeviceTelemetry> m_mapDevices;
+
+private:
+	TransferTelemetry();
+
+public:
+	static TransferTelemetry& GetInstance();
+
+	void Record(const TString serialNumber, const TransferStats& stats, bool success);
+	bool GetDeviceTelemetry(const TString serialNumber, DeviceTelemetry& telemetry);
+	void Export(std::tstring& report);
+	void Reset();
+
+	static long long GetPercentileMicros(const unsigned int histogram[], int percent);
+};
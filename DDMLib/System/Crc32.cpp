@@ -0,0 +1,103 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Crc32.h"
+
+#define CRC32_POLYNOMIAL		0x04C11DB7
+
+// table[k][i] is the crc of byte i followed by k zero bytes
+struct Crc32Tables
+{
+	UINT32 table[8][256];
+
+	Crc32Tables()
+	{
+		for (UINT32 i = 0; i < 256; i++)
+		{
+			UINT32 crc = i << 24;
+			for (int bit = 0; bit < 8; bit++)
+			{
+				crc = (crc & 0x80000000) ? (crc << 1) ^ CRC32_POLYNOMIAL : crc << 1;
+			}
+			table[0][i] = crc;
+		}
+		for (int k = 1; k < 8; k++)
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				UINT32 crc = table[k - 1][i];
+				table[k][i] = (crc << 8) ^ table[0][crc >> 24];
+			}
+		}
+	}
+};
+
+static const Crc32Tables s_tables;
+
+Crc32::Crc32()
+{
+	Reset();
+}
+
+void Crc32::Update(const void* pData, size_t length)
+{
+	m_nCrc = Update(m_nCrc, static_cast<const BYTE*>(pData), length);
+	m_ullLength += length;
+}
+
+void Crc32::Reset()
+{
+	m_nCrc = 0;
+	m_ullLength = 0;
+}
+
+ULONGLONG Crc32::GetLength() const
+{
+	return m_ullLength;
+}
+
+UINT32 Crc32::GetCksum() const
+{
+	// cksum appends the length, least significant byte first, without leading zero bytes
+	BYTE arrLength[sizeof(ULONGLONG)];
+	int count = 0;
+	for (ULONGLONG ullLength = m_ullLength; ullLength != 0; ullLength >>= 8)
+	{
+		arrLength[count++] = static_cast<BYTE>(ullLength & 0xFF);
+	}
+	return ~Update(m_nCrc, arrLength, count);
+}
+
+UINT32 Crc32::Update(UINT32 nCrc, const BYTE* pData, size_t length)
+{
+	const UINT32 (*table)[256] = s_tables.table;
+	// eight bytes per step, the tables fold in their contribution at once
+	while (length >= 8)
+	{
+		const UINT32 high = nCrc ^ (static_cast<UINT32>(pData[0]) << 24 | static_cast<UINT32>(pData[1]) << 16 |
+			static_cast<UINT32>(pData[2]) << 8 | pData[3]);
+		nCrc = table[7][high >> 24] ^ table[6][(high >> 16) & 0xFF] ^ table[5][(high >> 8) & 0xFF] ^
+			table[4][high & 0xFF] ^ table[3][pData[4]] ^ table[2][pData[5]] ^ table[1][pData[6]] ^ table[0][pData[7]];
+		pData += 8;
+		length -= 8;
+	}
+	while (length-- > 0)
+	{
+		nCrc = (nCrc << 8) ^ table[0][(nCrc >> 24) ^ *pData++];
+	}
+	return nCrc;
+}
@@ -0,0 +1,45 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "SysDef.h"
+
+/**
+ * CRC-32 as computed by POSIX cksum (polynomial 0x04C11DB7, most significant
+ * bit first, length appended), so a checksum taken while data streams by
+ * can be compared with `cksum` on a device. Uses slicing-by-8 tables, a few
+ * GB/s per core.
+ */
+class Crc32
+{
+private:
+	UINT32 m_nCrc;
+	ULONGLONG m_ullLength;
+
+public:
+	Crc32();
+
+	void Update(const void* pData, size_t length);
+	void Reset();
+	ULONGLONG GetLength() const;
+	// the cksum value of everything passed to Update so far
+	UINT32 GetCksum() const;
+
+private:
+	static UINT32 Update(UINT32 nCrc, const BYTE* pData, size_t length);
+};
@@ -0,0 +1,551 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Deflate.h"
+#include <algorithm>
+#include <queue>
+
+#define MIN_MATCH				3
+#define MAX_MATCH				258
+#define TOO_FAR					4096	// a three byte match further back costs more than its literals
+#define HASH_BITS				15
+#define BLOCK_TOKENS			16384
+#define STORED_BLOCK_MAX		65535
+#define LITLEN_CODES			286
+#define DIST_CODES				30
+#define CODE_LENGTH_CODES		19
+#define END_OF_BLOCK			256
+#define MAX_CODE_BITS			15
+#define MAX_CODE_LENGTH_BITS	7
+
+struct DeflateLevel
+{
+	int nMaxChain;
+	int nNiceLength;	// stop searching once a match is this long
+	bool bLazy;			// try one byte later before taking a match
+};
+
+static const DeflateLevel s_arrLevels[DEFLATE_MAX_LEVEL + 1] =
+{
+	{ 0, 0, false }, { 4, 8, false }, { 8, 16, false }, { 16, 32, false }, { 16, 16, true },
+	{ 32, 32, true }, { 128, 128, true }, { 256, 128, true }, { 1024, MAX_MATCH, true }, { 4096, MAX_MATCH, true }
+};
+
+static const int s_arrLengthBase[29] =
+{
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const int s_arrLengthExtra[29] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const int s_arrDistBase[DIST_CODES] =
+{
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+	4097, 6145, 8193, 12289, 16385, 24577
+};
+static const int s_arrDistExtra[DIST_CODES] =
+{
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const BYTE s_arrCodeLengthOrder[CODE_LENGTH_CODES] =
+{
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+Deflate::Deflate()
+{
+}
+
+void Deflate::CompressSegment(const BYTE* history, size_t historyLength, const BYTE* data, size_t length,
+	int level, bool final, std::vector<BYTE>& out)
+{
+	BitWriter writer(out);
+	if (level <= 0)
+	{
+		WriteStored(writer, data, length, final);
+		if (!final)
+		{
+			WriteStored(writer, NULL, 0, false);
+		}
+		writer.Align();
+		return;
+	}
+	const DeflateLevel& config = s_arrLevels[(std::min)(level, DEFLATE_MAX_LEVEL)];
+
+	// matches may reach back into the history, tokens are only made for data
+	historyLength = history == NULL ? 0 : (std::min)(historyLength, static_cast<size_t>(DEFLATE_WINDOW_SIZE));
+	std::vector<BYTE> vecBuffer;
+	vecBuffer.reserve(historyLength + length);
+	vecBuffer.insert(vecBuffer.end(), history + 0, history + historyLength);
+	vecBuffer.insert(vecBuffer.end(), data, data + length);
+	const BYTE* buffer = vecBuffer.data();
+	const size_t total = vecBuffer.size();
+
+	std::vector<int> vecHead(1 << HASH_BITS, -1);
+	std::vector<int> vecPrev(total);
+	auto Hash = [buffer](size_t pos) -> UINT32
+	{
+		const UINT32 value = static_cast<UINT32>(buffer[pos]) << 16 | static_cast<UINT32>(buffer[pos + 1]) << 8 | buffer[pos + 2];
+		return (value * 2654435761U) >> (32 - HASH_BITS);
+	};
+	auto Insert = [&](size_t pos)
+	{
+		if (pos + MIN_MATCH <= total)
+		{
+			const UINT32 hash = Hash(pos);
+			vecPrev[pos] = vecHead[hash];
+			vecHead[hash] = static_cast<int>(pos);
+		}
+	};
+	auto FindMatch = [&](size_t pos, int& matchLength, int& matchDist)
+	{
+		matchLength = 0;
+		matchDist = 0;
+		if (pos + MIN_MATCH > total)
+		{
+			return;
+		}
+		const int maxLength = static_cast<int>((std::min)(static_cast<size_t>(MAX_MATCH), total - pos));
+		int chain = config.nMaxChain;
+		for (int candidate = vecHead[Hash(pos)];
+			candidate >= 0 && pos - candidate <= DEFLATE_WINDOW_SIZE && chain-- > 0;
+			candidate = vecPrev[candidate])
+		{
+			// the byte that would make it longer decides most candidates at once
+			if (buffer[candidate + matchLength] != buffer[pos + matchLength])
+			{
+				continue;
+			}
+			int matched = 0;
+			while (matched < maxLength && buffer[candidate + matched] == buffer[pos + matched])
+			{
+				matched++;
+			}
+			if (matched > matchLength)
+			{
+				matchLength = matched;
+				matchDist = static_cast<int>(pos - candidate);
+				if (matched >= config.nNiceLength || matched == maxLength)
+				{
+					break;
+				}
+			}
+		}
+		if (matchLength < MIN_MATCH || (matchLength == MIN_MATCH && matchDist > TOO_FAR))
+		{
+			matchLength = 0;
+		}
+	};
+
+	for (size_t pos = 0; pos < historyLength; pos++)
+	{
+		Insert(pos);
+	}
+
+	std::vector<Token> vecTokens;
+	vecTokens.reserve(BLOCK_TOKENS);
+	size_t blockStart = historyLength;
+	size_t pos = historyLength;
+	// every position before pos is in the hash chains
+	while (pos < total)
+	{
+		int matchLength = 0;
+		int matchDist = 0;
+		FindMatch(pos, matchLength, matchDist);
+		Insert(pos);
+		if (matchLength > 0 && config.bLazy && matchLength < config.nNiceLength)
+		{
+			int nextLength = 0;
+			int nextDist = 0;
+			FindMatch(pos + 1, nextLength, nextDist);
+			if (nextLength > matchLength)
+			{
+				// a literal now buys the longer match at the next byte
+				Token token = { buffer[pos], 0 };
+				vecTokens.push_back(token);
+				pos++;
+				Insert(pos);
+				matchLength = nextLength;
+				matchDist = nextDist;
+			}
+		}
+
+		if (matchLength > 0)
+		{
+			Token token = { static_cast<WORD>(matchLength), static_cast<WORD>(matchDist) };
+			vecTokens.push_back(token);
+			for (size_t next = pos + 1; next < pos + matchLength; next++)
+			{
+				Insert(next);
+			}
+			pos += matchLength;
+		}
+		else
+		{
+			Token token = { buffer[pos], 0 };
+			vecTokens.push_back(token);
+			pos++;
+		}
+
+		if (vecTokens.size() >= BLOCK_TOKENS && pos < total)
+		{
+			WriteBlock(writer, vecTokens, buffer + blockStart, pos - blockStart, false);
+			vecTokens.clear();
+			blockStart = pos;
+		}
+	}
+	if (!vecTokens.empty() || final)
+	{
+		WriteBlock(writer, vecTokens, buffer + blockStart, pos - blockStart, final);
+	}
+
+	if (!final)
+	{
+		// an empty stored block leaves the segment byte aligned for the next one
+		WriteStored(writer, NULL, 0, false);
+	}
+	writer.Align();
+}
+
+void Deflate::WriteBlock(BitWriter& writer, const std::vector<Token>& vecTokens, const BYTE* raw,
+	size_t rawLength, bool final)
+{
+	if (rawLength == 0)
+	{
+		WriteStored(writer, NULL, 0, final);
+		return;
+	}
+
+	UINT32 arrLitFreqs[LITLEN_CODES] = { 0 };
+	UINT32 arrDistFreqs[DIST_CODES] = { 0 };
+	for (const Token& token : vecTokens)
+	{
+		if (token.wDist == 0)
+		{
+			arrLitFreqs[token.wLitLen]++;
+		}
+		else
+		{
+			arrLitFreqs[257 + GetLengthCode(token.wLitLen)]++;
+			arrDistFreqs[GetDistCode(token.wDist)]++;
+		}
+	}
+	arrLitFreqs[END_OF_BLOCK] = 1;
+
+	BYTE arrLitLengths[LITLEN_CODES];
+	BYTE arrDistLengths[DIST_CODES];
+	BuildLengths(arrLitFreqs, LITLEN_CODES, MAX_CODE_BITS, arrLitLengths);
+	BuildLengths(arrDistFreqs, DIST_CODES, MAX_CODE_BITS, arrDistLengths);
+	int litCount = LITLEN_CODES;
+	while (litCount > 257 && arrLitLengths[litCount - 1] == 0)
+	{
+		litCount--;
+	}
+	int distCount = DIST_CODES;
+	while (distCount > 1 && arrDistLengths[distCount - 1] == 0)
+	{
+		distCount--;
+	}
+
+	// both code length tables go out run length encoded, as symbols 0-18 with extra bits
+	std::vector<BYTE> vecLengths(arrLitLengths, arrLitLengths + litCount);
+	vecLengths.insert(vecLengths.end(), arrDistLengths, arrDistLengths + distCount);
+	std::vector<std::pair<BYTE, BYTE>> vecRuns;
+	for (size_t i = 0; i < vecLengths.size();)
+	{
+		const BYTE value = vecLengths[i];
+		int run = 1;
+		while (i + run < vecLengths.size() && vecLengths[i + run] == value)
+		{
+			run++;
+		}
+		i += run;
+		if (value == 0)
+		{
+			while (run >= 11)
+			{
+				const int count = (std::min)(run, 138);
+				vecRuns.push_back(std::make_pair(static_cast<BYTE>(18), static_cast<BYTE>(count - 11)));
+				run -= count;
+			}
+			if (run >= 3)
+			{
+				vecRuns.push_back(std::make_pair(static_cast<BYTE>(17), static_cast<BYTE>(run - 3)));
+				run = 0;
+			}
+		}
+		else
+		{
+			vecRuns.push_back(std::make_pair(value, static_cast<BYTE>(0)));
+			run--;
+			while (run >= 3)
+			{
+				const int count = (std::min)(run, 6);
+				vecRuns.push_back(std::make_pair(static_cast<BYTE>(16), static_cast<BYTE>(count - 3)));
+				run -= count;
+			}
+		}
+		for (; run > 0; run--)
+		{
+			vecRuns.push_back(std::make_pair(value, static_cast<BYTE>(0)));
+		}
+	}
+
+	UINT32 arrCodeLengthFreqs[CODE_LENGTH_CODES] = { 0 };
+	for (const auto& run : vecRuns)
+	{
+		arrCodeLengthFreqs[run.first]++;
+	}
+	BYTE arrCodeLengthLengths[CODE_LENGTH_CODES];
+	BuildLengths(arrCodeLengthFreqs, CODE_LENGTH_CODES, MAX_CODE_LENGTH_BITS, arrCodeLengthLengths);
+	int codeLengthCount = CODE_LENGTH_CODES;
+	while (codeLengthCount > 4 && arrCodeLengthLengths[s_arrCodeLengthOrder[codeLengthCount - 1]] == 0)
+	{
+		codeLengthCount--;
+	}
+
+	// stored wins on data that does not compress
+	static const int s_arrRunExtra[CODE_LENGTH_CODES] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7 };
+	UINT64 ullBits = 3 + 5 + 5 + 4 + 3 * codeLengthCount;
+	for (const auto& run : vecRuns)
+	{
+		ullBits += arrCodeLengthLengths[run.first] + s_arrRunExtra[run.first];
+	}
+	for (int i = 0; i < LITLEN_CODES; i++)
+	{
+		ullBits += static_cast<UINT64>(arrLitFreqs[i]) * (arrLitLengths[i] + (i > 256 ? s_arrLengthExtra[i - 257] : 0));
+	}
+	for (int i = 0; i < DIST_CODES; i++)
+	{
+		ullBits += static_cast<UINT64>(arrDistFreqs[i]) * (arrDistLengths[i] + s_arrDistExtra[i]);
+	}
+	const UINT64 ullStoredBits = rawLength * 8 + (rawLength / STORED_BLOCK_MAX + 1) * (3 + 7 + 32);
+	if (ullStoredBits <= ullBits)
+	{
+		WriteStored(writer, raw, rawLength, final);
+		return;
+	}
+
+	WORD arrLitCodes[LITLEN_CODES];
+	WORD arrDistCodes[DIST_CODES];
+	WORD arrCodeLengthCodes[CODE_LENGTH_CODES];
+	BuildCodes(arrLitLengths, LITLEN_CODES, arrLitCodes);
+	BuildCodes(arrDistLengths, DIST_CODES, arrDistCodes);
+	BuildCodes(arrCodeLengthLengths, CODE_LENGTH_CODES, arrCodeLengthCodes);
+
+	writer.Put(final ? 1 : 0, 1);
+	writer.Put(2, 2);
+	writer.Put(litCount - 257, 5);
+	writer.Put(distCount - 1, 5);
+	writer.Put(codeLengthCount - 4, 4);
+	for (int i = 0; i < codeLengthCount; i++)
+	{
+		writer.Put(arrCodeLengthLengths[s_arrCodeLengthOrder[i]], 3);
+	}
+	for (const auto& run : vecRuns)
+	{
+		writer.Put(arrCodeLengthCodes[run.first], arrCodeLengthLengths[run.first]);
+		if (s_arrRunExtra[run.first] > 0)
+		{
+			writer.Put(run.second, s_arrRunExtra[run.first]);
+		}
+	}
+
+	for (const Token& token : vecTokens)
+	{
+		if (token.wDist == 0)
+		{
+			writer.Put(arrLitCodes[token.wLitLen], arrLitLengths[token.wLitLen]);
+			continue;
+		}
+		const int lengthCode = GetLengthCode(token.wLitLen);
+		writer.Put(arrLitCodes[257 + lengthCode], arrLitLengths[257 + lengthCode]);
+		if (s_arrLengthExtra[lengthCode] > 0)
+		{
+			writer.Put(token.wLitLen - s_arrLengthBase[lengthCode], s_arrLengthExtra[lengthCode]);
+		}
+		const int distCode = GetDistCode(token.wDist);
+		writer.Put(arrDistCodes[distCode], arrDistLengths[distCode]);
+		if (s_arrDistExtra[distCode] > 0)
+		{
+			writer.Put(token.wDist - s_arrDistBase[distCode], s_arrDistExtra[distCode]);
+		}
+	}
+	writer.Put(arrLitCodes[END_OF_BLOCK], arrLitLengths[END_OF_BLOCK]);
+}
+
+void Deflate::WriteStored(BitWriter& writer, const BYTE* raw, size_t rawLength, bool final)
+{
+	do
+	{
+		const size_t length = (std::min)(rawLength, static_cast<size_t>(STORED_BLOCK_MAX));
+		rawLength -= length;
+		writer.Put(final && rawLength == 0 ? 1 : 0, 1);
+		writer.Put(0, 2);
+		writer.Align();
+		writer.Put(static_cast<UINT32>(length), 16);
+		writer.Put(static_cast<UINT32>(~length) & 0xFFFF, 16);
+		for (size_t i = 0; i < length; i++)
+		{
+			writer.Put(raw[i], 8);
+		}
+		raw += length;
+	} while (rawLength > 0);
+}
+
+void Deflate::BuildLengths(const UINT32* freqs, int count, int maxBits, BYTE* lengths)
+{
+	// a code needs two symbols at least, or decoders see it as incomplete
+	std::vector<UINT32> vecFreqs(freqs, freqs + count);
+	int used = static_cast<int>(count - std::count(vecFreqs.begin(), vecFreqs.end(), 0U));
+	for (int i = 0; i < count && used < 2; i++)
+	{
+		if (vecFreqs[i] == 0)
+		{
+			vecFreqs[i] = 1;
+			used++;
+		}
+	}
+
+	while (true)
+	{
+		// plain Huffman, parent links give the depth of every leaf
+		typedef std::pair<UINT64, int> Node;
+		std::priority_queue<Node, std::vector<Node>, std::greater<Node>> queue;
+		std::vector<int> vecParents(2 * count, -1);
+		for (int i = 0; i < count; i++)
+		{
+			if (vecFreqs[i] > 0)
+			{
+				queue.push(Node(vecFreqs[i], i));
+			}
+		}
+		int next = count;
+		while (queue.size() > 1)
+		{
+			const Node first = queue.top();
+			queue.pop();
+			const Node second = queue.top();
+			queue.pop();
+			vecParents[first.second] = next;
+			vecParents[second.second] = next;
+			queue.push(Node(first.first + second.first, next++));
+		}
+
+		int maxDepth = 0;
+		for (int i = 0; i < count; i++)
+		{
+			int depth = 0;
+			if (vecFreqs[i] > 0)
+			{
+				for (int node = i; vecParents[node] >= 0; node = vecParents[node])
+				{
+					depth++;
+				}
+			}
+			lengths[i] = static_cast<BYTE>(depth);
+			maxDepth = (std::max)(maxDepth, depth);
+		}
+		if (maxDepth <= maxBits)
+		{
+			return;
+		}
+		// too deep, flatten the distribution and try again
+		for (UINT32& freq : vecFreqs)
+		{
+			if (freq > 0)
+			{
+				freq = (freq >> 1) | 1;
+			}
+		}
+	}
+}
+
+void Deflate::BuildCodes(const BYTE* lengths, int count, WORD* codes)
+{
+	// canonical codes as in RFC 1951 3.2.2, bit reversed since deflate sends them high bit first
+	int arrLengthCounts[MAX_CODE_BITS + 1] = { 0 };
+	for (int i = 0; i < count; i++)
+	{
+		arrLengthCounts[lengths[i]]++;
+	}
+	arrLengthCounts[0] = 0;
+	int arrNextCode[MAX_CODE_BITS + 1] = { 0 };
+	int code = 0;
+	for (int bits = 1; bits <= MAX_CODE_BITS; bits++)
+	{
+		code = (code + arrLengthCounts[bits - 1]) << 1;
+		arrNextCode[bits] = code;
+	}
+	for (int i = 0; i < count; i++)
+	{
+		const int length = lengths[i];
+		codes[i] = 0;
+		if (length == 0)
+		{
+			continue;
+		}
+		int value = arrNextCode[length]++;
+		int reversed = 0;
+		for (int bit = 0; bit < length; bit++)
+		{
+			reversed = (reversed << 1) | (value & 1);
+			value >>= 1;
+		}
+		codes[i] = static_cast<WORD>(reversed);
+	}
+}
+
+int Deflate::GetLengthCode(int length)
+{
+	return static_cast<int>(std::upper_bound(s_arrLengthBase, s_arrLengthBase + 29, length) - s_arrLengthBase) - 1;
+}
+
+int Deflate::GetDistCode(int dist)
+{
+	return static_cast<int>(std::upper_bound(s_arrDistBase, s_arrDistBase + DIST_CODES, dist) - s_arrDistBase) - 1;
+}
+
+//////////////////////////////////////////////////////////////////////////
+// implements for BitWriter
+
+Deflate::BitWriter::BitWriter(std::vector<BYTE>& vecOut) : m_vecOut(vecOut), m_ullBits(0), m_nCount(0)
+{
+}
+
+void Deflate::BitWriter::Put(UINT32 bits, int count)
+{
+	m_ullBits |= static_cast<UINT64>(bits) << m_nCount;
+	m_nCount += count;
+	while (m_nCount >= 8)
+	{
+		m_vecOut.push_back(static_cast<BYTE>(m_ullBits & 0xFF));
+		m_ullBits >>= 8;
+		m_nCount -= 8;
+	}
+}
+
+void Deflate::BitWriter::Align()
+{
+	if (m_nCount > 0)
+	{
+		m_vecOut.push_back(static_cast<BYTE>(m_ullBits & 0xFF));
+	}
+	m_ullBits = 0;
+	m_nCount = 0;
+}
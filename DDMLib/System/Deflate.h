@@ -0,0 +1,74 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "SysDef.h"
+
+#define DEFLATE_WINDOW_SIZE		32768
+#define DEFLATE_MAX_LEVEL		9
+
+/**
+ * Raw deflate (RFC 1951) compressor working on independent segments, so a
+ * large input can be compressed by several threads at once. Each segment
+ * may match into the history preceding it and ends byte aligned with an
+ * empty stored block, the concatenation of all segments being one valid
+ * stream. Uses hash chains with lazy matching and dynamic Huffman blocks,
+ * falling back to stored blocks for data that does not compress.
+ */
+class Deflate
+{
+private:
+	struct Token
+	{
+		WORD wLitLen;		// literal byte, or match length when wDist is not 0
+		WORD wDist;
+	};
+
+	class BitWriter
+	{
+	private:
+		std::vector<BYTE>& m_vecOut;
+		UINT64 m_ullBits;
+		int m_nCount;
+	public:
+		explicit BitWriter(std::vector<BYTE>& vecOut);
+		void Put(UINT32 bits, int count);
+		void Align();
+	};
+
+private:
+	Deflate();
+
+public:
+	/**
+	 * Compresses data into out, appending to it.
+	 * @param history up to DEFLATE_WINDOW_SIZE bytes that precede data, may be NULL
+	 * @param final marks the last segment of the stream
+	 */
+	static void CompressSegment(const BYTE* history, size_t historyLength, const BYTE* data, size_t length,
+		int level, bool final, std::vector<BYTE>& out);
+
+private:
+	static void WriteBlock(BitWriter& writer, const std::vector<Token>& vecTokens, const BYTE* raw,
+		size_t rawLength, bool final);
+	static void WriteStored(BitWriter& writer, const BYTE* raw, size_t rawLength, bool final);
+	static void BuildLengths(const UINT32* freqs, int count, int maxBits, BYTE* lengths);
+	static void BuildCodes(const BYTE* lengths, int count, WORD* codes);
+	static int GetLengthCode(int length);
+	static int GetDistCode(int dist);
+};
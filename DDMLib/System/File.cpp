@@ -51,6 +51,11 @@ BOOL File::IsFile() const
 	return Exists() && !IsDirectory();
 }
 
+const TString File::GetPath() const
+{
+	return m_strPath.c_str();
+}
+
 DWORD File::GetLength() const
 {
 	HANDLE hFile = ::CreateFile(m_strPath.c_str(), FILE_READ_EA, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
@@ -63,6 +68,19 @@ DWORD File::GetLength() const
 	return 0;
 }
 
+LONGLONG File::GetLength64() const
+{
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	if (::GetFileAttributesEx(m_strPath.c_str(), GetFileExInfoStandard, &fad))
+	{
+		ULARGE_INTEGER ui;
+		ui.LowPart = fad.nFileSizeLow;
+		ui.HighPart = fad.nFileSizeHigh;
+		return static_cast<LONGLONG>(ui.QuadPart);
+	}
+	return 0;
+}
+
 time_t File::GetLastModifiedTime() const
 {
 	time_t tTime = 0;
@@ -95,7 +113,7 @@ FileReadWrite File::GetWrite() const
 {
 	FileReadWrite fWrite;
 	fWrite.Create();
-	fWrite = ::CreateFile(m_strPath.c_str(), GENERIC_WRITE, FILE_SHARE_WRITE, 0, OPEN_EXISTING, 0, 0);
+	fWrite = ::CreateFile(m_strPath.c_str(), GENERIC_WRITE, FILE_SHARE_WRITE, 0, CREATE_ALWAYS, 0, 0);
 	if (!fWrite.IsValid())
 	{
 		fWrite.Delete();
@@ -103,6 +121,83 @@ FileReadWrite File::GetWrite() const
 	return fWrite;
 }
 
+FileReadWrite File::GetAppend() const
+{
+	FileReadWrite fWrite;
+	fWrite.Create();
+	fWrite = ::CreateFile(m_strPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, 0, OPEN_ALWAYS, 0, 0);
+	if (!fWrite.IsValid())
+	{
+		fWrite.Delete();
+	}
+	else
+	{
+		LARGE_INTEGER liZero;
+		liZero.QuadPart = 0;
+		::SetFilePointerEx(fWrite, liZero, NULL, FILE_END);
+	}
+	return fWrite;
+}
+
+BOOL File::Delete() const
+{
+	return ::DeleteFile(m_strPath.c_str());
+}
+
+BOOL File::MoveTo(const TString szDest) const
+{
+	return ::MoveFileEx(m_strPath.c_str(), szDest, MOVEFILE_REPLACE_EXISTING);
+}
+
+BOOL File::ListFiles(std::vector<std::tstring>& vecNames) const
+{
+	std::tstring strPattern(m_strPath);
+	strPattern.append(_T("\\*"));
+	WIN32_FIND_DATA fd;
+	HANDLE hFind = ::FindFirstFile(strPattern.c_str(), &fd);
+	if (hFind == INVALID_HANDLE_VALUE)
+	{
+		return FALSE;
+	}
+	do
+	{
+		if (_tcscmp(fd.cFileName, _T(".")) != 0 && _tcscmp(fd.cFileName, _T("..")) != 0)
+		{
+			vecNames.push_back(fd.cFileName);
+		}
+	} while (::FindNextFile(hFind, &fd));
+	::FindClose(hFind);
+	return TRUE;
+}
+
+BOOL File::MakeDirectories() const
+{
+	if (IsDirectory())
+	{
+		return TRUE;
+	}
+	// create the parents first, stopping at the drive or share root
+	size_t pos = m_strPath.find_last_of(_T("\\/"));
+	if (pos != std::tstring::npos && pos > 0 && m_strPath[pos - 1] != _T(':'))
+	{
+		if (!File(m_strPath.substr(0, pos).c_str()).MakeDirectories())
+		{
+			return FALSE;
+		}
+	}
+	return ::CreateDirectory(m_strPath.c_str(), NULL) || ::GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+BOOL File::SetLastModifiedTime(FileReadWrite& fWrite, time_t tTime)
+{
+	ULARGE_INTEGER ui;
+	ui.QuadPart = static_cast<ULONGLONG>(tTime) * 10000000 + 116444736000000000;
+	FILETIME filetime;
+	filetime.dwLowDateTime = ui.LowPart;
+	filetime.dwHighDateTime = ui.HighPart;
+	return ::SetFileTime(fWrite, NULL, NULL, &filetime);
+}
+
 void File::FileTimeToTime_t(const FILETIME* ft, time_t *t) const
 {
 	ULARGE_INTEGER ui;
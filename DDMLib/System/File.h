@@ -33,10 +33,18 @@ public:
 	BOOL Exists() const;
 	BOOL IsDirectory() const;
 	BOOL IsFile() const;
+	const TString GetPath() const;
 	DWORD GetLength() const;
+	LONGLONG GetLength64() const;
 	time_t GetLastModifiedTime() const;
 	FileReadWrite GetRead() const;
 	FileReadWrite GetWrite() const;
+	FileReadWrite GetAppend() const;
+	BOOL Delete() const;
+	BOOL MoveTo(const TString szDest) const;
+	BOOL ListFiles(std::vector<std::tstring>& vecNames) const;
+	BOOL MakeDirectories() const;
+	static BOOL SetLastModifiedTime(FileReadWrite& fWrite, time_t tTime);
 
 private:
 	void FileTimeToTime_t(const FILETIME* ft, time_t *t) const;
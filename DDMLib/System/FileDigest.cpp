@@ -0,0 +1,112 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FileDigest.h"
+#include <bcrypt.h>
+#include "File.h"
+#include "StreamReader.h"
+
+#pragma comment(lib, "bcrypt.lib")
+
+#define DIGEST_BUFFER_SIZE		64*1024
+
+FileDigest::FileDigest()
+{
+}
+
+BOOL FileDigest::Sha256(const TString szPath, std::string& strHex)
+{
+	return Sha256(szPath, -1, strHex);
+}
+
+BOOL FileDigest::Sha256(const TString szPath, LONGLONG llLength, std::string& strHex)
+{
+	File file(szPath);
+	FileReadWrite fRead = file.GetRead();
+	if (!fRead.IsValid())
+	{
+		return FALSE;
+	}
+
+	BCRYPT_ALG_HANDLE hAlg = NULL;
+	BCRYPT_HASH_HANDLE hHash = NULL;
+	if (!BCRYPT_SUCCESS(::BCryptOpenAlgorithmProvider(&hAlg, BCRYPT_SHA256_ALGORITHM, NULL, 0)))
+	{
+		fRead.Close();
+		fRead.Delete();
+		return FALSE;
+	}
+
+	BOOL bRet = BCRYPT_SUCCESS(::BCryptCreateHash(hAlg, &hHash, NULL, 0, NULL, 0, 0));
+	if (bRet)
+	{
+		CharStreamReader fsr(fRead, DIGEST_BUFFER_SIZE);
+		std::unique_ptr<CHAR[]> buffer(new CHAR[DIGEST_BUFFER_SIZE]);
+		// a negative length hashes the whole file, otherwise only its prefix
+		LONGLONG llRemain = llLength;
+		while (llLength < 0 || llRemain > 0)
+		{
+			int nWant = DIGEST_BUFFER_SIZE;
+			if (llLength >= 0 && llRemain < nWant)
+			{
+				nWant = static_cast<int>(llRemain);
+			}
+			LONG lRead = fsr.ReadData(buffer.get(), nWant);
+			if (lRead == 0)
+			{
+				// end of file, fine unless the prefix was longer than the file
+				bRet = llLength < 0;
+				break;
+			}
+			if (lRead < 0 ||
+				!BCRYPT_SUCCESS(::BCryptHashData(hHash, reinterpret_cast<PUCHAR>(buffer.get()), lRead, 0)))
+			{
+				bRet = FALSE;
+				break;
+			}
+			llRemain -= lRead;
+		}
+
+		BYTE digest[SHA256_DIGEST_LENGTH] = { 0 };
+		if (bRet && BCRYPT_SUCCESS(::BCryptFinishHash(hHash, digest, SHA256_DIGEST_LENGTH, 0)))
+		{
+			ToHex(digest, SHA256_DIGEST_LENGTH, strHex);
+		}
+		else
+		{
+			bRet = FALSE;
+		}
+		::BCryptDestroyHash(hHash);
+	}
+	::BCryptCloseAlgorithmProvider(hAlg, 0);
+
+	fRead.Close();
+	fRead.Delete();
+	return bRet;
+}
+
+void FileDigest::ToHex(const BYTE* pData, int length, std::string& strHex)
+{
+	static const char s_szHexDigit[] = "0123456789abcdef";
+	strHex.resize(length * 2);
+	for (int i = 0; i < length; i++)
+	{
+		strHex[i * 2] = s_szHexDigit[pData[i] >> 4];
+		strHex[i * 2 + 1] = s_szHexDigit[pData[i] & 0x0F];
+	}
+}
@@ -0,0 +1,34 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "SysDef.h"
+
+#define SHA256_DIGEST_LENGTH	32
+
+class FileDigest
+{
+private:
+	FileDigest();
+
+public:
+	static BOOL Sha256(const TString szPath, std::string& strHex);
+	static BOOL Sha256(const TString szPath, LONGLONG llLength, std::string& strHex);
+	static void ToHex(const BYTE* pData, int length, std::string& strHex);
+};
@@ -94,6 +94,17 @@ public:
 		}
 	}
 
+	BOOL Seek(LONGLONG llOffset)
+	{
+		if (!IsValid())
+		{
+			return FALSE;
+		}
+		LARGE_INTEGER liOffset;
+		liOffset.QuadPart = llOffset;
+		return ::SetFilePointerEx(*m_pHandle, liOffset, NULL, FILE_BEGIN);
+	}
+
 	void Close()
 	{
 		if (IsValid())
@@ -0,0 +1,567 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "Inflate.h"
+#include <algorithm>
+
+#define LITLEN_CODES			286
+#define DIST_CODES				30
+#define FIXED_LITLEN_CODES		288
+#define CODE_LENGTH_CODES		19
+#define END_OF_BLOCK			256
+#define MAX_CODE_BITS			15
+#define MAX_SYMBOL_BITS			48		// longest length code, its extra bits, distance code and extra bits
+#define EMIT_SIZE				65536
+
+static const int s_arrLengthBase[29] =
+{
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const int s_arrLengthExtra[29] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const int s_arrDistBase[DIST_CODES] =
+{
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+	4097, 6145, 8193, 12289, 16385, 24577
+};
+static const int s_arrDistExtra[DIST_CODES] =
+{
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+static const BYTE s_arrCodeLengthOrder[CODE_LENGTH_CODES] =
+{
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+Inflate::Inflate()
+{
+	Reset();
+}
+
+void Inflate::Reset()
+{
+	m_vecInput.clear();
+	m_nPos = 0;
+	m_ullBits = 0;
+	m_nBitCount = 0;
+	m_emState = STATE_HEADER;
+	m_bLastBlock = false;
+	m_nStoredLeft = 0;
+	m_vecWindow.clear();
+	m_nEmitted = 0;
+}
+
+int Inflate::Feed(const BYTE* data, size_t length, ISink* sink)
+{
+	if (m_emState == STATE_DONE || m_emState == STATE_ERROR)
+	{
+		// nothing more belongs to this stream
+		m_vecInput.insert(m_vecInput.end(), data, data + length);
+		return m_emState == STATE_DONE ? 1 : -1;
+	}
+	m_vecInput.insert(m_vecInput.end(), data, data + length);
+	return Run(false, sink);
+}
+
+int Inflate::Finish(ISink* sink)
+{
+	if (m_emState == STATE_DONE || m_emState == STATE_ERROR)
+	{
+		return m_emState == STATE_DONE ? 1 : -1;
+	}
+	int nRet = Run(true, sink);
+	return nRet == 1 ? 1 : -1;
+}
+
+void Inflate::TakeRemainder(std::vector<BYTE>& rest)
+{
+	rest.assign(m_vecInput.begin() + m_nPos, m_vecInput.end());
+	m_vecInput.clear();
+	m_nPos = 0;
+}
+
+int Inflate::Run(bool final, ISink* sink)
+{
+	int nRet = 0;
+	while (nRet == 0)
+	{
+		if (m_emState == STATE_HEADER)
+		{
+			const BitState saved = SaveBits();
+			nRet = ReadBlockHeader();
+			if (nRet == 0)
+			{
+				// the header is not all there yet, read it again with more input
+				RestoreBits(saved);
+				nRet = final ? -1 : 0;
+				break;
+			}
+			nRet = nRet > 0 ? 0 : -1;
+		}
+		else if (m_emState == STATE_STORED)
+		{
+			size_t count = (std::min)(m_nStoredLeft, m_vecInput.size() - m_nPos);
+			m_vecWindow.insert(m_vecWindow.end(), m_vecInput.begin() + m_nPos, m_vecInput.begin() + m_nPos + count);
+			m_nPos += count;
+			m_nStoredLeft -= count;
+			if (m_vecWindow.size() - m_nEmitted >= EMIT_SIZE && !Emit(sink))
+			{
+				nRet = -1;
+			}
+			else if (m_nStoredLeft > 0)
+			{
+				nRet = final ? -1 : 0;
+				break;
+			}
+			else
+			{
+				m_emState = m_bLastBlock ? STATE_DONE : STATE_HEADER;
+			}
+		}
+		else if (m_emState == STATE_CODES)
+		{
+			nRet = DecodeCodes(final, sink);
+			if (nRet == 0 && m_emState == STATE_CODES)
+			{
+				break;
+			}
+		}
+		else if (m_emState == STATE_DONE)
+		{
+			// give back the whole bytes read ahead, the rest of the last byte is padding
+			m_nPos -= m_nBitCount / 8;
+			m_ullBits = 0;
+			m_nBitCount = 0;
+			nRet = 1;
+		}
+	}
+
+	if (nRet < 0)
+	{
+		m_emState = STATE_ERROR;
+		return -1;
+	}
+	if (!Emit(sink))
+	{
+		m_emState = STATE_ERROR;
+		return -1;
+	}
+	if (m_emState != STATE_DONE)
+	{
+		// drop the input already decoded, but keep the bytes the bit buffer holds so they can be given back
+		const size_t nHeld = m_nBitCount / 8;
+		m_vecInput.erase(m_vecInput.begin(), m_vecInput.begin() + (m_nPos - nHeld));
+		m_nPos = nHeld;
+	}
+	return nRet;
+}
+
+// @return 1 when the block can be decoded, 0 if more input is needed, -1 on corrupt data
+int Inflate::ReadBlockHeader()
+{
+	UINT32 nHeader;
+	if (!GetBits(3, nHeader))
+	{
+		return 0;
+	}
+	m_bLastBlock = (nHeader & 1) != 0;
+	const UINT32 nType = nHeader >> 1;
+	if (nType == 0)
+	{
+		// stored, the length starts at the next byte boundary
+		m_ullBits >>= m_nBitCount % 8;
+		m_nBitCount -= m_nBitCount % 8;
+		m_nPos -= m_nBitCount / 8;
+		m_ullBits = 0;
+		m_nBitCount = 0;
+		if (m_vecInput.size() - m_nPos < 4)
+		{
+			return 0;
+		}
+		const BYTE* p = m_vecInput.data() + m_nPos;
+		const UINT32 nLength = p[0] | (p[1] << 8);
+		const UINT32 nComplement = p[2] | (p[3] << 8);
+		if (nLength != (~nComplement & 0xFFFF))
+		{
+			return -1;
+		}
+		m_nPos += 4;
+		m_nStoredLeft = nLength;
+		m_emState = STATE_STORED;
+		return 1;
+	}
+	if (nType == 1)
+	{
+		BYTE arrLengths[FIXED_LITLEN_CODES + DIST_CODES];
+		std::fill(arrLengths, arrLengths + 144, 8);
+		std::fill(arrLengths + 144, arrLengths + 256, 9);
+		std::fill(arrLengths + 256, arrLengths + 280, 7);
+		std::fill(arrLengths + 280, arrLengths + FIXED_LITLEN_CODES, 8);
+		std::fill(arrLengths + FIXED_LITLEN_CODES, arrLengths + FIXED_LITLEN_CODES + DIST_CODES, 5);
+		BuildHuffman(m_lenCode, arrLengths, FIXED_LITLEN_CODES);
+		BuildHuffman(m_distCode, arrLengths + FIXED_LITLEN_CODES, DIST_CODES);
+		m_emState = STATE_CODES;
+		return 1;
+	}
+	if (nType == 2)
+	{
+		int nRet = ReadDynamicTables();
+		if (nRet > 0)
+		{
+			m_emState = STATE_CODES;
+		}
+		return nRet;
+	}
+	return -1;
+}
+
+int Inflate::ReadDynamicTables()
+{
+	UINT32 nLitLen, nDist, nCodeLen;
+	if (!GetBits(5, nLitLen) || !GetBits(5, nDist) || !GetBits(4, nCodeLen))
+	{
+		return 0;
+	}
+	nLitLen += 257;
+	nDist += 1;
+	nCodeLen += 4;
+	if (nLitLen > LITLEN_CODES || nDist > DIST_CODES)
+	{
+		return -1;
+	}
+
+	BYTE arrLengths[LITLEN_CODES + DIST_CODES] = { 0 };
+	for (UINT32 i = 0; i < nCodeLen; i++)
+	{
+		UINT32 nValue;
+		if (!GetBits(3, nValue))
+		{
+			return 0;
+		}
+		arrLengths[s_arrCodeLengthOrder[i]] = static_cast<BYTE>(nValue);
+	}
+	// the code length code is decoded with m_lenCode, rebuilt below
+	if (BuildHuffman(m_lenCode, arrLengths, CODE_LENGTH_CODES) != 0)
+	{
+		return -1;
+	}
+
+	const UINT32 nTotal = nLitLen + nDist;
+	UINT32 nIndex = 0;
+	while (nIndex < nTotal)
+	{
+		int nSymbol = Decode(m_lenCode);
+		if (nSymbol == -1)
+		{
+			return 0;
+		}
+		if (nSymbol < 0)
+		{
+			return -1;
+		}
+		if (nSymbol < 16)
+		{
+			arrLengths[nIndex++] = static_cast<BYTE>(nSymbol);
+			continue;
+		}
+		BYTE nRepeated = 0;
+		UINT32 nRun;
+		if (nSymbol == 16)
+		{
+			if (nIndex == 0)
+			{
+				return -1;
+			}
+			nRepeated = arrLengths[nIndex - 1];
+			if (!GetBits(2, nRun))
+			{
+				return 0;
+			}
+			nRun += 3;
+		}
+		else if (nSymbol == 17)
+		{
+			if (!GetBits(3, nRun))
+			{
+				return 0;
+			}
+			nRun += 3;
+		}
+		else
+		{
+			if (!GetBits(7, nRun))
+			{
+				return 0;
+			}
+			nRun += 11;
+		}
+		if (nIndex + nRun > nTotal)
+		{
+			return -1;
+		}
+		std::fill(arrLengths + nIndex, arrLengths + nIndex + nRun, nRepeated);
+		nIndex += nRun;
+	}
+	if (arrLengths[END_OF_BLOCK] == 0)
+	{
+		return -1;
+	}
+
+	// incomplete codes are only allowed for a single length
+	int nLeft = BuildHuffman(m_lenCode, arrLengths, nLitLen);
+	if (nLeft < 0 || (nLeft > 0 && nLitLen - m_lenCode.arrCount[0] != 1))
+	{
+		return -1;
+	}
+	nLeft = BuildHuffman(m_distCode, arrLengths + nLitLen, nDist);
+	if (nLeft < 0 || (nLeft > 0 && nDist - m_distCode.arrCount[0] != 1))
+	{
+		return -1;
+	}
+	return 1;
+}
+
+// @return 0 when the block ended or more input is needed, -1 on corrupt data
+int Inflate::DecodeCodes(bool final, ISink* sink)
+{
+	while (true)
+	{
+		// unless this is the end of the input, only start on a symbol that is all there
+		if (!final && GetAvailableBits() < MAX_SYMBOL_BITS)
+		{
+			return 0;
+		}
+		int nSymbol = Decode(m_lenCode);
+		if (nSymbol < 0)
+		{
+			return -1;
+		}
+		if (nSymbol < END_OF_BLOCK)
+		{
+			m_vecWindow.push_back(static_cast<BYTE>(nSymbol));
+		}
+		else if (nSymbol == END_OF_BLOCK)
+		{
+			m_emState = m_bLastBlock ? STATE_DONE : STATE_HEADER;
+			return 0;
+		}
+		else
+		{
+			nSymbol -= END_OF_BLOCK + 1;
+			if (nSymbol >= 29)
+			{
+				return -1;
+			}
+			UINT32 nExtra;
+			if (!GetBits(s_arrLengthExtra[nSymbol], nExtra))
+			{
+				return -1;
+			}
+			const size_t nLength = s_arrLengthBase[nSymbol] + nExtra;
+
+			nSymbol = Decode(m_distCode);
+			if (nSymbol < 0 || nSymbol >= DIST_CODES)
+			{
+				return -1;
+			}
+			if (!GetBits(s_arrDistExtra[nSymbol], nExtra))
+			{
+				return -1;
+			}
+			const size_t nDist = s_arrDistBase[nSymbol] + nExtra;
+			if (nDist > m_vecWindow.size())
+			{
+				return -1;
+			}
+			// byte by byte, the match may overlap what it produces
+			size_t nFrom = m_vecWindow.size() - nDist;
+			for (size_t i = 0; i < nLength; i++)
+			{
+				m_vecWindow.push_back(m_vecWindow[nFrom + i]);
+			}
+		}
+		if (m_vecWindow.size() - m_nEmitted >= EMIT_SIZE && !Emit(sink))
+		{
+			return -1;
+		}
+	}
+}
+
+// @return the symbol, -1 when the input ran out, -2 for a code that is not in the table
+int Inflate::Decode(const Huffman& huffman)
+{
+	if (NeedBits(INFLATE_FAST_BITS))
+	{
+		const WORD wEntry = huffman.arrFast[m_ullBits & ((1 << INFLATE_FAST_BITS) - 1)];
+		if (wEntry != 0)
+		{
+			m_ullBits >>= wEntry & 15;
+			m_nBitCount -= wEntry & 15;
+			return wEntry >> 4;
+		}
+	}
+	// longer codes, or the last bits of the input, one bit at a time
+	int nCode = 0;
+	int nFirst = 0;
+	int nIndex = 0;
+	for (int nLength = 1; nLength <= MAX_CODE_BITS; nLength++)
+	{
+		if (!NeedBits(nLength))
+		{
+			return -1;
+		}
+		nCode |= static_cast<int>((m_ullBits >> (nLength - 1)) & 1);
+		const int nCount = huffman.arrCount[nLength];
+		if (nCode - nCount < nFirst)
+		{
+			m_ullBits >>= nLength;
+			m_nBitCount -= nLength;
+			return huffman.arrSymbol[nIndex + (nCode - nFirst)];
+		}
+		nIndex += nCount;
+		nFirst += nCount;
+		nFirst <<= 1;
+		nCode <<= 1;
+	}
+	return -2;
+}
+
+bool Inflate::Emit(ISink* sink)
+{
+	bool bRet = true;
+	if (m_vecWindow.size() > m_nEmitted)
+	{
+		bRet = sink->OnInflated(m_vecWindow.data() + m_nEmitted, m_vecWindow.size() - m_nEmitted);
+		m_nEmitted = m_vecWindow.size();
+	}
+	// keep only the history matches can reach
+	if (m_vecWindow.size() > 2 * INFLATE_WINDOW_SIZE)
+	{
+		m_vecWindow.erase(m_vecWindow.begin(), m_vecWindow.end() - INFLATE_WINDOW_SIZE);
+		m_nEmitted = m_vecWindow.size();
+	}
+	return bRet;
+}
+
+bool Inflate::NeedBits(int count)
+{
+	while (m_nBitCount < count)
+	{
+		if (m_nPos >= m_vecInput.size())
+		{
+			return false;
+		}
+		m_ullBits |= static_cast<UINT64>(m_vecInput[m_nPos++]) << m_nBitCount;
+		m_nBitCount += 8;
+	}
+	return true;
+}
+
+bool Inflate::GetBits(int count, UINT32& value)
+{
+	if (!NeedBits(count))
+	{
+		return false;
+	}
+	value = static_cast<UINT32>(m_ullBits & ((1ull << count) - 1));
+	m_ullBits >>= count;
+	m_nBitCount -= count;
+	return true;
+}
+
+size_t Inflate::GetAvailableBits() const
+{
+	return m_nBitCount + (m_vecInput.size() - m_nPos) * 8;
+}
+
+Inflate::BitState Inflate::SaveBits() const
+{
+	BitState state = { m_nPos, m_ullBits, m_nBitCount };
+	return state;
+}
+
+void Inflate::RestoreBits(const BitState& state)
+{
+	m_nPos = state.nPos;
+	m_ullBits = state.ullBits;
+	m_nBitCount = state.nCount;
+}
+
+// @return 0 for a complete code, more than 0 if incomplete, less than 0 if over-subscribed
+int Inflate::BuildHuffman(Huffman& huffman, const BYTE* lengths, int count)
+{
+	std::fill(huffman.arrCount, huffman.arrCount + 16, 0);
+	for (int i = 0; i < count; i++)
+	{
+		huffman.arrCount[lengths[i]]++;
+	}
+	std::fill(huffman.arrFast, huffman.arrFast + (1 << INFLATE_FAST_BITS), 0);
+	if (huffman.arrCount[0] == count)
+	{
+		// no codes, decoding anything with it fails
+		return 0;
+	}
+
+	int nLeft = 1;
+	for (int nLength = 1; nLength <= MAX_CODE_BITS; nLength++)
+	{
+		nLeft <<= 1;
+		nLeft -= huffman.arrCount[nLength];
+		if (nLeft < 0)
+		{
+			return nLeft;
+		}
+	}
+
+	WORD arrOffset[16];
+	arrOffset[1] = 0;
+	for (int nLength = 1; nLength < MAX_CODE_BITS; nLength++)
+	{
+		arrOffset[nLength + 1] = arrOffset[nLength] + huffman.arrCount[nLength];
+	}
+	for (int i = 0; i < count; i++)
+	{
+		if (lengths[i] != 0)
+		{
+			huffman.arrSymbol[arrOffset[lengths[i]]++] = static_cast<WORD>(i);
+		}
+	}
+
+	// codes are sent most significant bit first, the table is indexed by the bits as read
+	int nCode = 0;
+	int nIndex = 0;
+	for (int nLength = 1; nLength <= INFLATE_FAST_BITS; nLength++)
+	{
+		for (int i = 0; i < huffman.arrCount[nLength]; i++, nIndex++, nCode++)
+		{
+			int nReversed = 0;
+			for (int bit = 0; bit < nLength; bit++)
+			{
+				nReversed |= ((nCode >> bit) & 1) << (nLength - 1 - bit);
+			}
+			const WORD wEntry = static_cast<WORD>((huffman.arrSymbol[nIndex] << 4) | nLength);
+			for (int fill = nReversed; fill < (1 << INFLATE_FAST_BITS); fill += 1 << nLength)
+			{
+				huffman.arrFast[fill] = wEntry;
+			}
+		}
+		nCode <<= 1;
+	}
+	return nLeft;
+}
@@ -0,0 +1,111 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include "SysDef.h"
+
+#define INFLATE_WINDOW_SIZE		32768
+#define INFLATE_FAST_BITS		9
+#define INFLATE_MAX_SYMBOLS		320
+
+/**
+ * Streaming raw inflate (RFC 1951), the counterpart of Deflate. Input may be
+ * cut anywhere: Feed decodes as far as the data allows and keeps the tail
+ * for the next call. Output is handed to a sink in pieces that point into
+ * the sliding window, valid only during the call.
+ */
+class Inflate
+{
+public:
+	interface ISink
+	{
+		// @return false to stop decoding
+		virtual bool OnInflated(const BYTE* data, size_t length) = 0;
+	};
+
+private:
+	enum State
+	{
+		STATE_HEADER,
+		STATE_STORED,
+		STATE_CODES,
+		STATE_DONE,
+		STATE_ERROR,
+	};
+
+	// canonical code as in RFC 1951, plus a table for codes of up to INFLATE_FAST_BITS
+	struct Huffman
+	{
+		WORD arrCount[16];
+		WORD arrSymbol[INFLATE_MAX_SYMBOLS];
+		WORD arrFast[1 << INFLATE_FAST_BITS];	// symbol << 4 | length, 0 for longer codes
+	};
+
+	struct BitState
+	{
+		size_t nPos;
+		UINT64 ullBits;
+		int nCount;
+	};
+
+private:
+	std::vector<BYTE> m_vecInput;
+	size_t m_nPos;
+	UINT64 m_ullBits;
+	int m_nBitCount;
+	State m_emState;
+	bool m_bLastBlock;
+	size_t m_nStoredLeft;
+	Huffman m_lenCode;
+	Huffman m_distCode;
+	std::vector<BYTE> m_vecWindow;
+	size_t m_nEmitted;
+
+public:
+	Inflate();
+
+	void Reset();
+
+	/**
+	 * Decodes as much of the stream as the input allows.
+	 * @return 1 once the last block ended, 0 when more input is needed, -1 on corrupt data or if the sink stopped
+	 */
+	int Feed(const BYTE* data, size_t length, ISink* sink);
+
+	// decodes what is left at the end of the input, a stream that is not complete then is an error
+	int Finish(ISink* sink);
+
+	// hands over the input that followed the end of the stream, such as a gzip trailer
+	void TakeRemainder(std::vector<BYTE>& rest);
+
+private:
+	int Run(bool final, ISink* sink);
+	int ReadBlockHeader();
+	int ReadDynamicTables();
+	int DecodeCodes(bool final, ISink* sink);
+	int Decode(const Huffman& huffman);
+	bool Emit(ISink* sink);
+
+	bool NeedBits(int count);
+	bool GetBits(int count, UINT32& value);
+	size_t GetAvailableBits() const;
+	BitState SaveBits() const;
+	void RestoreBits(const BitState& state);
+
+	static int BuildHuffman(Huffman& huffman, const BYTE* lengths, int count);
+};
@@ -0,0 +1,71 @@
+/*
+AdbWinGui (Android Debug Bridge Windows GUI)
+Copyright (C) 2017  singun
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "SysDef.h"
+#include "FileReadWrite.h"
+
+class Pipe
+{
+private:
+	FileReadWrite m_fRead;
+	FileReadWrite m_fWrite;
+
+public:
+	Pipe()
+	{
+		m_fRead.Create();
+		m_fWrite.Create();
+	}
+
+	~Pipe()
+	{
+		CloseRead();
+		CloseWrite();
+		m_fRead.Delete();
+		m_fWrite.Delete();
+	}
+
+	BOOL Open(DWORD dwBufferSize)
+	{
+		return ::CreatePipe(m_fRead.Get(), m_fWrite.Get(), NULL, dwBufferSize);
+	}
+
+	FileReadWrite& GetRead()
+	{
+		return m_fRead;
+	}
+
+	FileReadWrite& GetWrite()
+	{
+		return m_fWrite;
+	}
+
+	// the other end sees a broken pipe once its peer is closed,
+	// the handles stay allocated until the pipe is destroyed
+	void CloseRead()
+	{
+		m_fRead.Close();
+	}
+
+	void CloseWrite()
+	{
+		m_fWrite.Close();
+	}
+};
@@ -23,10 +23,17 @@ SocketClient::SocketClient()
 {
 	m_sockClient = 0;
 	m_bBlocking = true;
+	m_nTimeout = 0;
+	m_hCancelEvent = NULL;
+	m_hSocketEvent = WSA_INVALID_EVENT;
 }
 
 SocketClient::~SocketClient()
 {
+	if (m_hSocketEvent != WSA_INVALID_EVENT)
+	{
+		::WSACloseEvent(m_hSocketEvent);
+	}
 }
 
 SocketClient* SocketClient::Open(const SocketAddress& addSocket)
@@ -60,6 +67,7 @@ INT SocketClient::Close()
 	{
 		return NO_ERROR;
 	}
+	ReleaseSocketEvent();
 	INT nRet = closesocket(m_sockClient);
 	if (nRet == NO_ERROR)
 	{
@@ -100,6 +108,8 @@ BOOL SocketClient::SetTimeout(INT nTimeout)
 	INT nRet = setsockopt(m_sockClient, SOL_SOCKET, SO_RCVTIMEO, (const CHAR*)&nTimeout, sizeof(INT));
 	if (nRet == NO_ERROR)
 	{
+		// SO_RCVTIMEO does not apply to the event wait of a cancellable socket
+		m_nTimeout = nTimeout;
 		return TRUE;
 	}
 	return FALSE;
@@ -151,15 +161,52 @@ BOOL SocketClient::Connect(const SocketAddress& addSocket)
 	return TRUE;
 }
 
+BOOL SocketClient::SetCancelEvent(HANDLE hEvent)
+{
+	if (hEvent == NULL)
+	{
+		return ReleaseSocketEvent();
+	}
+	if (m_hSocketEvent == WSA_INVALID_EVENT)
+	{
+		m_hSocketEvent = ::WSACreateEvent();
+		if (m_hSocketEvent == WSA_INVALID_EVENT)
+		{
+			return FALSE;
+		}
+		// this also makes the socket non-blocking
+		INT nRet = ::WSAEventSelect(m_sockClient, m_hSocketEvent, FD_READ | FD_WRITE | FD_CLOSE);
+		if (nRet == SOCKET_ERROR)
+		{
+			::WSACloseEvent(m_hSocketEvent);
+			m_hSocketEvent = WSA_INVALID_EVENT;
+			return FALSE;
+		}
+	}
+	m_hCancelEvent = hEvent;
+	return TRUE;
+}
+
 INT SocketClient::Read(CHAR* cData, INT nLen)
 {
-	INT nRet = recv(m_sockClient, cData, nLen, 0);
-	if (nRet == SOCKET_ERROR)
+	while (true)
 	{
-		// recv error
-		return -1;
+		if (m_hCancelEvent != NULL && ::WaitForSingleObject(m_hCancelEvent, 0) == WAIT_OBJECT_0)
+		{
+			::WSASetLastError(WSAECANCELLED);
+			return -1;
+		}
+		INT nRet = recv(m_sockClient, cData, nLen, 0);
+		if (nRet != SOCKET_ERROR)
+		{
+			return nRet;
+		}
+		if (m_hCancelEvent == NULL || ::WSAGetLastError() != WSAEWOULDBLOCK || !WaitForSocket())
+		{
+			// recv error
+			return -1;
+		}
 	}
-	return nRet;
 }
 
 INT SocketClient::Write(const CHAR* cData, INT nLen)
@@ -168,13 +215,24 @@ INT SocketClient::Write(const CHAR* cData, INT nLen)
 	{
 		nLen = (INT) strlen(cData);
 	}
-	INT nRet = send(m_sockClient, cData, nLen, 0);
-	if (nRet == SOCKET_ERROR)
+	while (true)
 	{
-		// send error
-		return -1;
+		if (m_hCancelEvent != NULL && ::WaitForSingleObject(m_hCancelEvent, 0) == WAIT_OBJECT_0)
+		{
+			::WSASetLastError(WSAECANCELLED);
+			return -1;
+		}
+		INT nRet = send(m_sockClient, cData, nLen, 0);
+		if (nRet != SOCKET_ERROR)
+		{
+			return nRet;
+		}
+		if (m_hCancelEvent == NULL || ::WSAGetLastError() != WSAEWOULDBLOCK || !WaitForSocket())
+		{
+			// send error
+			return -1;
+		}
 	}
-	return nRet;
 }
 
 BOOL SocketClient::ImplConfigureBlocking(BOOL bBlock)
@@ -187,3 +245,42 @@ BOOL SocketClient::ImplConfigureBlocking(BOOL bBlock)
 	}
 	return TRUE;
 }
+
+BOOL SocketClient::WaitForSocket()
+{
+	// the cancel event comes first so it wins when both are signaled
+	WSAEVENT arrEvents[2] = { m_hCancelEvent, m_hSocketEvent };
+	DWORD dwTimeout = m_nTimeout > 0 ? static_cast<DWORD>(m_nTimeout) : WSA_INFINITE;
+	DWORD dwRet = ::WSAWaitForMultipleEvents(2, arrEvents, FALSE, dwTimeout, FALSE);
+	if (dwRet == WSA_WAIT_EVENT_0 + 1)
+	{
+		// the network event is re-armed by the next recv or send that would block
+		::WSAResetEvent(m_hSocketEvent);
+		return TRUE;
+	}
+	if (dwRet == WSA_WAIT_EVENT_0)
+	{
+		::WSASetLastError(WSAECANCELLED);
+	}
+	else if (dwRet == WSA_WAIT_TIMEOUT)
+	{
+		::WSASetLastError(WSAETIMEDOUT);
+	}
+	return FALSE;
+}
+
+BOOL SocketClient::ReleaseSocketEvent()
+{
+	m_hCancelEvent = NULL;
+	if (m_hSocketEvent == WSA_INVALID_EVENT)
+	{
+		return TRUE;
+	}
+	::WSAEventSelect(m_sockClient, m_hSocketEvent, 0);
+	::WSACloseEvent(m_hSocketEvent);
+	m_hSocketEvent = WSA_INVALID_EVENT;
+	// back to the blocking mode WSAEventSelect took away
+	ULONG ulMode = 0;
+	INT nRet = ioctlsocket(m_sockClient, FIONBIO, &ulMode);
+	return nRet == NO_ERROR ? TRUE : FALSE;
+}
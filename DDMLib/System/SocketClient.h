@@ -26,6 +26,9 @@ class SocketClient
 private:
 	SOCKET m_sockClient;
 	BOOL m_bBlocking;
+	INT m_nTimeout;
+	HANDLE m_hCancelEvent;
+	WSAEVENT m_hSocketEvent;
 
 private:
 	SocketClient();
@@ -40,10 +43,14 @@ public:
 	BOOL SetTimeout(INT nTimeout);
 	INT GetTimeout();
 	BOOL ConfigureBlocking(BOOL bBlock);
+	// while set, Read and Write wait on the event too and fail with WSAECANCELLED once it is signaled
+	BOOL SetCancelEvent(HANDLE hEvent);
 	BOOL Connect(const SocketAddress& addSocket);
 	INT Read(CHAR* cData, INT nLen);
 	INT Write(const CHAR* cData, INT nLen = -1);
 
 private:
 	BOOL ImplConfigureBlocking(BOOL bBlock);
+	BOOL WaitForSocket();
+	BOOL ReleaseSocketEvent();
 };
\ No newline at end of file